@@ -10,7 +10,8 @@ SUBDIRS += src/core \
     src/plugins \
     src/acoustid \
     src/tageditor \
-    src/player
+    src/player \
+    src/benchmark
 
 RESOURCES += src/player/mp.qrc \
     src/tabplaylists/mp.qrc \
@@ -0,0 +1,38 @@
+QT       += widgets multimedia sql
+
+TEMPLATE = app
+
+TARGET = miam-benchmark
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    scanbenchmark.cpp \
+    syntheticlibrary.cpp
+
+HEADERS += scanbenchmark.h \
+    syntheticlibrary.h
+
+CONFIG(debug, debug|release) {
+    win32: LIBS += -L$$PWD/../../lib/debug/win-x64/ -ltag -L$$OUT_PWD/../core/debug/ -lmiam-core -lpsapi
+    OBJECTS_DIR = debug/.obj
+    MOC_DIR = debug/.moc
+    RCC_DIR = debug/.rcc
+}
+
+CONFIG(release, debug|release) {
+    win32: LIBS += -L$$PWD/../../lib/release/win-x64/ -ltag -L$$OUT_PWD/../core/release/ -lmiam-core -lpsapi
+    OBJECTS_DIR = release/.obj
+    MOC_DIR = release/.moc
+    RCC_DIR = release/.rcc
+}
+unix:!macx {
+    LIBS += -L$$OUT_PWD/../core/ -lmiam-core -L/usr/lib/x86_64-linux-gnu/ -ltag
+}
+macx {
+    LIBS += -L$$PWD/../../lib/osx/ -ltag -L$$OUT_PWD/../core/ -lmiam-core
+    QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.9
+}
+
+INCLUDEPATH += $$PWD/../core/ $$PWD/../core/3rdparty/
+DEPENDPATH += $$PWD/../core
@@ -0,0 +1,97 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTextStream>
+
+#include <QtDebug>
+
+#include "scanbenchmark.h"
+#include "syntheticlibrary.h"
+
+/**
+ * Two commands:
+ *   miam-benchmark generate [options] <folder>		writes a synthetic library
+ *   miam-benchmark scan [options] <folders...>		scans folders, like a music location would be, and prints results as JSON
+ */
+int main(int argc, char *argv[])
+{
+	// Nothing is ever shown, but settings need a QApplication for palettes and fonts
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
+	// Settings and library of the player are left alone: everything goes to test locations
+	QStandardPaths::setTestModeEnabled(true);
+	QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation));
+
+	QApplication app(argc, argv);
+	app.setApplicationName("miam-benchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measures how fast Miam-Player scans a music library.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("command", "generate: writes a synthetic library. scan: scans folders and reports results as JSON.");
+	parser.addPositionalArgument("folders", "Where the library is written, or folders to scan.", "<folders...>");
+
+	QCommandLineOption countOption("count", "Number of tracks to generate.", "n", "1000");
+	QCommandLineOption formatsOption("formats", "Comma separated formats among mp3, flac, ogg and m4a.", "list", "mp3,flac,ogg,m4a");
+	QCommandLineOption tracksOption("tracks-per-album", "Number of tracks in each album.", "n", "12");
+	QCommandLineOption albumsOption("albums-per-artist", "Number of albums of each artist.", "n", "3");
+	QCommandLineOption durationOption("duration", "Length of each track in seconds.", "seconds", "30");
+	QCommandLineOption tagSizeOption("tag-size", "Bytes of text in tags of each track.", "bytes", "256");
+	QCommandLineOption coverSizeOption("cover-size", "Width and height of embedded covers, 0 for none.", "pixels", "500");
+	QCommandLineOption folderCoversOption("folder-covers", "Adds a cover.jpg in each album folder.");
+	QCommandLineOption runsOption("runs", "Number of scans: a full one, then incremental ones.", "n", "2");
+	QCommandLineOption outputOption("output", "Writes results to a file instead of the standard output.", "file");
+	parser.addOptions({ countOption, formatsOption, tracksOption, albumsOption, durationOption, tagSizeOption,
+						coverSizeOption, folderCoversOption, runsOption, outputOption });
+	parser.process(app);
+
+	QStringList arguments = parser.positionalArguments();
+	if (arguments.size() < 2) {
+		parser.showHelp(1);
+	}
+	QString command = arguments.takeFirst();
+
+	QJsonObject report;
+	if (command == "generate") {
+		SyntheticLibrary library(arguments.first());
+		library.setFormats(parser.value(formatsOption).split(',', QString::SkipEmptyParts));
+		library.setTracksPerAlbum(parser.value(tracksOption).toInt());
+		library.setAlbumsPerArtist(parser.value(albumsOption).toInt());
+		library.setDuration(parser.value(durationOption).toInt());
+		library.setTagSize(parser.value(tagSizeOption).toInt());
+		library.setCoverSize(parser.value(coverSizeOption).toInt());
+		library.setFolderCovers(parser.isSet(folderCoversOption));
+
+		QElapsedTimer timer;
+		timer.start();
+		int count = library.generate(parser.value(countOption).toInt());
+		report.insert("filesWritten", count);
+		report.insert("bytesWritten", library.bytesWritten());
+		report.insert("milliseconds", timer.elapsed());
+	} else if (command == "scan") {
+		ScanBenchmark benchmark(arguments);
+		benchmark.setRuns(parser.value(runsOption).toInt());
+		report = benchmark.run();
+	} else {
+		parser.showHelp(1);
+	}
+
+	QByteArray json = QJsonDocument(report).toJson();
+	if (parser.isSet(outputOption)) {
+		QFile output(parser.value(outputOption));
+		if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size()) {
+			qWarning() << "cannot write results to" << output.fileName();
+			return 1;
+		}
+	} else {
+		QTextStream(stdout) << json;
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "scanbenchmark.h"
+
+#include <model/sqlconnectionpool.h>
+#include <musicsearchengine.h>
+#include <settingsprivate.h>
+
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QSysInfo>
+#include <QThread>
+
+#include <QtDebug>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+ScanBenchmark::ScanBenchmark(const QStringList &locations)
+	: _runs(2)
+{
+	for (QString location : locations) {
+		_locations.append(QDir::toNativeSeparators(QDir(location).absolutePath()));
+	}
+}
+
+QJsonObject ScanBenchmark::run()
+{
+	SettingsPrivate *settings = SettingsPrivate::instance();
+	settings->setMusicLocations(_locations);
+
+	// No connection is opened yet: the first run always starts from an empty library. Its write-ahead log goes with it
+	QString dbPath = SqlConnectionPool::databasePath();
+	for (QString path : { dbPath, dbPath + "-wal", dbPath + "-shm" }) {
+		if (QFile::exists(path) && !QFile::remove(path)) {
+			qWarning() << Q_FUNC_INFO << "cannot remove previous library" << path;
+		}
+	}
+
+	QJsonArray runs;
+	for (int i = 0; i < _runs; i++) {
+		qint64 statementHits = SqlConnectionPool::statementCacheHits();
+		qint64 statementMisses = SqlConnectionPool::statementCacheMisses();
+
+		MusicSearchEngine engine;
+		engine.doSearch();
+		const ScanStatistics &statistics = engine.statistics();
+
+		QJsonObject statements;
+		statements.insert("hits", SqlConnectionPool::statementCacheHits() - statementHits);
+		statements.insert("misses", SqlConnectionPool::statementCacheMisses() - statementMisses);
+
+		QJsonObject stages;
+		stages.insert("walk", statistics.walkTime);
+		stages.insert("read", statistics.readTime);
+		stages.insert("write", statistics.writeTime);
+		stages.insert("finalize", statistics.finalizeTime);
+
+		QJsonObject result;
+		result.insert("run", i + 1);
+		result.insert("kind", i == 0 ? "full" : "incremental");
+		result.insert("entries", statistics.entryCount);
+		result.insert("filesRead", statistics.fileCount);
+		result.insert("milliseconds", statistics.totalTime);
+		result.insert("filesPerSecond", statistics.totalTime > 0 ? statistics.fileCount * 1000.0 / statistics.totalTime : 0.0);
+		result.insert("bytesRead", statistics.bytesRead);
+		result.insert("peakRssBytes", peakResidentSetSize());
+		result.insert("stagesMilliseconds", stages);
+		result.insert("statementCache", statements);
+		runs.append(result);
+	}
+
+	QJsonObject report;
+	report.insert("locations", QJsonArray::fromStringList(_locations));
+	report.insert("threads", QThread::idealThreadCount());
+	report.insert("platform", QSysInfo::prettyProductName());
+	report.insert("runs", runs);
+	return report;
+}
+
+/** Highest resident memory of this process so far, in bytes, or -1 if it's unknown on this platform. */
+qint64 ScanBenchmark::peakResidentSetSize()
+{
+#if defined(Q_OS_UNIX)
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(Q_OS_OSX)
+		return usage.ru_maxrss;
+#else
+		// Linux and BSD count kilobytes
+		return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+	}
+#elif defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+#endif
+	return -1;
+}
@@ -0,0 +1,36 @@
+#ifndef SCANBENCHMARK_H
+#define SCANBENCHMARK_H
+
+#include <QJsonObject>
+#include <QStringList>
+
+/**
+ * \brief		The ScanBenchmark class runs MusicSearchEngine::doSearch on some folders and reports what it took.
+ * \details		First run starts from an empty library, following runs are incremental rescans of the same folders. For each
+ *				run, results include files per second, bytes fetched from devices to parse tags, peak resident memory of the
+ *				process and the duration of each stage of the scan.
+ *				Settings and library must be redirected before this class is used, so that the library of the player isn't
+ *				touched: see main().
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class ScanBenchmark
+{
+private:
+	QStringList _locations;
+	int _runs;
+
+public:
+	explicit ScanBenchmark(const QStringList &locations);
+
+	/** Number of scans, the first one being a full scan. */
+	inline void setRuns(int runs) { _runs = qMax(1, runs); }
+
+	QJsonObject run();
+
+private:
+	/** Highest resident memory of this process so far, in bytes, or -1 if it's unknown on this platform. */
+	static qint64 peakResidentSetSize();
+};
+
+#endif // SCANBENCHMARK_H
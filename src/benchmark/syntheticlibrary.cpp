@@ -0,0 +1,432 @@
+#include "syntheticlibrary.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMap>
+#include <QtEndian>
+#include <QVector>
+
+#include <QtDebug>
+
+#include <taglib/attachedpictureframe.h>
+#include <taglib/flacfile.h>
+#include <taglib/flacpicture.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4coverart.h>
+#include <taglib/mp4file.h>
+#include <taglib/mp4item.h>
+#include <taglib/mp4tag.h>
+#include <taglib/mpegfile.h>
+#include <taglib/tag.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/xiphcomment.h>
+
+static const int sampleRate = 44100;
+static const int channels = 2;
+
+/** MPEG-1 Layer III, 128 kbps, 44.1 kHz, joint stereo: 1152 samples in 417 bytes. */
+static const char mpegFrameHeader[] = { '\xff', '\xfb', '\x90', '\x64' };
+static const int mpegFrameLength = 417;
+static const int mpegFrameSamples = 1152;
+
+/** Bytes per second of fake compressed streams. */
+static const int flacByteRate = 88200;
+static const int vorbisByteRate = 20000;
+static const int aacByteRate = 16000;
+
+/** Size of Vorbis audio packets, one per Ogg page. */
+static const int oggPacketLength = 8000;
+static const quint32 oggSerialNumber = 0x4d69616d;
+
+template<typename T>
+static QByteArray bigEndian(T value)
+{
+	QByteArray bytes(sizeof(T), 0);
+	qToBigEndian<T>(value, reinterpret_cast<uchar*>(bytes.data()));
+	return bytes;
+}
+
+template<typename T>
+static QByteArray littleEndian(T value)
+{
+	QByteArray bytes(sizeof(T), 0);
+	qToLittleEndian<T>(value, reinterpret_cast<uchar*>(bytes.data()));
+	return bytes;
+}
+
+static TagLib::String toTagLibString(const QString &s)
+{
+	return TagLib::String(s.toUtf8().constData(), TagLib::String::UTF8);
+}
+
+/** CRC of Ogg pages: polynomial 0x04c11db7, not reflected, initial value 0. */
+static quint32 oggChecksum(const QByteArray &page)
+{
+	static const QVector<quint32> table = []() {
+		QVector<quint32> t(256);
+		for (quint32 i = 0; i < 256; i++) {
+			quint32 r = i << 24;
+			for (int j = 0; j < 8; j++) {
+				r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : (r << 1);
+			}
+			t[i] = r;
+		}
+		return t;
+	}();
+
+	quint32 crc = 0;
+	for (char c : page) {
+		crc = (crc << 8) ^ table.at(((crc >> 24) ^ static_cast<quint8>(c)) & 0xff);
+	}
+	return crc;
+}
+
+/** A page with whole packets. Flags are 0x02 for the first page of a stream and 0x04 for the last one. */
+static QByteArray oggPage(const QList<QByteArray> &packets, quint8 flags, qint64 granulePosition, quint32 sequence)
+{
+	QByteArray segments;
+	QByteArray body;
+	for (const QByteArray &packet : packets) {
+		int length = packet.size();
+		for (; length >= 255; length -= 255) {
+			segments.append(static_cast<char>(255));
+		}
+		segments.append(static_cast<char>(length));
+		body.append(packet);
+	}
+
+	QByteArray page("OggS", 4);
+	page.append('\0');
+	page.append(static_cast<char>(flags));
+	page.append(littleEndian<qint64>(granulePosition));
+	page.append(littleEndian<quint32>(oggSerialNumber));
+	page.append(littleEndian<quint32>(sequence));
+	page.append(littleEndian<quint32>(0));
+	page.append(static_cast<char>(segments.size()));
+	page.append(segments);
+	page.append(body);
+
+	quint32 crc = oggChecksum(page);
+	qToLittleEndian<quint32>(crc, reinterpret_cast<uchar*>(page.data() + 22));
+	return page;
+}
+
+static QByteArray mp4Atom(const char *type, const QByteArray &payload)
+{
+	return bigEndian<quint32>(8 + payload.size()) + QByteArray(type, 4) + payload;
+}
+
+SyntheticLibrary::SyntheticLibrary(const QString &root)
+	: _root(QDir(root).absolutePath())
+	, _formats({ "mp3", "flac", "ogg", "m4a" })
+	, _tracksPerAlbum(12)
+	, _albumsPerArtist(3)
+	, _duration(30)
+	, _tagSize(256)
+	, _coverSize(500)
+	, _hasFolderCovers(false)
+	, _bytesWritten(0)
+{}
+
+/** Writes count tracks under the root folder. Returns how many of them were written successfully. */
+int SyntheticLibrary::generate(int count)
+{
+	// Skeletons only depend on the format and the duration, they are built once
+	QMap<QString, QByteArray> skeletons;
+	for (QString format : _formats) {
+		QString suffix = format.toLower();
+		if (suffix == "mp3") {
+			skeletons.insert(suffix, this->mpegSkeleton());
+		} else if (suffix == "flac") {
+			skeletons.insert(suffix, this->flacSkeleton());
+		} else if (suffix == "ogg") {
+			skeletons.insert(suffix, this->oggSkeleton());
+		} else if (suffix == "m4a") {
+			skeletons.insert(suffix, this->mp4Skeleton());
+		} else {
+			qDebug() << Q_FUNC_INFO << "unsupported format" << format;
+		}
+	}
+	if (skeletons.isEmpty()) {
+		return 0;
+	}
+	QStringList suffixes = skeletons.keys();
+
+	_cover = _coverSize > 0 ? encodeCover(_coverSize) : QByteArray();
+	QByteArray folderCover = _hasFolderCovers ? encodeCover(qMax(_coverSize, 300)) : QByteArray();
+
+	int written = 0;
+	for (int i = 0; i < count; i++) {
+		int albumIndex = i / _tracksPerAlbum;
+		int artistIndex = albumIndex / _albumsPerArtist;
+		QString suffix = suffixes.at(albumIndex % suffixes.size());
+		QString albumPath = QString("%1/Artist %2/Album %3").arg(_root)
+				.arg(artistIndex + 1, 4, 10, QChar('0'))
+				.arg(albumIndex % _albumsPerArtist + 1, 2, 10, QChar('0'));
+
+		if (i % _tracksPerAlbum == 0) {
+			QDir().mkpath(albumPath);
+			if (!folderCover.isEmpty()) {
+				QFile picture(albumPath + "/cover.jpg");
+				if (picture.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+					_bytesWritten += picture.write(folderCover);
+				}
+			}
+		}
+
+		QString filePath = QString("%1/%2 - Track %3.%4").arg(albumPath)
+				.arg(i % _tracksPerAlbum + 1, 2, 10, QChar('0'))
+				.arg(i + 1, 6, 10, QChar('0'))
+				.arg(suffix);
+		const QByteArray &skeleton = skeletons[suffix];
+		QFile file(filePath);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(skeleton) != skeleton.size()) {
+			qDebug() << Q_FUNC_INFO << "cannot write" << filePath << file.errorString();
+			continue;
+		}
+		file.close();
+
+		if (this->writeTags(filePath, suffix, i)) {
+			written++;
+			_bytesWritten += QFileInfo(filePath).size();
+		}
+	}
+	return written;
+}
+
+QByteArray SyntheticLibrary::encodeCover(int pixels)
+{
+	// Gradients with some noise: pictures don't compress better than real artworks
+	QImage image(pixels, pixels, QImage::Format_RGB32);
+	quint32 noise = 0x2545f491;
+	for (int y = 0; y < pixels; y++) {
+		QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+		for (int x = 0; x < pixels; x++) {
+			noise ^= noise << 13;
+			noise ^= noise >> 17;
+			noise ^= noise << 5;
+			line[x] = qRgb(x * 255 / pixels, y * 255 / pixels, noise & 0xff);
+		}
+	}
+	QByteArray bytes;
+	QBuffer buffer(&bytes);
+	buffer.open(QIODevice::WriteOnly);
+	image.save(&buffer, "JPG", 90);
+	return bytes;
+}
+
+QByteArray SyntheticLibrary::flacSkeleton() const
+{
+	quint64 sampleCount = static_cast<quint64>(_duration) * sampleRate;
+
+	// STREAMINFO: block sizes, unknown frame sizes, then rate (20 bits), channels - 1 (3), bits per sample - 1 (5),
+	// number of samples (36) and an empty MD5
+	QByteArray streamInfo;
+	streamInfo.append(bigEndian<quint16>(4096));
+	streamInfo.append(bigEndian<quint16>(4096));
+	streamInfo.append(QByteArray(6, '\0'));
+	streamInfo.append(bigEndian<quint64>((static_cast<quint64>(sampleRate) << 44) | (static_cast<quint64>(channels - 1) << 41) |
+										 (Q_UINT64_C(15) << 36) | sampleCount));
+	streamInfo.append(QByteArray(16, '\0'));
+
+	QByteArray data("fLaC", 4);
+	// Last metadata block, of type STREAMINFO. TagLib adds comments and pictures before frames
+	data.append('\x80');
+	data.append(bigEndian<quint32>(streamInfo.size()).right(3));
+	data.append(streamInfo);
+	data.append("\xff\xf8", 2);
+	data.append(QByteArray(_duration * flacByteRate, '\0'));
+	return data;
+}
+
+QByteArray SyntheticLibrary::mp4Skeleton() const
+{
+	static const QByteArray matrix = bigEndian<quint32>(0x00010000) + QByteArray(12, '\0') + bigEndian<quint32>(0x00010000) +
+			QByteArray(12, '\0') + bigEndian<quint32>(0x40000000);
+	quint32 duration = static_cast<quint32>(_duration);
+
+	QByteArray ftyp = QByteArray("M4A ", 4) + bigEndian<quint32>(0) + QByteArray("M4A mp42isom", 12);
+
+	QByteArray mvhd = QByteArray(12, '\0') + bigEndian<quint32>(1000) + bigEndian<quint32>(duration * 1000) +
+			bigEndian<quint32>(0x00010000) + bigEndian<quint16>(0x0100) + QByteArray(10, '\0') + matrix +
+			QByteArray(24, '\0') + bigEndian<quint32>(2);
+
+	QByteArray tkhd = bigEndian<quint32>(0x000007) + QByteArray(8, '\0') + bigEndian<quint32>(1) + QByteArray(4, '\0') +
+			bigEndian<quint32>(duration * 1000) + QByteArray(12, '\0') + bigEndian<quint16>(0x0100) + QByteArray(2, '\0') +
+			matrix + QByteArray(8, '\0');
+
+	QByteArray mdhd = QByteArray(12, '\0') + bigEndian<quint32>(sampleRate) + bigEndian<quint32>(duration * sampleRate) +
+			bigEndian<quint16>(0x55c4) + QByteArray(2, '\0');
+
+	QByteArray hdlr = QByteArray(8, '\0') + QByteArray("soun", 4) + QByteArray(12, '\0') + QByteArray("SoundHandler", 13);
+
+	// ES descriptor: AAC LC (0x40) in an audio stream (0x15), with its average bitrate where TagLib expects it
+	QByteArray esds = QByteArray(4, '\0') +
+			QByteArray("\x03\x19\x00\x01\x00" "\x04\x11\x40\x15\x00\x00\x00", 12) +
+			bigEndian<quint32>(aacByteRate * 8) + bigEndian<quint32>(aacByteRate * 8) +
+			QByteArray("\x05\x02\x12\x10" "\x06\x01\x02", 7);
+	QByteArray mp4a = QByteArray(6, '\0') + bigEndian<quint16>(1) + QByteArray(8, '\0') + bigEndian<quint16>(channels) +
+			bigEndian<quint16>(16) + QByteArray(4, '\0') + bigEndian<quint32>(static_cast<quint32>(sampleRate) << 16) +
+			mp4Atom("esds", esds);
+	QByteArray stsd = bigEndian<quint32>(0) + bigEndian<quint32>(1) + mp4Atom("mp4a", mp4a);
+
+	QByteArray emptyTable = bigEndian<quint32>(0) + bigEndian<quint32>(0);
+	QByteArray stbl = mp4Atom("stsd", stsd) + mp4Atom("stts", emptyTable) + mp4Atom("stsc", emptyTable) +
+			mp4Atom("stsz", bigEndian<quint32>(0) + emptyTable) + mp4Atom("stco", emptyTable);
+	QByteArray dinf = mp4Atom("dref", bigEndian<quint32>(0) + bigEndian<quint32>(1) + mp4Atom("url ", bigEndian<quint32>(1)));
+	QByteArray minf = mp4Atom("smhd", QByteArray(8, '\0')) + mp4Atom("dinf", dinf) + mp4Atom("stbl", stbl);
+	QByteArray mdia = mp4Atom("mdhd", mdhd) + mp4Atom("hdlr", hdlr) + mp4Atom("minf", minf);
+	QByteArray trak = mp4Atom("tkhd", tkhd) + mp4Atom("mdia", mdia);
+	QByteArray moov = mp4Atom("mvhd", mvhd) + mp4Atom("trak", trak);
+
+	return mp4Atom("ftyp", ftyp) + mp4Atom("moov", moov) + mp4Atom("mdat", QByteArray(_duration * aacByteRate, '\0'));
+}
+
+QByteArray SyntheticLibrary::mpegSkeleton() const
+{
+	QByteArray frame(mpegFrameHeader, sizeof(mpegFrameHeader));
+	frame.append(QByteArray(mpegFrameLength - frame.size(), '\0'));
+
+	int frameCount = _duration * sampleRate / mpegFrameSamples;
+	QByteArray data;
+	data.reserve(frameCount * mpegFrameLength);
+	for (int i = 0; i < frameCount; i++) {
+		data.append(frame);
+	}
+	return data;
+}
+
+QByteArray SyntheticLibrary::oggSkeleton() const
+{
+	QByteArray identification("\x01vorbis", 7);
+	identification.append(littleEndian<quint32>(0));
+	identification.append(static_cast<char>(channels));
+	identification.append(littleEndian<quint32>(sampleRate));
+	identification.append(littleEndian<qint32>(0));
+	identification.append(littleEndian<qint32>(vorbisByteRate * 8));
+	identification.append(littleEndian<qint32>(0));
+	// Block sizes 256 and 2048, then framing bit
+	identification.append('\xb8');
+	identification.append('\x01');
+
+	QByteArray vendor("Miam-Player benchmark");
+	QByteArray comment("\x03vorbis", 7);
+	comment.append(littleEndian<quint32>(vendor.size()));
+	comment.append(vendor);
+	comment.append(littleEndian<quint32>(0));
+	comment.append('\x01');
+
+	// Codebooks are never decoded by TagLib
+	QByteArray setup("\x05vorbis", 7);
+	setup.append(QByteArray(32, '\0'));
+
+	QByteArray data = oggPage({ identification }, 0x02, 0, 0);
+	data.append(oggPage({ comment, setup }, 0x00, 0, 1));
+
+	// Length is computed from the position of the last page
+	qint64 sampleCount = static_cast<qint64>(_duration) * sampleRate;
+	int pageCount = qMax(1, _duration * vorbisByteRate / oggPacketLength);
+	QByteArray packet(oggPacketLength, '\0');
+	for (int i = 0; i < pageCount; i++) {
+		bool isLastPage = i == pageCount - 1;
+		data.append(oggPage({ packet }, isLastPage ? 0x04 : 0x00, sampleCount * (i + 1) / pageCount, i + 2));
+	}
+	return data;
+}
+
+bool SyntheticLibrary::writeTags(const QString &filePath, const QString &suffix, int trackIndex) const
+{
+#ifdef _WIN32
+	TagLib::FileName fp(QDir::toNativeSeparators(filePath).toStdWString().data());
+#else
+	TagLib::String s(QDir::toNativeSeparators(filePath).toUtf8().constData(), TagLib::String::UTF8);
+	TagLib::FileName fp(s.toCString(true));
+#endif
+
+	int albumIndex = trackIndex / _tracksPerAlbum;
+	int artistIndex = albumIndex / _albumsPerArtist;
+	QString title = QString("Track %1").arg(trackIndex + 1, 6, 10, QChar('0'));
+	QString artist = QString("Artist %1").arg(artistIndex + 1, 4, 10, QChar('0'));
+	QString album = QString("Album %1").arg(albumIndex + 1, 5, 10, QChar('0'));
+
+	// Comment fills text fields up to the requested size
+	static const QString lorem = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ";
+	int commentLength = qMax(0, _tagSize - title.size() - artist.size() - album.size());
+	QString comment = lorem.repeated(commentLength / lorem.size() + 1).left(commentLength);
+
+	auto setFields = [&](TagLib::Tag *tag) {
+		tag->setTitle(toTagLibString(title));
+		tag->setArtist(toTagLibString(artist));
+		tag->setAlbum(toTagLibString(album));
+		tag->setGenre("Benchmark");
+		tag->setComment(toTagLibString(comment));
+		tag->setYear(1970 + artistIndex % 50);
+		tag->setTrack(trackIndex % _tracksPerAlbum + 1);
+	};
+
+	TagLib::ByteVector cover(_cover.constData(), _cover.size());
+	auto flacPicture = [&]() -> TagLib::FLAC::Picture* {
+		TagLib::FLAC::Picture *picture = new TagLib::FLAC::Picture;
+		picture->setType(TagLib::FLAC::Picture::FrontCover);
+		picture->setMimeType("image/jpeg");
+		picture->setWidth(_coverSize);
+		picture->setHeight(_coverSize);
+		picture->setColorDepth(24);
+		picture->setData(cover);
+		return picture;
+	};
+
+	bool isSaved = false;
+	if (suffix == "mp3") {
+		TagLib::MPEG::File file(fp, false);
+		if (file.isValid()) {
+			TagLib::ID3v2::Tag *tag = file.ID3v2Tag(true);
+			setFields(tag);
+			if (!_cover.isEmpty()) {
+				TagLib::ID3v2::AttachedPictureFrame *picture = new TagLib::ID3v2::AttachedPictureFrame;
+				picture->setMimeType("image/jpeg");
+				picture->setType(TagLib::ID3v2::AttachedPictureFrame::FrontCover);
+				picture->setPicture(cover);
+				tag->addFrame(picture);
+			}
+			isSaved = file.save(TagLib::MPEG::File::ID3v2);
+		}
+	} else if (suffix == "flac") {
+		TagLib::FLAC::File file(fp, false);
+		if (file.isValid()) {
+			setFields(file.xiphComment(true));
+			if (!_cover.isEmpty()) {
+				file.addPicture(flacPicture());
+			}
+			isSaved = file.save();
+		}
+	} else if (suffix == "ogg") {
+		TagLib::Vorbis::File file(fp, false);
+		if (file.isValid()) {
+			setFields(file.tag());
+			if (!_cover.isEmpty()) {
+				file.tag()->addPicture(flacPicture());
+			}
+			isSaved = file.save();
+		}
+	} else if (suffix == "m4a") {
+		TagLib::MP4::File file(fp, false);
+		if (file.isValid()) {
+			setFields(file.tag());
+			if (!_cover.isEmpty()) {
+				TagLib::MP4::CoverArtList covers;
+				covers.append(TagLib::MP4::CoverArt(TagLib::MP4::CoverArt::JPEG, cover));
+				file.tag()->setItem("covr", covers);
+			}
+			isSaved = file.save();
+		}
+	}
+
+	if (!isSaved) {
+		qDebug() << Q_FUNC_INFO << "tags couldn't be written in" << filePath;
+	}
+	return isSaved;
+}
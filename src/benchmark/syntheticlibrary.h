@@ -0,0 +1,75 @@
+#ifndef SYNTHETICLIBRARY_H
+#define SYNTHETICLIBRARY_H
+
+#include <QByteArray>
+#include <QStringList>
+
+/**
+ * \brief		The SyntheticLibrary class writes a fake music library, to measure scans on a known set of files.
+ * \details		Files are organized like a real library: Artist/Album/NN - Title.ext, one format per album. Audio streams are
+ *				only valid skeletons (MPEG frames, FLAC stream info, Vorbis headers in Ogg pages, MP4 atoms) filled with
+ *				silence, but their size matches the requested duration. Tags and pictures are then written by TagLib, like
+ *				any other tag editor would. The size of text fields and embedded covers can be set, to see how they weigh
+ *				on the scan.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class SyntheticLibrary
+{
+private:
+	QString _root;
+	QStringList _formats;
+	int _tracksPerAlbum;
+	int _albumsPerArtist;
+	int _duration;
+	int _tagSize;
+	int _coverSize;
+	bool _hasFolderCovers;
+
+	/** Picture embedded in every file, encoded only once. */
+	QByteArray _cover;
+
+	qint64 _bytesWritten;
+
+public:
+	explicit SyntheticLibrary(const QString &root);
+
+	/** Suffixes among mp3, flac, ogg and m4a. Each album has its own format, they are used in turn. */
+	inline void setFormats(const QStringList &formats) { _formats = formats; }
+
+	inline void setTracksPerAlbum(int tracks) { _tracksPerAlbum = qMax(1, tracks); }
+
+	inline void setAlbumsPerArtist(int albums) { _albumsPerArtist = qMax(1, albums); }
+
+	/** Length of each track in seconds, which drives the size of files. */
+	inline void setDuration(int seconds) { _duration = qMax(1, seconds); }
+
+	/** Approximate number of bytes in text fields of each file. */
+	inline void setTagSize(int bytes) { _tagSize = qMax(0, bytes); }
+
+	/** Width and height of embedded covers in pixels, 0 for files without picture. */
+	inline void setCoverSize(int pixels) { _coverSize = qMax(0, pixels); }
+
+	/** Adds a cover.jpg next to tracks of each album. */
+	inline void setFolderCovers(bool b) { _hasFolderCovers = b; }
+
+	/** Writes count tracks under the root folder. Returns how many of them were written successfully. */
+	int generate(int count);
+
+	inline qint64 bytesWritten() const { return _bytesWritten; }
+
+private:
+	static QByteArray encodeCover(int pixels);
+
+	QByteArray flacSkeleton() const;
+
+	QByteArray mp4Skeleton() const;
+
+	QByteArray mpegSkeleton() const;
+
+	QByteArray oggSkeleton() const;
+
+	bool writeTags(const QString &filePath, const QString &suffix, int trackIndex) const;
+};
+
+#endif // SYNTHETICLIBRARY_H
@@ -72,6 +72,9 @@ public slots:
 signals:
 	void modelReloadRequested();
 
+	/** Only some tracks have changed: views can update them without reloading everything. */
+	void tracksChanged(const QStringList &removedUris, const QStringList &savedUris);
+
 	void aboutToSendToTagEditor(const QList<QUrl> &tracks);
 };
 
@@ -0,0 +1,205 @@
+#include "boundedfilestream.h"
+
+#include <QtDebug>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** Bytes prefetched at the beginning of a file: tags, stream headers and first audio frames. */
+static const qint64 headWindow = 256 * 1024;
+
+/** Bytes prefetched at the end of a file: ID3v1 and APE footers, last MPEG frames or last Ogg page. */
+static const qint64 tailWindow = 64 * 1024;
+
+QAtomicInteger<qint64> BoundedFileStream::_totalBytesRead(0);
+
+BoundedFileStream::BoundedFileStream(const QString &filePath)
+	: TagLib::IOStream()
+	, _file(filePath)
+	, _filePath(filePath)
+	, _encodedName(QFile::encodeName(filePath))
+	, _headEnd(0)
+	, _tailOffset(0)
+	, _position(0)
+	, _length(0)
+	, _bytesRead(0)
+{
+	if (!_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+		qDebug() << Q_FUNC_INFO << "cannot open" << filePath << _file.errorString();
+		return;
+	}
+	_length = _file.size();
+	_headEnd = qMin(headWindow, _length);
+	_tailOffset = qMax(_headEnd, _length - tailWindow);
+	_head = this->readAt(0, _headEnd);
+	_tail = this->readAt(_tailOffset, _length - _tailOffset);
+
+	// File has been truncated since its size was read: it ends where reads have stopped
+	if (_head.size() < _headEnd) {
+		_length = _headEnd = _tailOffset = _head.size();
+		_tail.clear();
+	} else if (_tail.size() < _length - _tailOffset) {
+		_length = _tailOffset + _tail.size();
+	}
+}
+
+BoundedFileStream::~BoundedFileStream()
+{}
+
+/** Bytes fetched from devices by all streams since the application has started. */
+qint64 BoundedFileStream::totalBytesRead()
+{
+	return _totalBytesRead.load();
+}
+
+/** Asks the kernel to load windows of a file in the background, before a stream is opened. */
+void BoundedFileStream::prefetch(const QString &filePath)
+{
+#ifdef Q_OS_LINUX
+	int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	struct stat st;
+	if (::fstat(fd, &st) == 0) {
+		qint64 headEnd = qMin(headWindow, static_cast<qint64>(st.st_size));
+		qint64 tailOffset = qMax(headEnd, static_cast<qint64>(st.st_size) - tailWindow);
+		// Requests are only queued: the I/O scheduler can merge and order them while readers parse previous files
+		posix_fadvise(fd, 0, headEnd, POSIX_FADV_WILLNEED);
+		if (tailOffset < st.st_size) {
+			posix_fadvise(fd, tailOffset, st.st_size - tailOffset, POSIX_FADV_WILLNEED);
+		}
+	}
+	::close(fd);
+#else
+	Q_UNUSED(filePath)
+#endif
+}
+
+TagLib::FileName BoundedFileStream::name() const
+{
+#ifdef _WIN32
+	return TagLib::FileName(reinterpret_cast<const wchar_t*>(_filePath.utf16()));
+#else
+	return _encodedName.constData();
+#endif
+}
+
+TagLib::ByteVector BoundedFileStream::readBlock(unsigned long length)
+{
+	if (!this->isOpen() || _position >= _length || length == 0) {
+		return TagLib::ByteVector();
+	}
+	qint64 size = qMin(static_cast<qint64>(length), _length - _position);
+
+	TagLib::ByteVector data;
+	if (_position + size <= _headEnd) {
+		data = TagLib::ByteVector(_head.constData() + _position, size);
+	} else if (_position >= _tailOffset) {
+		data = TagLib::ByteVector(_tail.constData() + (_position - _tailOffset), size);
+	} else {
+		// Somewhere in the middle of the stream, like an MP4 atom or a big picture: read exactly what's needed
+		QByteArray bytes = this->readAt(_position, size);
+		data = TagLib::ByteVector(bytes.constData(), bytes.size());
+		size = bytes.size();
+	}
+	_position += size;
+	return data;
+}
+
+void BoundedFileStream::writeBlock(const TagLib::ByteVector &)
+{
+	qDebug() << Q_FUNC_INFO << "stream is read-only" << _filePath;
+}
+
+void BoundedFileStream::insert(const TagLib::ByteVector &, unsigned long, unsigned long)
+{
+	qDebug() << Q_FUNC_INFO << "stream is read-only" << _filePath;
+}
+
+void BoundedFileStream::removeBlock(unsigned long, unsigned long)
+{
+	qDebug() << Q_FUNC_INFO << "stream is read-only" << _filePath;
+}
+
+bool BoundedFileStream::readOnly() const
+{
+	return true;
+}
+
+bool BoundedFileStream::isOpen() const
+{
+	return _file.isOpen();
+}
+
+void BoundedFileStream::seek(long offset, Position p)
+{
+	switch (p) {
+	case Beginning:
+		_position = offset;
+		break;
+	case Current:
+		_position += offset;
+		break;
+	case End:
+		_position = _length + offset;
+		break;
+	}
+	_position = qMax(Q_INT64_C(0), _position);
+}
+
+long BoundedFileStream::tell() const
+{
+	return static_cast<long>(_position);
+}
+
+long BoundedFileStream::length()
+{
+	return static_cast<long>(_length);
+}
+
+void BoundedFileStream::truncate(long)
+{
+	qDebug() << Q_FUNC_INFO << "stream is read-only" << _filePath;
+}
+
+void BoundedFileStream::addBytesRead(qint64 bytes)
+{
+	_bytesRead += bytes;
+	_totalBytesRead.fetchAndAddRelaxed(bytes);
+}
+
+/** Bytes which could be read: fewer than length at the end of the file, or if it has been truncated. */
+QByteArray BoundedFileStream::readAt(qint64 offset, qint64 length)
+{
+	if (length <= 0) {
+		return QByteArray();
+	}
+#ifdef Q_OS_UNIX
+	// Reads at an offset leave the position of the descriptor alone, short reads are resumed until the end of the file
+	QByteArray bytes(length, Qt::Uninitialized);
+	qint64 count = 0;
+	while (count < length) {
+		ssize_t n = ::pread(_file.handle(), bytes.data() + count, length - count, offset + count);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		count += n;
+	}
+	bytes.truncate(count);
+#else
+	if (!_file.seek(offset)) {
+		return QByteArray();
+	}
+	QByteArray bytes = _file.read(length);
+#endif
+	this->addBytesRead(bytes.size());
+	return bytes;
+}
@@ -0,0 +1,75 @@
+#ifndef BOUNDEDFILESTREAM_H
+#define BOUNDEDFILESTREAM_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QFile>
+
+#include <taglib/tiostream.h>
+
+#include "miamcore_global.h"
+
+/**
+ * \brief		The BoundedFileStream class is a read-only TagLib stream which keeps I/O close to where tags are.
+ * \details		Tags and stream headers are at the beginning of a file, footers (ID3v1, APE) and last frames are at the end.
+ *				Both windows are read at once when the stream is opened, reads which fall inside them are free. Other reads
+ *				fetch exactly what's needed. Files are never mapped: one which is truncated while it's being read would
+ *				crash the scan with SIGBUS, it's only seen shorter than expected here.
+ *				Every byte read from the device is counted, per stream and for the whole process.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY BoundedFileStream : public TagLib::IOStream
+{
+private:
+	QFile _file;
+	QString _filePath;
+	QByteArray _encodedName;
+
+	/** Windows [0, _headEnd[ and [_tailOffset, _length[. */
+	qint64 _headEnd;
+	qint64 _tailOffset;
+	QByteArray _head;
+	QByteArray _tail;
+
+	qint64 _position;
+	qint64 _length;
+	qint64 _bytesRead;
+
+	static QAtomicInteger<qint64> _totalBytesRead;
+
+public:
+	explicit BoundedFileStream(const QString &filePath);
+
+	virtual ~BoundedFileStream();
+
+	/** Bytes read from the device by this stream. */
+	inline qint64 bytesRead() const { return _bytesRead; }
+
+	/** Bytes fetched from devices by all streams since the application has started. */
+	static qint64 totalBytesRead();
+
+	/** Asks the kernel to load windows of a file in the background, before a stream is opened. */
+	static void prefetch(const QString &filePath);
+
+	/// TagLib::IOStream
+	virtual TagLib::FileName name() const override;
+	virtual TagLib::ByteVector readBlock(unsigned long length) override;
+	virtual void writeBlock(const TagLib::ByteVector &data) override;
+	virtual void insert(const TagLib::ByteVector &data, unsigned long start = 0, unsigned long replace = 0) override;
+	virtual void removeBlock(unsigned long start = 0, unsigned long length = 0) override;
+	virtual bool readOnly() const override;
+	virtual bool isOpen() const override;
+	virtual void seek(long offset, Position p = Beginning) override;
+	virtual long tell() const override;
+	virtual long length() override;
+	virtual void truncate(long length) override;
+
+private:
+	void addBytesRead(qint64 bytes);
+
+	/** Bytes which could be read: fewer than length at the end of the file, or if it has been truncated. */
+	QByteArray readAt(qint64 offset, qint64 length);
+};
+
+#endif // BOUNDEDFILESTREAM_H
@@ -0,0 +1,97 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QWaitCondition>
+
+/**
+ * \brief		The BoundedQueue class is a blocking FIFO used to connect stages of a pipeline running in different threads.
+ * \details		Producers are blocked when the queue is full, so a fast stage (like walking directories) cannot pile up an
+ *				unbounded amount of work while slower stages are still parsing files. Once closed, consumers drain remaining
+ *				items and are then released.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+template<typename T>
+class BoundedQueue
+{
+private:
+	QQueue<T> _items;
+	int _capacity;
+	bool _isClosed;
+
+	QMutex _mutex;
+	QWaitCondition _notEmpty;
+	QWaitCondition _notFull;
+
+public:
+	explicit BoundedQueue(int capacity)
+		: _capacity(qMax(1, capacity))
+		, _isClosed(false)
+	{}
+
+	/** Appends an item, waiting for a free slot if necessary. Returns false if the queue has been closed. */
+	bool push(const T &item)
+	{
+		QMutexLocker locker(&_mutex);
+		while (_items.size() >= _capacity && !_isClosed) {
+			_notFull.wait(&_mutex);
+		}
+		if (_isClosed) {
+			return false;
+		}
+		_items.enqueue(item);
+		_notEmpty.wakeOne();
+		return true;
+	}
+
+	/** Takes the oldest item, waiting for one if necessary. Returns false when the queue is both closed and empty. */
+	bool pop(T &item)
+	{
+		QMutexLocker locker(&_mutex);
+		while (_items.isEmpty() && !_isClosed) {
+			_notEmpty.wait(&_mutex);
+		}
+		if (_items.isEmpty()) {
+			return false;
+		}
+		item = _items.dequeue();
+		_notFull.wakeOne();
+		return true;
+	}
+
+	/** Takes the oldest item if one is available within timeout (in ms). Doesn't tell if the queue is closed, see isDrained(). */
+	bool tryPop(T &item, unsigned long timeout)
+	{
+		QMutexLocker locker(&_mutex);
+		if (_items.isEmpty() && !_isClosed) {
+			_notEmpty.wait(&_mutex, timeout);
+		}
+		if (_items.isEmpty()) {
+			return false;
+		}
+		item = _items.dequeue();
+		_notFull.wakeOne();
+		return true;
+	}
+
+	/** True when the queue is closed and every item has been consumed. */
+	bool isDrained()
+	{
+		QMutexLocker locker(&_mutex);
+		return _isClosed && _items.isEmpty();
+	}
+
+	/** Tells consumers that no more items will be pushed. */
+	void close()
+	{
+		QMutexLocker locker(&_mutex);
+		_isClosed = true;
+		_notEmpty.wakeAll();
+		_notFull.wakeAll();
+	}
+};
+
+#endif // BOUNDEDQUEUE_H
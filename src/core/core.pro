@@ -61,8 +61,12 @@ SOURCES += library/jumptowidget.cpp \
     model/genericdao.cpp \
     model/playlistdao.cpp \
     model/selectedtracksmodel.cpp \
+    model/librarysnapshot.cpp \
+    model/sqlconnectionpool.cpp \
     model/sqldatabase.cpp \
+    model/sqlqueryservice.cpp \
     model/trackdao.cpp \
+    model/trackrecord.cpp \
     styling/imageutils.cpp \
     styling/lineedit.cpp \
     styling/miamslider.cpp \
@@ -70,9 +74,11 @@ SOURCES += library/jumptowidget.cpp \
     widgets/seekbar.cpp \
     widgets/timelabel.cpp \
     widgets/volumeslider.cpp \
+    boundedfilestream.cpp \
     cover.cpp \
     filehelper.cpp \
     flowlayout.cpp \
+    librarywatcher.cpp \
     mediaplayer.cpp \
     mediaplaylist.cpp \
     miamsortfilterproxymodel.cpp \
@@ -97,8 +103,12 @@ HEADERS += interfaces/basicplugin.h \
     model/genericdao.h \
     model/playlistdao.h \
     model/selectedtracksmodel.h \
+    model/librarysnapshot.h \
+    model/sqlconnectionpool.h \
     model/sqldatabase.h \
+    model/sqlqueryservice.h \
     model/trackdao.h \
+    model/trackrecord.h \
     styling/imageutils.h \
     styling/lineedit.h \
     styling/miamslider.h \
@@ -110,10 +120,13 @@ HEADERS += interfaces/basicplugin.h \
     abstractmediaplayercontrol.h \
     abstractsearchdialog.h \
     abstractview.h \
+    boundedfilestream.h \
+    boundedqueue.h \
     cover.h \
     filehelper.h \
     flowlayout.h \
     imediaplayer.h \
+    librarywatcher.h \
     mediaplayer.h \
     mediaplaylist.h \
     miamcore_global.h \
@@ -3,6 +3,7 @@
 #include <QtDebug>
 
 #include <QBuffer>
+#include <QDir>
 #include <QImage>
 #include <QImageReader>
 #include <QHash>
@@ -47,3 +48,58 @@ Cover::Cover(const QString &fileName)
 		}
 	}
 }
+
+/** Score of a picture found next to tracks: the higher, the more likely it's the front cover. -1 if it's not a picture. */
+qint64 Cover::rank(const QFileInfo &picture)
+{
+	QString suffix = picture.suffix().toLower();
+	qint64 formatScore;
+	if (suffix == "png") {
+		formatScore = 3;
+	} else if (suffix == "jpg" || suffix == "jpeg") {
+		formatScore = 2;
+	} else if (suffix == "gif" || suffix == "bmp") {
+		formatScore = 1;
+	} else {
+		return -1;
+	}
+
+	// Well-known names first, then pictures which are not scans of the back or the booklet
+	QString name = picture.completeBaseName().toLower();
+	qint64 nameScore;
+	if (name == "cover") {
+		nameScore = 6;
+	} else if (name == "folder") {
+		nameScore = 5;
+	} else if (name == "front") {
+		nameScore = 4;
+	} else if (name.startsWith("albumart")) {
+		nameScore = 3;
+	} else if (name.contains("cover") || name.contains("front")) {
+		nameScore = 2;
+	} else if (name.contains("back") || name.contains("inlay") || name.contains("booklet") || name.contains("cd") ||
+			   name.contains("disc") || name.contains("inside")) {
+		nameScore = 0;
+	} else {
+		nameScore = 1;
+	}
+
+	// Then bigger pictures, then better formats when sizes are equal
+	qint64 size = qMin(picture.size(), (Q_INT64_C(1) << 44) - 1);
+	return (nameScore << 56) | (size << 4) | formatScore;
+}
+
+/** Picture with the best rank in a folder, or an empty string. */
+QString Cover::bestPictureInDirectory(const QString &dirPath)
+{
+	QString bestPicture;
+	qint64 bestRank = -1;
+	for (QFileInfo fileInfo : QDir(dirPath).entryInfoList(QDir::Files | QDir::Hidden)) {
+		qint64 r = rank(fileInfo);
+		if (r > bestRank) {
+			bestRank = r;
+			bestPicture = fileInfo.absoluteFilePath();
+		}
+	}
+	return bestPicture;
+}
@@ -1,6 +1,7 @@
 #ifndef COVER_H
 #define COVER_H
 
+#include <QFileInfo>
 #include <QString>
 #include <QUrl>
 
@@ -39,6 +40,12 @@ public:
 	inline bool hasChanged() const { return _hasChanged && !_data.isEmpty(); }
 
 	inline void setChanged(bool changed) { this->_hasChanged = changed; }
+
+	/** Score of a picture found next to tracks: the higher, the more likely it's the front cover. -1 if it's not a picture. */
+	static qint64 rank(const QFileInfo &picture);
+
+	/** Picture with the best rank in a folder, or an empty string. */
+	static QString bestPictureInDirectory(const QString &dirPath);
 };
 
 #endif // COVER_H
@@ -1,4 +1,5 @@
 #include "filehelper.h"
+#include "boundedfilestream.h"
 #include "cover.h"
 
 #include <algorithm>
@@ -8,6 +9,7 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QImage>
+#include <QSet>
 
 #include <taglib/taglib.h>
 #include <taglib/fileref.h>
@@ -24,6 +26,7 @@
 
 #include <taglib/id3v2tag.h>
 #include <taglib/id3v2frame.h>
+#include <taglib/id3v2framefactory.h>
 
 #include <taglib/attachedpictureframe.h>
 #include <taglib/popularimeterframe.h>
@@ -39,10 +42,39 @@
 
 #include <QtDebug>
 
-FileHelper::FileHelper(const QMediaContent &track)
+/** First value of a key in a generic map of properties, or an empty string. */
+static QString firstProperty(const TagLib::PropertyMap &properties, const char *key)
+{
+	auto it = properties.find(key);
+	if (it == properties.end() || it->second.isEmpty()) {
+		return QString();
+	}
+	return QString(it->second.front().toCString(true));
+}
+
+/** Frames of an ID3v2 tag with this identifier, if any. */
+static TagLib::ID3v2::FrameList findFrames(const TagLib::ID3v2::FrameListMap &frames, const char *frameId)
+{
+	auto it = frames.find(frameId);
+	return it == frames.end() ? TagLib::ID3v2::FrameList() : it->second;
+}
+
+/** Disc numbers can be stored like "1/2". */
+static int parseDiscNumber(const QString &strDiscNumber)
+{
+	if (strDiscNumber.contains('/')) {
+		return strDiscNumber.split('/').first().toInt();
+	} else {
+		return strDiscNumber.toInt();
+	}
+}
+
+FileHelper::FileHelper(const QMediaContent &track, ReadOptions options)
 	: _file(nullptr)
+	, _stream(nullptr)
 	, _fileType(EXT_UNKNOWN)
 	, _isValid(false)
+	, _options(options)
 {
 	bool b = init(QDir::fromNativeSeparators(track.canonicalUrl().toLocalFile()));
 	if (!b) {
@@ -57,10 +89,12 @@ FileHelper::FileHelper(const QMediaContent &track)
 	}
 }
 
-FileHelper::FileHelper(const QString &filePath)
+FileHelper::FileHelper(const QString &filePath, ReadOptions options)
 	: _file(nullptr)
+	, _stream(nullptr)
 	, _fileType(EXT_UNKNOWN)
 	, _isValid(false)
+	, _options(options)
 {
 	bool b = init(filePath);
 	if (!b) {
@@ -115,29 +149,40 @@ bool FileHelper::init(const QString &filePath)
 	TagLib::String s(QDir::toNativeSeparators(fileName).toUtf8().constData(), TagLib::String::UTF8);
 	TagLib::FileName fp(s.toCString(true));
 #endif
+	bool readProperties = !(_options & RO_SkipAudioProperties);
+
+	// Library scans only read tags: I/O can be limited to where tags and headers are
+	TagLib::IOStream *stream = nullptr;
+	if ((_options & RO_BoundedRead) && suffixes(ET_Standard).contains(suffix)) {
+		_stream = new BoundedFileStream(QDir::toNativeSeparators(fileName));
+		stream = _stream;
+	}
+
 	if (suffix == "ape") {
-		_file = new TagLib::APE::File(fp);
+		_file = stream ? new TagLib::APE::File(stream, readProperties) : new TagLib::APE::File(fp, readProperties);
 		_fileType = EXT_APE;
 	} else if (suffix == "asf") {
-		_file = new TagLib::ASF::File(fp);
+		_file = stream ? new TagLib::ASF::File(stream, readProperties) : new TagLib::ASF::File(fp, readProperties);
 		_fileType = EXT_ASF;
 	} else if (suffix == "flac") {
-		_file = new TagLib::FLAC::File(fp);
+		_file = stream ? new TagLib::FLAC::File(stream, TagLib::ID3v2::FrameFactory::instance(), readProperties)
+					   : new TagLib::FLAC::File(fp, readProperties);
 		_fileType = EXT_FLAC;
 	} else if (suffix == "m4a" || suffix == "mp4") {
-		_file = new TagLib::MP4::File(fp);
+		_file = stream ? new TagLib::MP4::File(stream, readProperties) : new TagLib::MP4::File(fp, readProperties);
 		_fileType = EXT_MP4;
 	} else if (suffix == "mpc") {
-		_file = new TagLib::MPC::File(fp);
+		_file = stream ? new TagLib::MPC::File(stream, readProperties) : new TagLib::MPC::File(fp, readProperties);
 		_fileType = EXT_MPC;
 	} else if (suffix == "mp3") {
-		_file = new TagLib::MPEG::File(fp);
+		_file = stream ? new TagLib::MPEG::File(stream, TagLib::ID3v2::FrameFactory::instance(), readProperties)
+					   : new TagLib::MPEG::File(fp, readProperties);
 		_fileType = EXT_MP3;
 	} else if (suffix == "ogg" || suffix == "oga") {
-		_file = new TagLib::Vorbis::File(fp);
+		_file = stream ? new TagLib::Vorbis::File(stream, readProperties) : new TagLib::Vorbis::File(fp, readProperties);
 		_fileType = EXT_OGG;
 	} else if (suffix == "opus") {
-		_file = new TagLib::Ogg::Opus::File(fp);
+		_file = stream ? new TagLib::Ogg::Opus::File(stream, readProperties) : new TagLib::Ogg::Opus::File(fp, readProperties);
 		_fileType = EXT_OGG;
 	} else {
 		_file = nullptr;
@@ -160,6 +205,11 @@ FileHelper::~FileHelper()
 		delete _file;
 		_file = nullptr;
 	}
+	// TagLib doesn't own streams, and they must outlive files
+	if (_stream != nullptr) {
+		delete _stream;
+		_stream = nullptr;
+	}
 }
 
 const QStringList FileHelper::suffixes(FileHelper::ExtensionTypes et, bool withPrefix)
@@ -198,6 +248,13 @@ const QStringList FileHelper::suffixes(FileHelper::ExtensionTypes et, bool withP
 	return filters;
 }
 
+/** True if a file can be added to the library. Suffixes are compared like when the file is opened, whatever their case. */
+bool FileHelper::isLibraryFile(const QFileInfo &fileInfo)
+{
+	static const QSet<QString> librarySuffixes = suffixes(ET_Standard | ET_GameMusicEmu).toSet();
+	return librarySuffixes.contains(fileInfo.suffix().toLower());
+}
+
 /** Field ArtistAlbum if exists (in a compilation for example). */
 QString FileHelper::artistAlbum() const
 {
@@ -311,14 +368,9 @@ int FileHelper::discNumber(bool canBeZero) const
 	default:
 		qDebug() << Q_FUNC_INFO << "Not yet implemented for this file type" << _fileType;
 	}
-	int disc = -1;
-	if (strDiscNumber.contains('/')) {
-		disc = strDiscNumber.split('/').first().toInt();
-	} else {
-		disc = strDiscNumber.toInt();
-		if (canBeZero && disc == 0) {
-			disc = -1;
-		}
+	int disc = parseDiscNumber(strDiscNumber);
+	if (canBeZero && disc == 0 && !strDiscNumber.contains('/')) {
+		disc = -1;
 	}
 	return disc;
 }
@@ -601,6 +653,130 @@ void FileHelper::setRating(int rating)
 	this->save();
 }
 
+/** Reads all fields in one pass over the tag. */
+FileHelper::Snapshot FileHelper::snapshot() const
+{
+	Snapshot snapshot;
+	if (_file == nullptr) {
+		return snapshot;
+	}
+
+	if (!(_options & RO_SkipAudioProperties)) {
+		snapshot.length = _file->audioProperties() ? _file->audioProperties()->length() : 0;
+	}
+
+	TagLib::Tag *tag = _file->tag();
+	if (tag == nullptr) {
+		return snapshot;
+	}
+	snapshot.title = QString(tag->title().toCString(true));
+	snapshot.artist = QString(tag->artist().toCString(true)).trimmed();
+	snapshot.album = QString(tag->album().toCString(true)).trimmed();
+	snapshot.genre = QString(tag->genre().toCString(true));
+	snapshot.comment = QString(tag->comment().toCString(true));
+	if (tag->track() < UINT_MAX) {
+		snapshot.trackNumber = tag->track();
+	}
+	if (tag->year() > 0 && tag->year() < INT_MAX) {
+		snapshot.year = QString::number(tag->year());
+	}
+
+	// Same fields as specific getters, but maps are built only once
+	QString strDiscNumber = "0";
+	switch (_fileType) {
+	case EXT_APE:
+	case EXT_MPC: {
+		TagLib::PropertyMap properties = _file->properties();
+		snapshot.artistAlbum = firstProperty(properties, "ALBUMARTIST");
+		strDiscNumber = firstProperty(properties, "DISCNUMBER");
+		break;
+	}
+	case EXT_OGG: {
+		TagLib::PropertyMap properties = _file->properties();
+		snapshot.artistAlbum = firstProperty(properties, "ALBUMARTIST");
+		if (snapshot.artistAlbum.isEmpty()) {
+			snapshot.artistAlbum = firstProperty(properties, "ALBUM ARTIST");
+		}
+		strDiscNumber = firstProperty(properties, "DISCNUMBER");
+		break;
+	}
+	case EXT_FLAC: {
+		TagLib::FLAC::File *flacFile = static_cast<TagLib::FLAC::File*>(_file);
+		if (flacFile->ID3v2Tag()) {
+			const TagLib::ID3v2::FrameListMap &frames = flacFile->ID3v2Tag()->frameListMap();
+			TagLib::ID3v2::FrameList tpe2 = findFrames(frames, "TPE2");
+			TagLib::ID3v2::FrameList tpos = findFrames(frames, "TPOS");
+			// Fallback to the generic map in case we didn't find the matching key
+			TagLib::PropertyMap properties;
+			if (tpe2.isEmpty() || tpos.isEmpty()) {
+				properties = flacFile->properties();
+			}
+			if (tpe2.isEmpty()) {
+				snapshot.artistAlbum = firstProperty(properties, "ALBUMARTIST");
+			} else {
+				snapshot.artistAlbum = QString(tpe2.front()->toString().toCString(true));
+			}
+			if (tpos.isEmpty()) {
+				strDiscNumber = firstProperty(properties, "DISCNUMBER");
+			} else {
+				strDiscNumber = QString(tpos.front()->toString().toCString(true));
+			}
+			snapshot.rating = this->ratingForID3v2(flacFile->ID3v2Tag());
+		} else if (flacFile->xiphComment()) {
+			const TagLib::Ogg::FieldListMap &fields = flacFile->xiphComment()->fieldListMap();
+			auto firstField = [&fields](const char *key) -> QString {
+				auto it = fields.find(key);
+				return (it == fields.end() || it->second.isEmpty()) ? QString() : QString(it->second.front().toCString(true));
+			};
+			snapshot.artistAlbum = firstField("ALBUMARTIST");
+			strDiscNumber = firstField("DISCNUMBER");
+			QString rating = firstField("RATING");
+			if (!rating.isEmpty()) {
+				snapshot.rating = rating.toInt();
+			}
+		}
+		snapshot.hasCover = !flacFile->pictureList().isEmpty();
+		break;
+	}
+	case EXT_MP4:
+		snapshot.artistAlbum = this->extractMp4Feature("aART");
+		strDiscNumber = firstProperty(_file->properties(), "DISCNUMBER");
+		break;
+	case EXT_MP3: {
+		TagLib::MPEG::File *mpegFile = static_cast<TagLib::MPEG::File*>(_file);
+		if (mpegFile->hasID3v2Tag()) {
+			const TagLib::ID3v2::FrameListMap &frames = mpegFile->ID3v2Tag()->frameListMap();
+			TagLib::ID3v2::FrameList tpe2 = findFrames(frames, "TPE2");
+			if (!tpe2.isEmpty()) {
+				snapshot.artistAlbum = QString(tpe2.front()->toString().toCString(true));
+			}
+			TagLib::ID3v2::FrameList tpos = findFrames(frames, "TPOS");
+			if (!tpos.isEmpty()) {
+				strDiscNumber = QString(tpos.front()->toString().toCString(true));
+			}
+			TagLib::ID3v2::FrameList pictures = findFrames(frames, "APIC");
+			for (TagLib::ID3v2::FrameList::ConstIterator it = pictures.begin(); it != pictures.end() && !snapshot.hasCover; it++) {
+				TagLib::ID3v2::AttachedPictureFrame *pictureFrame = static_cast<TagLib::ID3v2::AttachedPictureFrame*>(*it);
+				snapshot.hasCover = pictureFrame != nullptr && !pictureFrame->picture().isEmpty();
+			}
+			snapshot.rating = this->ratingForID3v2(mpegFile->ID3v2Tag());
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	snapshot.artistAlbum = snapshot.artistAlbum.trimmed();
+	snapshot.disc = parseDiscNumber(strDiscNumber);
+	return snapshot;
+}
+
+/** Bytes fetched from the device to read this file, only known with RO_BoundedRead. */
+qint64 FileHelper::bytesRead() const
+{
+	return _stream ? _stream->bytesRead() : 0;
+}
+
 bool FileHelper::isValid() const
 {
 	/*if (_file) {
@@ -807,7 +983,7 @@ QString FileHelper::extractVorbisFeature(const QString &featureToExtract) const
 int FileHelper::ratingForID3v2(TagLib::ID3v2::Tag *tag) const
 {
 	int r = -1;
-	TagLib::ID3v2::FrameList l = tag->frameListMap()["POPM"];
+	TagLib::ID3v2::FrameList l = findFrames(tag->frameListMap(), "POPM");
 	if (l.isEmpty()) {
 		return r;
 	}
@@ -8,7 +8,8 @@
 
 #include <QFileInfo>
 
-/// Forward declaration
+/// Forward declarations
+class BoundedFileStream;
 class Cover;
 
 /// Forward declaration
@@ -34,8 +35,12 @@ class MIAMCORE_LIBRARY FileHelper
 private:
 	TagLib::File *_file;
 
+	/** Only used to read tags in library scans, see RO_BoundedRead. */
+	BoundedFileStream *_stream;
+
 	int _fileType;
 	bool _isValid;
+	int _options;
 
 	QFileInfo _fileInfo;
 
@@ -62,6 +67,36 @@ public:
 	};
 	Q_DECLARE_FLAGS(ExtensionTypes, ExtensionType)
 
+	enum ReadOption {
+		RO_Default				= 0x000,
+		RO_SkipAudioProperties	= 0x001,	// Length is already known, don't decode stream headers
+		RO_BoundedRead			= 0x002		// Read-only, I/O is limited to the beginning and the end of the file
+	};
+	Q_DECLARE_FLAGS(ReadOptions, ReadOption)
+
+	/**
+	 * \brief		The Snapshot struct holds every field displayed in views or stored in the library.
+	 * \details	All fields are read at once by snapshot(), which is much cheaper than calling getters one by one.
+	 */
+	struct Snapshot
+	{
+		QString title;
+		QString artist;
+		QString artistAlbum;
+		QString album;
+		QString year;
+		QString genre;
+		QString comment;
+		int trackNumber;
+		int disc;
+		int rating;
+		/** In seconds, or -1 if audio properties were skipped. */
+		int length;
+		bool hasCover;
+
+		Snapshot() : trackNumber(0), disc(-1), rating(-1), length(-1), hasCover(false) {}
+	};
+
 	enum TagKey {
 		Artist
 	};
@@ -81,9 +116,9 @@ public:
 		Field_Year			= 12
 	};
 
-	explicit FileHelper(const QMediaContent &track);
+	explicit FileHelper(const QMediaContent &track, ReadOptions options = RO_Default);
 
-	explicit FileHelper(const QString &filePath);
+	explicit FileHelper(const QString &filePath, ReadOptions options = RO_Default);
 
 	static std::string keyToStdString(Field f);
 
@@ -95,6 +130,9 @@ public:
 
 	static const QStringList suffixes(FileHelper::ExtensionTypes et = FileHelper::ET_Standard, bool withPrefix = false);
 
+	/** True if a file can be added to the library. Suffixes are compared like when the file is opened, whatever their case. */
+	static bool isLibraryFile(const QFileInfo &fileInfo);
+
 	/** Field ArtistAlbum if exists (in a compilation for example). */
 	QString artistAlbum() const;
 	void setArtistAlbum(const QString &artistAlbum);
@@ -122,6 +160,12 @@ public:
 	/** Set or remove any rating. */
 	void setRating(int rating);
 
+	/** Reads all fields in one pass over the tag. */
+	Snapshot snapshot() const;
+
+	/** Bytes fetched from the device to read this file, only known with RO_BoundedRead. */
+	qint64 bytesRead() const;
+
 	/// Facade
 	bool isValid() const;
 	QString title() const;
@@ -155,5 +199,6 @@ private:
 /** Register this class to convert in QVariant. */
 Q_DECLARE_METATYPE(FileHelper::Field)
 Q_DECLARE_OPERATORS_FOR_FLAGS(FileHelper::ExtensionTypes)
+Q_DECLARE_OPERATORS_FOR_FLAGS(FileHelper::ReadOptions)
 
 #endif // FILEHELPER_H
@@ -0,0 +1,317 @@
+#include "librarywatcher.h"
+#include "filehelper.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <QtDebug>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/** Delay without any event before changes are sent. */
+static const int quietDelay = 1000;
+
+/** Maximum delay before changes are sent, even if the filesystem is still busy. */
+static const int maximumDelay = 5000;
+
+LibraryWatcher::LibraryWatcher(QObject *parent)
+	: QObject(parent)
+	, _fd(-1)
+	, _notifier(nullptr)
+	, _debounceTimer(new QTimer(this))
+{
+	_debounceTimer->setSingleShot(true);
+	_debounceTimer->setInterval(quietDelay);
+	connect(_debounceTimer, &QTimer::timeout, this, &LibraryWatcher::flush);
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+	this->unwatchAll();
+}
+
+/** True if the platform can notify changes by itself. */
+bool LibraryWatcher::isAvailable()
+{
+#ifdef Q_OS_LINUX
+	return true;
+#else
+	return false;
+#endif
+}
+
+/** Watches every folder under each location, recursively. Previous watches are discarded. */
+bool LibraryWatcher::watch(const QStringList &locations)
+{
+	this->unwatchAll();
+#ifdef Q_OS_LINUX
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_fd < 0) {
+		qWarning() << Q_FUNC_INFO << "inotify is not available:" << strerror(errno);
+		return false;
+	}
+	_notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
+	connect(_notifier, &QSocketNotifier::activated, this, &LibraryWatcher::readEvents);
+
+	for (QString location : locations) {
+		this->addWatchRecursively(QDir(location).absolutePath(), false);
+	}
+	return true;
+#else
+	Q_UNUSED(locations)
+	return false;
+#endif
+}
+
+void LibraryWatcher::unwatchAll()
+{
+#ifdef Q_OS_LINUX
+	if (_notifier) {
+		_notifier->setEnabled(false);
+		delete _notifier;
+		_notifier = nullptr;
+	}
+	if (_fd >= 0) {
+		// Closing the descriptor removes all watches at once
+		::close(_fd);
+		_fd = -1;
+	}
+#endif
+	_watches.clear();
+	_pendingMoves.clear();
+	_modified.clear();
+	_changes.clear();
+	_debounceTimer->stop();
+}
+
+void LibraryWatcher::addWatchRecursively(const QString &dirPath, bool reportFiles)
+{
+#ifdef Q_OS_LINUX
+	static const quint32 mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+	auto addWatch = [this](const QString &path) {
+		int wd = inotify_add_watch(_fd, QFile::encodeName(path).constData(), mask);
+		if (wd < 0) {
+			// Usually ENOSPC: fs.inotify.max_user_watches is too low for this library
+			qWarning() << Q_FUNC_INFO << "cannot watch" << path << strerror(errno);
+		} else {
+			_watches.insert(wd, path);
+		}
+	};
+
+	addWatch(dirPath);
+	QDirIterator it(dirPath, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		QString entry = it.next();
+		if (it.fileInfo().isDir()) {
+			addWatch(entry);
+		} else if (reportFiles && this->isAudioFile(entry)) {
+			// Files which were already in a folder created or moved in a location
+			_modified.insert(entry);
+		}
+	}
+#else
+	Q_UNUSED(dirPath)
+	Q_UNUSED(reportFiles)
+#endif
+}
+
+/** Same files as the ones a scan adds, so that a rescan doesn't remove them. */
+bool LibraryWatcher::isAudioFile(const QString &path) const
+{
+	return FileHelper::isLibraryFile(QFileInfo(path));
+}
+
+void LibraryWatcher::processEvent(int wd, quint32 mask, quint32 cookie, const QString &name)
+{
+#ifdef Q_OS_LINUX
+	if (mask & IN_Q_OVERFLOW) {
+		qDebug() << Q_FUNC_INFO << "inotify queue has overflowed, some events were lost";
+		_pendingMoves.clear();
+		_modified.clear();
+		_changes.clear();
+		emit overflow();
+		return;
+	}
+
+	// The watched folder itself has been removed, its parent has already reported it
+	if (mask & (IN_DELETE_SELF | IN_IGNORED)) {
+		_watches.remove(wd);
+		return;
+	}
+
+	// Both halves of a move are queued one after the other: an item whose move isn't completed by the next event has left the library
+	if (!(mask & IN_MOVED_TO) || !_pendingMoves.contains(cookie)) {
+		this->resolvePendingMoves();
+	}
+
+	auto it = _watches.constFind(wd);
+	if (it == _watches.constEnd() || name.isEmpty()) {
+		return;
+	}
+	QString path = it.value() + "/" + name;
+	bool isDir = mask & IN_ISDIR;
+
+	if (mask & IN_MOVED_FROM) {
+		// Wait for the other half of this event: if it never comes, the item was moved out of the library
+		_pendingMoves.insert(cookie, path);
+	} else if (mask & IN_MOVED_TO) {
+		QString oldPath = _pendingMoves.take(cookie);
+		if (oldPath.isEmpty()) {
+			// Moved in from a place which is not watched
+			if (isDir) {
+				this->addWatchRecursively(path, true);
+			} else if (this->isAudioFile(path)) {
+				_modified.insert(path);
+			}
+		} else if (isDir) {
+			this->renameWatches(oldPath, path);
+			this->renameModified(oldPath, path);
+			_changes.append(qMakePair(oldPath, path));
+		} else {
+			bool wasAudioFile = this->isAudioFile(oldPath);
+			bool isAudioFile = this->isAudioFile(path);
+			if (wasAudioFile && isAudioFile) {
+				this->renameModified(oldPath, path);
+				_changes.append(qMakePair(oldPath, path));
+			} else if (wasAudioFile) {
+				this->addRemoval(oldPath);
+			} else if (isAudioFile) {
+				_modified.insert(path);
+			}
+		}
+	} else if (mask & IN_CREATE) {
+		// New files are reported when they are closed, not when they are still being written
+		if (isDir) {
+			this->addWatchRecursively(path, true);
+		}
+	} else if (mask & IN_CLOSE_WRITE) {
+		if (this->isAudioFile(path)) {
+			_modified.insert(path);
+		}
+	} else if (mask & IN_DELETE) {
+		if (isDir || this->isAudioFile(path)) {
+			this->addRemoval(path);
+		}
+	}
+	this->scheduleFlush();
+#else
+	Q_UNUSED(wd)
+	Q_UNUSED(mask)
+	Q_UNUSED(cookie)
+	Q_UNUSED(name)
+#endif
+}
+
+void LibraryWatcher::renameWatches(const QString &oldPath, const QString &newPath)
+{
+	QString oldPrefix = oldPath + "/";
+	for (auto it = _watches.begin(); it != _watches.end(); ++it) {
+		if (it.value() == oldPath) {
+			it.value() = newPath;
+		} else if (it.value().startsWith(oldPrefix)) {
+			it.value() = newPath + it.value().mid(oldPath.length());
+		}
+	}
+}
+
+/** Moves are applied before files are read: a file written then renamed is read at its new path. */
+void LibraryWatcher::renameModified(const QString &oldPath, const QString &newPath)
+{
+	QString oldPrefix = oldPath + "/";
+	QStringList renamed;
+	for (auto it = _modified.begin(); it != _modified.end(); ) {
+		if (*it == oldPath || it->startsWith(oldPrefix)) {
+			renamed.append(newPath + it->mid(oldPath.length()));
+			it = _modified.erase(it);
+		} else {
+			++it;
+		}
+	}
+	for (QString path : renamed) {
+		_modified.insert(path);
+	}
+}
+
+/** Files under a removed item won't be read anymore. */
+void LibraryWatcher::addRemoval(const QString &path)
+{
+	QString prefix = path + "/";
+	for (auto it = _modified.begin(); it != _modified.end(); ) {
+		if (*it == path || it->startsWith(prefix)) {
+			it = _modified.erase(it);
+		} else {
+			++it;
+		}
+	}
+	_changes.append(qMakePair(path, QString()));
+}
+
+/** Items moved from a location to a folder which isn't watched. */
+void LibraryWatcher::resolvePendingMoves()
+{
+	for (QString oldPath : _pendingMoves) {
+		this->addRemoval(oldPath);
+	}
+	_pendingMoves.clear();
+}
+
+void LibraryWatcher::scheduleFlush()
+{
+	if (!_firstPendingEvent.isValid()) {
+		_firstPendingEvent.start();
+	}
+	if (_firstPendingEvent.elapsed() < maximumDelay) {
+		_debounceTimer->start();
+	} else if (!_debounceTimer->isActive()) {
+		_debounceTimer->start(0);
+	}
+}
+
+void LibraryWatcher::flush()
+{
+	_firstPendingEvent.invalidate();
+
+	this->resolvePendingMoves();
+	if (_modified.isEmpty() && _changes.isEmpty()) {
+		return;
+	}
+
+	QStringList modified = _modified.toList();
+	QList<QPair<QString, QString>> changes = _changes;
+	_modified.clear();
+	_changes.clear();
+	emit changesDetected(modified, changes);
+}
+
+void LibraryWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+	// Buffer is aligned like struct inotify_event, as recommended by inotify(7)
+	char buffer[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	forever {
+		ssize_t length = ::read(_fd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+		for (char *ptr = buffer; ptr < buffer + length; ) {
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(ptr);
+			QString name;
+			if (event->len > 0) {
+				name = QFile::decodeName(event->name);
+			}
+			this->processEvent(event->wd, event->mask, event->cookie, name);
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#endif
+}
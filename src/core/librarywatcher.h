@@ -0,0 +1,101 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+
+#include "miamcore_global.h"
+
+/// Forward declarations
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * \brief		The LibraryWatcher class reports files which were added, modified, removed or moved in music locations.
+ * \details		It's built on Linux inotify: every folder under a music location has its own watch, new folders are watched
+ *				as soon as they are created. Events are merged then sent in batches when the filesystem is quiet for a moment,
+ *				so copying a whole album results in one update of the library. When the kernel queue overflows, events are
+ *				lost and the owner has to rescan locations.
+ *				On other platforms, isAvailable() returns false and the owner should fall back to polling.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY LibraryWatcher : public QObject
+{
+	Q_OBJECT
+private:
+	int _fd;
+	QSocketNotifier *_notifier;
+
+	/** Merge events which are close in time. */
+	QTimer *_debounceTimer;
+
+	/** Changes can't be delayed forever if the filesystem is never quiet. */
+	QElapsedTimer _firstPendingEvent;
+
+	/** Watch descriptor -> absolute path of the folder. */
+	QHash<int, QString> _watches;
+
+	/** Items moved from a watched folder, waiting for the matching event with the same cookie. */
+	QHash<quint32, QString> _pendingMoves;
+
+	QSet<QString> _modified;
+
+	/** Removals and moves in the order they happened, a removal has no new path. */
+	QList<QPair<QString, QString>> _changes;
+
+public:
+	explicit LibraryWatcher(QObject *parent = nullptr);
+
+	virtual ~LibraryWatcher();
+
+	/** True if the platform can notify changes by itself. */
+	static bool isAvailable();
+
+	/** Watches every folder under each location, recursively. Previous watches are discarded. */
+	bool watch(const QStringList &locations);
+
+	void unwatchAll();
+
+private:
+	void addWatchRecursively(const QString &dirPath, bool reportFiles);
+
+	/** Same files as the ones a scan adds, so that a rescan doesn't remove them. */
+	bool isAudioFile(const QString &path) const;
+
+	/** Files under a removed item won't be read anymore. */
+	void addRemoval(const QString &path);
+
+	void processEvent(int wd, quint32 mask, quint32 cookie, const QString &name);
+
+	void renameWatches(const QString &oldPath, const QString &newPath);
+
+	/** Moves are applied before files are read: a file written then renamed is read at its new path. */
+	void renameModified(const QString &oldPath, const QString &newPath);
+
+	/** Items moved from a location to a folder which isn't watched. */
+	void resolvePendingMoves();
+
+	void scheduleFlush();
+
+private slots:
+	void flush();
+
+	void readEvents();
+
+signals:
+	/**
+	 * Removals and moves have to be applied in order, before modified files are read: a file can be moved then removed,
+	 * or renamed over another one. The new path of a removal is empty. Paths can be files or folders.
+	 */
+	void changesDetected(const QStringList &modified, const QList<QPair<QString, QString>> &changes);
+
+	/** Some events were lost: locations have to be scanned again. */
+	void overflow();
+};
+
+#endif // LIBRARYWATCHER_H
@@ -3,6 +3,7 @@
 #include "settings.h"
 #include "settingsprivate.h"
 #include "model/sqldatabase.h"
+#include "model/sqlqueryservice.h"
 #include <QDir>
 #include <QGuiApplication>
 #include <QMediaContent>
@@ -52,14 +53,20 @@ MediaPlayer::MediaPlayer(QObject *parent)
 	});
 	_localPlayer->audio()->setVolume(Settings::instance()->volume());
 
+	// When one is skipping tracks quickly, only the last one is looked up
 	connect(this, &MediaPlayer::currentMediaChanged, this, [=] (const QString &uri) {
-		QWindow *w = QGuiApplication::topLevelWindows().first();
-		TrackDAO t = SqlDatabase().selectTrackByURI(uri);
-		if (t.artist().isEmpty()) {
-			w->setTitle(t.title() + " - Miam Player");
-		} else {
-			w->setTitle(t.title() + " (" + t.artist() + ") - Miam Player");
-		}
+		QFuture<TrackDAO> track = SqlQueryService::instance()->submit<TrackDAO>(SqlQueryService::QP_Interactive, "windowTitle",
+																				SqlConnectionPool::AM_ReadOnly, [uri](SqlDatabase &db) {
+			return db.selectTrackByURI(uri);
+		});
+		SqlQueryService::whenReady<TrackDAO>(track, this, [] (const TrackDAO &t) {
+			QWindow *w = QGuiApplication::topLevelWindows().first();
+			if (t.artist().isEmpty()) {
+				w->setTitle(t.title() + " - Miam Player");
+			} else {
+				w->setTitle(t.title() + " (" + t.artist() + ") - Miam Player");
+			}
+		});
 	});
 
 	// Link core multimedia actions
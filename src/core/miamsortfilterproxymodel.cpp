@@ -85,6 +85,17 @@ void MiamSortFilterProxyModel::highlightMatchingText(const QString &text)
 	emit aboutToHighlightLetters(lettersToHighlight);
 }
 
+/** Items read from the library have a sort key: they are compared byte per byte, instead of with the locale. */
+bool MiamSortFilterProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+	const QVariant leftKey = left.data(Miam::DF_SortKey);
+	const QVariant rightKey = right.data(Miam::DF_SortKey);
+	if (leftKey.isValid() && rightKey.isValid()) {
+		return leftKey.toByteArray() < rightKey.toByteArray();
+	}
+	return QSortFilterProxyModel::lessThan(left, right);
+}
+
 /** Reduce the size of the library when the user is typing text. */
 void MiamSortFilterProxyModel::filterLibrary(const QString &filter)
 {
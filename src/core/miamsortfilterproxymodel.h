@@ -38,9 +38,12 @@ public:
 	/** For classes that are subclassing this filter, allow to change sort column (for models based on a Table for example). */
 	virtual int defaultSortColumn() const { return 0; }
 
-private:
+protected:
+	/** Items read from the library have a sort key: they are compared byte per byte, instead of with the locale. */
+	virtual bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
+
 	/** Reduce the size of the library when the user is typing text. */
-	void filterLibrary(const QString &filter);
+	virtual void filterLibrary(const QString &filter);
 
 signals:
 	void aboutToHighlightLetters(const QSet<QChar> &letters);
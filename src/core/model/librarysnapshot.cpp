@@ -0,0 +1,457 @@
+#include "librarysnapshot.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#include <QtDebug>
+
+#include <cstddef>
+#include <cstring>
+
+#include "sqldatabase.h"
+
+/** Increase it each time the layout of the file changes: snapshots written by previous versions are read again from the library. */
+static const quint32 formatVersion = 1;
+
+/** Snapshots are local caches, they are never read on a machine with another byte order. Just in case, they are rejected. */
+static const quint32 byteOrderMark = 0x01020304;
+
+/**
+ * First bytes of the file. Then come the offsets and sizes of strings, albums, tracks and the data of strings, with
+ * their fixed sizes. Every table is aligned on 4 bytes, so that records can be read in place.
+ */
+struct SnapshotHeader
+{
+	char magic[8];
+	quint32 version;
+	quint32 byteOrder;
+	qint64 libraryId;
+	qint64 generation;
+	quint32 stringCount;
+	quint32 albumCount;
+	quint32 trackCount;
+	quint32 reserved;
+	quint64 stringDataSize;
+	/** FNV-1a of every byte after the header. */
+	quint64 checksum;
+};
+
+static const char snapshotMagic[8] = { 'M', 'I', 'A', 'M', 'L', 'I', 'B', '\0' };
+
+static quint64 checksum(const uchar *data, qint64 size)
+{
+	quint64 hash = Q_UINT64_C(14695981039346656037);
+	for (qint64 i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= Q_UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+/** Builds the table of strings: each distinct text or sort key is stored once, padded so that the next one is aligned. */
+class StringTable
+{
+private:
+	QHash<QByteArray, quint32> _indexes;
+
+public:
+	QVector<quint32> entries;
+	QByteArray data;
+
+	StringTable()
+	{
+		// Empty and null values are the same in the library
+		entries << 0 << 0;
+		_indexes.insert(QByteArray(), 0);
+	}
+
+	quint32 add(const QByteArray &bytes)
+	{
+		auto it = _indexes.constFind(bytes);
+		if (it != _indexes.constEnd()) {
+			return it.value();
+		}
+		quint32 index = _indexes.size();
+		entries << data.size() << bytes.size();
+		data.append(bytes);
+		if (data.size() % 2 != 0) {
+			data.append('\0');
+		}
+		// Texts are only borrowed by the caller: keys must own their data
+		_indexes.insert(QByteArray(bytes.constData(), bytes.size()), index);
+		return index;
+	}
+
+	quint32 add(const QString &text)
+	{
+		return add(QByteArray::fromRawData(reinterpret_cast<const char*>(text.constData()), text.size() * sizeof(QChar)));
+	}
+};
+
+LibrarySnapshot::LibrarySnapshot()
+	: _data(nullptr)
+	, _size(0)
+	, _libraryId(0)
+	, _generation(-1)
+	, _albums(nullptr)
+	, _tracks(nullptr)
+	, _albumCount(0)
+	, _trackCount(0)
+	, _strings(nullptr)
+	, _stringCount(0)
+	, _stringData(nullptr)
+{}
+
+LibrarySnapshot::~LibrarySnapshot()
+{
+	this->detach();
+}
+
+/** Path to the file written next to the library. */
+QString LibrarySnapshot::path()
+{
+	QFileInfo library(SqlConnectionPool::databasePath());
+	return QDir::toNativeSeparators(library.absolutePath() + "/library.snapshot");
+}
+
+/** Maps the file of the previous snapshot. False if it's missing, if it was written by another version, or if it's damaged. */
+bool LibrarySnapshot::map()
+{
+	this->detach();
+	_file.setFileName(path());
+	if (!_file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	qint64 size = _file.size();
+	const uchar *data = size > 0 ? _file.map(0, size) : nullptr;
+	if (data && this->attach(data, size)) {
+		return true;
+	}
+	qDebug() << Q_FUNC_INFO << "snapshot is ignored" << _file.fileName();
+	this->detach();
+	return false;
+}
+
+/** Reads artists, albums and tracks from the library, in a single transaction. */
+bool LibrarySnapshot::read(SqlDatabase &db)
+{
+	return this->readTracks(db, nullptr);
+}
+
+/** Reads some tracks only, with their albums. There can't be more than maxTracksPerRead uris. */
+bool LibrarySnapshot::read(SqlDatabase &db, const QStringList &uris)
+{
+	if (uris.size() > maxTracksPerRead) {
+		return false;
+	}
+	return this->readTracks(db, &uris);
+}
+
+/** Reads every track if uris is null. */
+bool LibrarySnapshot::readTracks(SqlDatabase &db, const QStringList *uris)
+{
+	this->detach();
+
+	// Same parameters are bound to each statement
+	QString selectedTracks;
+	if (uris) {
+		QStringList placeholders;
+		for (int i = 0; i < uris->size(); i++) {
+			placeholders << "?";
+		}
+		selectedTracks = "SELECT %1 FROM tracks WHERE uri IN (" + placeholders.join(", ") + ")";
+	}
+	auto bindUris = [uris] (QSqlQuery &query) {
+		if (uris) {
+			for (QString uri : *uris) {
+				query.addBindValue(uri);
+			}
+		}
+	};
+
+	// Counter and rows are read from the same snapshot of the library, even if a scan is writing at the same time
+	db.transaction();
+	qint64 libraryId = 0, generation = 0;
+	if (!db.selectLibraryGeneration(libraryId, generation)) {
+		db.rollback();
+		return false;
+	}
+
+	StringTable strings;
+	QVector<Album> albums;
+	QHash<int, quint32> albumIndexes;
+	QSqlQuery qAlbums(db);
+	qAlbums.setForwardOnly(true);
+	qAlbums.prepare("SELECT al.id, al.name, al.normalizedName, al.year, al.cover, ar.name, ar.normalizedName, al.sortKey, ar.sortKey " \
+					"FROM albums al JOIN artists ar ON ar.id = al.artistId" +
+					(uris ? " WHERE al.id IN (" + selectedTracks.arg("albumId") + ")" : QString()));
+	bindUris(qAlbums);
+	if (qAlbums.exec()) {
+		while (qAlbums.next()) {
+			Album a;
+			a.name = strings.add(qAlbums.value(1).toString());
+			a.normalizedName = strings.add(qAlbums.value(2).toString());
+			a.year = strings.add(qAlbums.value(3).toString());
+			a.cover = strings.add(qAlbums.value(4).toString());
+			a.artist = strings.add(qAlbums.value(5).toString());
+			a.artistNormalized = strings.add(qAlbums.value(6).toString());
+			a.sortKey = strings.add(qAlbums.value(7).toByteArray());
+			a.artistSortKey = strings.add(qAlbums.value(8).toByteArray());
+			albumIndexes.insert(qAlbums.value(0).toInt(), albums.size());
+			albums.append(a);
+		}
+	} else {
+		qDebug() << Q_FUNC_INFO << qAlbums.lastError();
+	}
+	qAlbums.finish();
+
+	QHash<int, quint32> artistNames;
+	QSqlQuery qArtists(db);
+	qArtists.setForwardOnly(true);
+	qArtists.prepare("SELECT id, name FROM artists" + (uris ? " WHERE id IN (" + selectedTracks.arg("artistId") + ")" : QString()));
+	bindUris(qArtists);
+	if (qArtists.exec()) {
+		while (qArtists.next()) {
+			artistNames.insert(qArtists.value(0).toInt(), strings.add(qArtists.value(1).toString()));
+		}
+	}
+	qArtists.finish();
+
+	QVector<Track> tracks;
+	QSqlQuery q(db);
+	q.setForwardOnly(true);
+	q.prepare("SELECT albumId, artistId, uri, trackNumber, title, length, rating, disc, internalCover, host, icon, sortKey " \
+			  "FROM tracks" + (uris ? " WHERE uri IN (" + selectedTracks.arg("uri") + ")" : QString()) + " ORDER BY uri");
+	bindUris(q);
+	if (!q.exec()) {
+		qDebug() << Q_FUNC_INFO << q.lastError();
+		db.rollback();
+		return false;
+	}
+	while (q.next()) {
+		Track t;
+		auto album = albumIndexes.constFind(q.value(0).toInt());
+		if (album == albumIndexes.constEnd()) {
+			// Can't happen with foreign keys, but an empty album is better than a missing track
+			album = albumIndexes.insert(q.value(0).toInt(), albums.size());
+			albums.append(Album());
+		}
+		t.album = album.value();
+		t.artist = artistNames.value(q.value(1).toInt());
+		t.uri = strings.add(q.value(2).toString());
+		t.trackNumber = strings.add(q.value(3).toString());
+		t.title = strings.add(q.value(4).toString());
+		t.length = q.value(5).toUInt();
+		t.rating = q.value(6).toInt();
+		t.disc = strings.add(q.value(7).toString());
+		t.icon = strings.add(q.value(10).toString());
+		t.sortKey = strings.add(q.value(11).toByteArray());
+		t.flags = 0;
+		if (q.value(8).toBool()) {
+			t.flags |= TF_InternalCover;
+		}
+		if (!q.value(9).toString().isEmpty()) {
+			t.flags |= TF_Remote;
+		}
+		tracks.append(t);
+	}
+	q.finish();
+	db.commit();
+
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+	header.version = formatVersion;
+	header.byteOrder = byteOrderMark;
+	header.libraryId = libraryId;
+	header.generation = generation;
+	header.stringCount = strings.entries.size() / 2;
+	header.albumCount = albums.size();
+	header.trackCount = tracks.size();
+	header.stringDataSize = strings.data.size();
+
+	QByteArray buffer;
+	buffer.reserve(sizeof(header) + strings.entries.size() * sizeof(quint32) + albums.size() * sizeof(Album) +
+				   tracks.size() * sizeof(Track) + strings.data.size());
+	buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	buffer.append(reinterpret_cast<const char*>(strings.entries.constData()), strings.entries.size() * sizeof(quint32));
+	buffer.append(reinterpret_cast<const char*>(albums.constData()), albums.size() * sizeof(Album));
+	buffer.append(reinterpret_cast<const char*>(tracks.constData()), tracks.size() * sizeof(Track));
+	buffer.append(strings.data);
+
+	const uchar *payload = reinterpret_cast<const uchar*>(buffer.constData()) + sizeof(header);
+	header.checksum = checksum(payload, buffer.size() - sizeof(header));
+	memcpy(buffer.data() + offsetof(SnapshotHeader, checksum), &header.checksum, sizeof(header.checksum));
+
+	_buffer = buffer;
+	return this->attach(reinterpret_cast<const uchar*>(_buffer.constData()), _buffer.size());
+}
+
+/** Replaces the file with rows which were read from the library. */
+bool LibrarySnapshot::write() const
+{
+	if (_data == nullptr) {
+		return false;
+	}
+	// Views which have mapped the previous file keep reading it until they have finished: it's replaced, not overwritten
+	QSaveFile file(path());
+	if (!file.open(QIODevice::WriteOnly) || file.write(reinterpret_cast<const char*>(_data), _size) != _size) {
+		qDebug() << Q_FUNC_INFO << "cannot write snapshot" << file.fileName() << file.errorString();
+		file.cancelWriting();
+		return false;
+	}
+	return file.commit();
+}
+
+/** True if rows were read from this library, and it hasn't changed since. */
+bool LibrarySnapshot::isFresh(SqlDatabase &db) const
+{
+	qint64 libraryId = 0, generation = 0;
+	return _data != nullptr && db.selectLibraryGeneration(libraryId, generation) &&
+			libraryId == _libraryId && generation == _generation;
+}
+
+/** Index of a track, or -1 if it's not in this snapshot. */
+int LibrarySnapshot::findTrack(const QString &uri) const
+{
+	// Tracks were sorted by SQLite, which compares texts byte per byte in UTF-8
+	const QByteArray key = uri.toUtf8();
+	quint32 first = 0, last = _trackCount;
+	while (first < last) {
+		quint32 middle = first + (last - first) / 2;
+		int c = qstrcmp(this->text(_tracks[middle].uri).toUtf8(), key);
+		if (c == 0) {
+			return middle;
+		} else if (c < 0) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+	return -1;
+}
+
+QString LibrarySnapshot::text(quint32 index) const
+{
+	if (index == 0 || index >= _stringCount) {
+		return QString();
+	}
+	QString &t = _texts[index];
+	if (t.isNull()) {
+		t = QString(reinterpret_cast<const QChar*>(_stringData + _strings[2 * index]), _strings[2 * index + 1] / sizeof(QChar));
+	}
+	return t;
+}
+
+/** Same as text(), without keeping a copy: for strings which are read only once. */
+QString LibrarySnapshot::readText(quint32 index) const
+{
+	if (index == 0 || index >= _stringCount) {
+		return QString();
+	}
+	if (!_texts.at(index).isNull()) {
+		return _texts.at(index);
+	}
+	return QString(reinterpret_cast<const QChar*>(_stringData + _strings[2 * index]), _strings[2 * index + 1] / sizeof(QChar));
+}
+
+QByteArray LibrarySnapshot::bytes(quint32 index) const
+{
+	if (index == 0 || index >= _stringCount) {
+		return QByteArray();
+	}
+	return QByteArray(reinterpret_cast<const char*>(_stringData + _strings[2 * index]), _strings[2 * index + 1]);
+}
+
+/** Checks the header, the checksum and every index, then points tables to the data. */
+bool LibrarySnapshot::attach(const uchar *data, qint64 size)
+{
+	if (size < static_cast<qint64>(sizeof(SnapshotHeader))) {
+		return false;
+	}
+	SnapshotHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 || header.version != formatVersion ||
+			header.byteOrder != byteOrderMark || header.stringCount == 0) {
+		return false;
+	}
+	quint64 expectedSize = sizeof(header) + quint64(header.stringCount) * 2 * sizeof(quint32) +
+			quint64(header.albumCount) * sizeof(Album) + quint64(header.trackCount) * sizeof(Track) + header.stringDataSize;
+	if (expectedSize != quint64(size) || header.checksum != checksum(data + sizeof(header), size - sizeof(header))) {
+		return false;
+	}
+
+	const uchar *p = data + sizeof(header);
+	const quint32 *strings = reinterpret_cast<const quint32*>(p);
+	p += header.stringCount * 2 * sizeof(quint32);
+	const Album *albums = reinterpret_cast<const Album*>(p);
+	p += header.albumCount * sizeof(Album);
+	const Track *tracks = reinterpret_cast<const Track*>(p);
+	p += header.trackCount * sizeof(Track);
+
+	// The checksum only proves the file is the one which was written: indexes are checked once, not on each access
+	for (quint32 i = 0; i < header.stringCount; i++) {
+		quint64 offset = strings[2 * i], length = strings[2 * i + 1];
+		if (offset % sizeof(QChar) != 0 || offset + length > header.stringDataSize) {
+			return false;
+		}
+	}
+	auto isString = [&header] (quint32 index) -> bool {
+		return index < header.stringCount;
+	};
+	for (quint32 i = 0; i < header.albumCount; i++) {
+		const Album &a = albums[i];
+		if (!isString(a.name) || !isString(a.normalizedName) || !isString(a.year) || !isString(a.cover) ||
+				!isString(a.artist) || !isString(a.artistNormalized) || !isString(a.sortKey) || !isString(a.artistSortKey)) {
+			return false;
+		}
+	}
+	for (quint32 i = 0; i < header.trackCount; i++) {
+		const Track &t = tracks[i];
+		if (t.album >= header.albumCount || !isString(t.artist) || !isString(t.uri) || !isString(t.trackNumber) ||
+				!isString(t.title) || !isString(t.disc) || !isString(t.icon) || !isString(t.sortKey)) {
+			return false;
+		}
+	}
+
+	_data = data;
+	_size = size;
+	_libraryId = header.libraryId;
+	_generation = header.generation;
+	_strings = strings;
+	_stringCount = header.stringCount;
+	_albums = albums;
+	_albumCount = header.albumCount;
+	_tracks = tracks;
+	_trackCount = header.trackCount;
+	_stringData = p;
+	_texts.resize(_stringCount);
+	return true;
+}
+
+void LibrarySnapshot::detach()
+{
+	if (_file.isOpen()) {
+		if (_data && _buffer.isEmpty()) {
+			_file.unmap(const_cast<uchar*>(_data));
+		}
+		_file.close();
+	}
+	_buffer.clear();
+	_texts.clear();
+	_data = nullptr;
+	_size = 0;
+	_libraryId = 0;
+	_generation = -1;
+	_albums = nullptr;
+	_tracks = nullptr;
+	_albumCount = 0;
+	_trackCount = 0;
+	_strings = nullptr;
+	_stringCount = 0;
+	_stringData = nullptr;
+}
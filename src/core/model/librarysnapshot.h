@@ -0,0 +1,140 @@
+#ifndef LIBRARYSNAPSHOT_H
+#define LIBRARYSNAPSHOT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "../miamcore_global.h"
+
+/// Forward declaration
+class SqlDatabase;
+
+/**
+ * \brief		The LibrarySnapshot class is a copy of the rows views need to build the library, in a file which can be mapped.
+ * \details		Rows are fixed-width records which refer to each other by index, and every text is stored once in a table
+ *				of strings, in UTF-16 so that it can be turned into a QString without decoding. A header tells which version
+ *				of the format was used, which library the rows come from, and how many changes this library had seen. The
+ *				snapshot of the previous session is mapped at startup, then compared with the library in background.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY LibrarySnapshot
+{
+public:
+	/** Texts are indexes in the table of strings. Index 0 is always the empty string. */
+	struct Album
+	{
+		quint32 name;
+		quint32 normalizedName;
+		quint32 year;
+		quint32 cover;
+		quint32 artist;
+		quint32 artistNormalized;
+		quint32 sortKey;
+		quint32 artistSortKey;
+	};
+
+	/** Tracks are ordered by uri. Their album is an index in the table of albums. */
+	struct Track
+	{
+		quint32 album;
+		quint32 artist;
+		quint32 uri;
+		quint32 trackNumber;
+		quint32 title;
+		quint32 length;
+		qint32 rating;
+		quint32 disc;
+		quint32 icon;
+		quint32 sortKey;
+		quint32 flags;
+	};
+
+	enum TrackFlag {
+		TF_InternalCover	= 0x1,
+		TF_Remote			= 0x2
+	};
+
+	/** Uris are bound to a single statement, which can't have too many parameters. */
+	static const int maxTracksPerRead = 500;
+
+private:
+	QFile _file;
+	QByteArray _buffer;
+	const uchar *_data;
+	qint64 _size;
+
+	qint64 _libraryId;
+	qint64 _generation;
+	const Album *_albums;
+	const Track *_tracks;
+	quint32 _albumCount;
+	quint32 _trackCount;
+
+	/** Offset and size in bytes of each string. */
+	const quint32 *_strings;
+	quint32 _stringCount;
+	const uchar *_stringData;
+
+	/** Strings which have already been read share their data with every item they were given to. */
+	mutable QVector<QString> _texts;
+
+public:
+	LibrarySnapshot();
+
+	~LibrarySnapshot();
+
+	/** Path to the file written next to the library. */
+	static QString path();
+
+	/** Maps the file of the previous snapshot. False if it's missing, if it was written by another version, or if it's damaged. */
+	bool map();
+
+	/** Reads artists, albums and tracks from the library, in a single transaction. */
+	bool read(SqlDatabase &db);
+
+	/** Reads some tracks only, with their albums. There can't be more than maxTracksPerRead uris. */
+	bool read(SqlDatabase &db, const QStringList &uris);
+
+	/** Replaces the file with rows which were read from the library. */
+	bool write() const;
+
+	/** True if rows were read from this library, and it hasn't changed since. */
+	bool isFresh(SqlDatabase &db) const;
+
+	inline qint64 libraryId() const { return _libraryId; }
+	inline qint64 generation() const { return _generation; }
+
+	inline quint32 albumCount() const { return _albumCount; }
+	inline const Album &album(quint32 index) const { return _albums[index]; }
+
+	inline quint32 trackCount() const { return _trackCount; }
+	inline const Track &track(quint32 index) const { return _tracks[index]; }
+
+	/** Index of a track, or -1 if it's not in this snapshot. */
+	int findTrack(const QString &uri) const;
+
+	QString text(quint32 index) const;
+
+	/** Same as text(), without keeping a copy: for strings which are read only once. */
+	QString readText(quint32 index) const;
+
+	QByteArray bytes(quint32 index) const;
+
+private:
+	/** Reads every track if uris is null. */
+	bool readTracks(SqlDatabase &db, const QStringList *uris);
+
+	/** Checks the header, the checksum and every index, then points tables to the data. */
+	bool attach(const uchar *data, qint64 size);
+
+	void detach();
+};
+
+Q_DECLARE_TYPEINFO(LibrarySnapshot::Album, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(LibrarySnapshot::Track, Q_PRIMITIVE_TYPE);
+
+#endif // LIBRARYSNAPSHOT_H
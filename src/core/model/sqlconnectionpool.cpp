@@ -0,0 +1,141 @@
+#include "sqlconnectionpool.h"
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QDir>
+#include <QSqlError>
+#include <QStandardPaths>
+#include <QThreadStorage>
+
+#include <QtDebug>
+
+#include "settingsprivate.h"
+
+/**
+ * Connections of a thread. They are closed and removed when the thread finishes: QThreadStorage deletes its data
+ * at this moment (or when the application is destroyed, for the main thread).
+ */
+struct ThreadConnections
+{
+	QSqlDatabase readWrite;
+	QSqlDatabase readOnly;
+	QHash<QString, QSqlQuery> readWriteStatements;
+	QHash<QString, QSqlQuery> readOnlyStatements;
+
+	~ThreadConnections()
+	{
+		// Statements must be released before their connection is closed
+		readWriteStatements.clear();
+		readOnlyStatements.clear();
+		for (QSqlDatabase *db : { &readWrite, &readOnly }) {
+			if (db->isValid()) {
+				QString name = db->connectionName();
+				db->close();
+				*db = QSqlDatabase();
+				QSqlDatabase::removeDatabase(name);
+			}
+		}
+	}
+};
+
+static QThreadStorage<ThreadConnections*> threadConnections;
+
+static QAtomicInteger<qint64> statementHits;
+static QAtomicInteger<qint64> statementMisses;
+
+/** Connection of the calling thread, opened and configured on first use. */
+QSqlDatabase SqlConnectionPool::connection(AccessMode mode)
+{
+	if (!threadConnections.hasLocalData()) {
+		threadConnections.setLocalData(new ThreadConnections);
+	}
+	ThreadConnections *connections = threadConnections.localData();
+	QSqlDatabase &db = (mode == AM_ReadOnly) ? connections->readOnly : connections->readWrite;
+	if (db.isValid()) {
+		return db;
+	}
+
+	// Thread ids can be reused, a counter can't
+	static QAtomicInt connectionCount;
+	QString name = QString("miam-library-%1").arg(connectionCount.fetchAndAddRelaxed(1));
+	db = QSqlDatabase::addDatabase("QSQLITE", name);
+	db.setDatabaseName(databasePath());
+	if (mode == AM_ReadOnly) {
+		db.setConnectOptions("QSQLITE_OPEN_READONLY");
+	}
+	if (db.open()) {
+		setPragmas(db, mode);
+	} else {
+		qWarning() << Q_FUNC_INFO << "cannot open library" << db.databaseName() << db.lastError().text();
+	}
+	return db;
+}
+
+/** Absolute path to the file of the library, resolved once. */
+QString SqlConnectionPool::databasePath()
+{
+	static const QString dbPath = []() {
+		SettingsPrivate *settings = SettingsPrivate::instance();
+		QString path("%1/%2/%3");
+		path = path.arg(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation),
+						settings->organizationName(),
+						settings->applicationName());
+		QDir userDataPath(path);
+		if (!userDataPath.exists(path)) {
+			// No DB path -> first launch
+			if (!userDataPath.mkpath(path)) {
+				qWarning() << QObject::tr("Cannot create path to store cache. Miam-Player might be able to run but it will be in limited mode");
+			}
+		}
+		return QDir::toNativeSeparators(path + "/mp.db");
+	}();
+	return dbPath;
+}
+
+void SqlConnectionPool::setPragmas(QSqlDatabase &db, AccessMode mode)
+{
+	db.exec("PRAGMA temp_store = 2");
+	if (mode == AM_ReadOnly) {
+		return;
+	}
+	// With a write-ahead log, readers see the last commit before their transaction has started and never wait for the
+	// writer, even in the middle of a scan. Commits are appended to the log, which is only synced when it is copied back
+	// into the library: the library stays consistent after a crash, and a scan resumes from its last saved checkpoint
+	db.exec("PRAGMA journal_mode = WAL");
+	db.exec("PRAGMA synchronous = NORMAL");
+	db.exec("PRAGMA foreign_keys = 1");
+	db.exec("PRAGMA count_changes = OFF");
+}
+
+QSqlQuery SqlConnectionPool::statement(const QString &sql, AccessMode mode)
+{
+	QSqlDatabase db = connection(mode);
+	ThreadConnections *connections = threadConnections.localData();
+	QHash<QString, QSqlQuery> &statements = (mode == AM_ReadOnly) ? connections->readOnlyStatements : connections->readWriteStatements;
+	auto it = statements.constFind(sql);
+	if (it != statements.constEnd()) {
+		statementHits.fetchAndAddRelaxed(1);
+		return it.value();
+	}
+
+	statementMisses.fetchAndAddRelaxed(1);
+	QSqlQuery query(db);
+	query.setForwardOnly(true);
+	if (query.prepare(sql)) {
+		// Copies share the compiled statement
+		statements.insert(sql, query);
+	} else {
+		qDebug() << Q_FUNC_INFO << sql << query.lastError();
+	}
+	return query;
+}
+
+qint64 SqlConnectionPool::statementCacheHits()
+{
+	return statementHits.load();
+}
+
+qint64 SqlConnectionPool::statementCacheMisses()
+{
+	return statementMisses.load();
+}
@@ -0,0 +1,53 @@
+#ifndef SQLCONNECTIONPOOL_H
+#define SQLCONNECTIONPOOL_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "../miamcore_global.h"
+
+/**
+ * \brief		The SqlConnectionPool class hands out long-lived connections to the library, one per thread.
+ * \details		A QSqlDatabase connection can only be used by the thread which has opened it. The first time a thread needs
+ *				the library, it gets its own connection which is opened and configured once, then kept until this thread
+ *				finishes. Building a SqlDatabase only copies a handle to this connection.
+ *				Background workers which never write can ask for a read-only connection instead: it's opened with
+ *				SQLITE_OPEN_READONLY, so a worker can't take the write lock by mistake. The library is in WAL mode: readers
+ *				work on a snapshot and are never blocked by the writer.
+ *				Each connection also keeps the statements it has compiled, keyed by their SQL text.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY SqlConnectionPool
+{
+public:
+	enum AccessMode {
+		AM_ReadWrite	= 0,
+		AM_ReadOnly		= 1
+	};
+
+	/** Connection of the calling thread, opened and configured on first use. */
+	static QSqlDatabase connection(AccessMode mode = AM_ReadWrite);
+
+	/** Absolute path to the file of the library, resolved once. */
+	static QString databasePath();
+
+	static void setPragmas(QSqlDatabase &db, AccessMode mode);
+
+	/**
+	 * Statement prepared once on the connection of the calling thread, then reused. Values bound by previous calls are
+	 * overwritten by the next ones, and finish() must be called after results are read.
+	 */
+	static QSqlQuery statement(const QString &sql, AccessMode mode = AM_ReadWrite);
+
+	/** Number of statements which were found in caches of all threads since the application has started. */
+	static qint64 statementCacheHits();
+
+	/** Number of statements which had to be prepared since the application has started. */
+	static qint64 statementCacheMisses();
+
+private:
+	SqlConnectionPool() {}
+};
+
+#endif // SQLCONNECTIONPOOL_H
@@ -1,216 +1,995 @@
 #include "sqldatabase.h"
 
-#include <QApplication>
-#include <QDir>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QRegularExpression>
+#include <QSet>
 #include <QSqlError>
 #include <QSqlRecord>
 #include <QSqlQuery>
-#include <QStandardPaths>
 #include <QTimer>
 
 #include <QtDebug>
 
 #include "cover.h"
-#include "settingsprivate.h"
 #include "musicsearchengine.h"
 #include "filehelper.h"
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
 #include <random>
 
-SqlDatabase::SqlDatabase(QObject *parent)
-	: QObject(parent)
-	, QSqlDatabase("QSQLITE")
+/** Version of the schema, stored in PRAGMA user_version. Increase it each time upgradeSchema() has a new step. */
+static const int schemaVersion = 13;
+
+/** Gap between positions of tracks in a saved playlist, so that a track can be inserted without moving its neighbours. */
+static const qint64 playlistPositionStep = 1024;
+
+/** Set once the schema is ready. Without FTS5 in SQLite, search falls back to LIKE. */
+static bool isSearchIndexAvailable = false;
+
+/** Words shorter than this match a large part of a big library: ranking all of them would take longer than a keystroke. */
+static const int rankedPrefixLength = 3;
+
+/** Words of a search, split like the tokenizer of the full-text index does. */
+static QStringList searchWords(const QString &text)
+{
+	static QRegularExpression separators("\\W+", QRegularExpression::UseUnicodePropertiesOption);
+	return text.split(separators, QString::SkipEmptyParts);
+}
+
+/**
+ * Full-text query where each word is a prefix. Words are quoted so that they can't be read as operators. A name typed
+ * without its spaces or punctuation ("acdc") is also matched against normalized names.
+ */
+static QString matchExpression(const QString &text, bool withNormalizedName)
 {
-	SettingsPrivate *settings = SettingsPrivate::instance();
-	QString path("%1/%2/%3");
-	path = path.arg(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation),
-					settings->organizationName(),
-					settings->applicationName());
-	QString dbPath = QDir::toNativeSeparators(path + "/mp.db");
-	QDir userDataPath(path);
-	// Init a new database file for settings
-	QFile dbFile(dbPath);
-	if (!userDataPath.exists(path)) {
-		// No DB path -> first launch
-		if (!userDataPath.mkpath(path)) {
-			qWarning() << tr("Cannot create path to store cache. Miam-Player might be able to run but it will be in limited mode");
+	QStringList prefixes;
+	for (QString word : searchWords(text)) {
+		prefixes << "\"" + word + "\"*";
+	}
+	if (prefixes.isEmpty()) {
+		return QString();
+	}
+	QString match = "(" + prefixes.join(' ') + ")";
+	if (withNormalizedName) {
+		QString normalized = SqlDatabase::normalizeField(text);
+		if (!normalized.isEmpty()) {
+			match.append(" OR normalizedName : \"" + normalized.replace('"', "\"\"") + "\"*");
 		}
 	}
+	return match;
+}
 
-	setDatabaseName(dbPath);
-
-	// DB folder exists but DB file doesn't: can be first launch or file was deleted manually
-	if (dbFile.exists()) {
-		this->init();
-	} else {
-
-		dbFile.open(QIODevice::ReadWrite);
-		dbFile.close();
+/** First letters of a word are returned in the order of the index, instead of being ranked. */
+static bool isRankedSearch(const QString &text)
+{
+	for (QString word : searchWords(text)) {
+		if (word.size() < rankedPrefixLength) {
+			return false;
+		}
+	}
+	return true;
+}
 
-		this->init();
+/** Years are stored as numbers, tags which aren't a valid year are stored as NULL. */
+static QVariant yearValue(const QString &year)
+{
+	bool ok = false;
+	int y = year.toInt(&ok);
+	return ok ? QVariant(y) : QVariant();
+}
 
-		QSqlQuery createDb(*this);
-		createDb.exec("CREATE TABLE IF NOT EXISTS cache (uri varchar(255) PRIMARY KEY ASC, trackNumber INTEGER, trackTitle varchar(255), trackLength INTEGER, " \
-					  "artist varchar(255), artistNormalized varchar(255), " \
-					  "album varchar(255), albumNormalized varchar(255), artistAlbum varchar(255), albumYear INTEGER,  " \
-					  "rating INTEGER, disc INTEGER, cover varchar(255), internalCover varchar(255), host varchar(255), icon varchar(255))");
+/** Fields of a track sent by a remote plugin, as they are stored in the library. */
+static TrackRecord toTrackRecord(const TrackDAO &track)
+{
+	TrackRecord record;
+	record.uri = track.uri();
+	record.title = track.title();
+	record.sortKey = SqlDatabase::sortKey(track.title());
+	record.artist = track.artist();
+	record.artistAlbum = track.artistAlbum().isEmpty() ? track.artist() : track.artistAlbum();
+	record.artistNormalized = SqlDatabase::normalizeField(record.artistAlbum);
+	record.album = track.album();
+	record.albumNormalized = SqlDatabase::normalizeField(track.album());
+	record.year = track.year();
+	record.length = track.length();
+	record.trackNumber = track.trackNumber().toInt();
+	record.disc = track.disc().toInt();
+	record.rating = track.rating();
+	record.host = track.host();
+	record.icon = track.icon();
+	return record;
+}
 
-		createDb.exec("CREATE TABLE IF NOT EXISTS playlists (id INTEGER PRIMARY KEY, title varchar(255), duration INTEGER, icon varchar(255), " \
-					  "host varchar(255), background varchar(255), checksum varchar(255))");
-		createDb.exec("CREATE TABLE IF NOT EXISTS playlistTracks (uri varchar(255) PRIMARY KEY ASC, playlistId INTEGER, FOREIGN KEY(playlistId) REFERENCES playlists(id) ON DELETE CASCADE)");
-		/// TEST Monitor Filesystem
-		createDb.exec("CREATE TABLE IF NOT EXISTS filesystem (path VARCHAR(255) PRIMARY KEY ASC, " \
-					  "lastModified INTEGER);");
+SqlDatabase::SqlDatabase(QObject *parent)
+	: SqlDatabase(SqlConnectionPool::AM_ReadWrite, parent)
+{}
 
-		// Wait for a few seconds and restart full scan
-		/// TODO: full rescan <> rebuild which is only for local tracks
-		/// Remote tracks (like Deezer) are still not synchronized
-		//QTimer *t = new QTimer(this);
-		//t->setSingleShot(true);
-		//t->start(5000);
-		//connect(t, &QTimer::timeout, this, &SqlDatabase::rebuild);
+SqlDatabase::SqlDatabase(SqlConnectionPool::AccessMode mode, QObject *parent)
+	: QObject(parent)
+	, QSqlDatabase()
+	, _mode(SqlConnectionPool::AM_ReadWrite)
+{
+	// Tables are created or upgraded once per process, before any connection is used
+	static QMutex schemaMutex;
+	static bool isSchemaReady = false;
+	QMutexLocker locker(&schemaMutex);
+	if (!isSchemaReady) {
+		QSqlDatabase::operator=(SqlConnectionPool::connection(SqlConnectionPool::AM_ReadWrite));
+		this->createSchema();
+		isSchemaReady = true;
 	}
+	locker.unlock();
 
+	// Only a handle to the connection of this thread is copied: it's already opened and configured
+	_mode = mode;
+	QSqlDatabase::operator=(SqlConnectionPool::connection(mode));
 }
 
 SqlDatabase::~SqlDatabase()
+{
+	// Connection belongs to the pool: it stays open for the next instance built in this thread
+}
+
+/** Connections are opened by the pool. Reopening one would drop its pragmas and its prepared statements. */
+bool SqlDatabase::open()
 {
 	if (isOpen()) {
-		close();
+		return true;
+	}
+	bool b = QSqlDatabase::open();
+	if (b) {
+		this->setPragmas();
 	}
+	return b;
 }
 
-void SqlDatabase::reset()
+/**
+ * Starts a transaction. On a read-write connection, the write lock is taken right away: a deferred transaction which
+ * reads before it writes would fail with SQLITE_BUSY_SNAPSHOT if another connection committed in between. Waiting for
+ * the lock is bounded by the busy timeout of the driver.
+ */
+bool SqlDatabase::transaction()
 {
-	exec("DELETE FROM cache");
-	exec("DROP INDEX indexArtist");
-	exec("DROP INDEX indexAlbum");
-	exec("DROP INDEX indexPath");
+	// Fails inside another transaction, like QSqlDatabase::transaction(), so callers can tell if they own it
+	QSqlQuery begin(*this);
+	return begin.exec(_mode == SqlConnectionPool::AM_ReadOnly ? "BEGIN" : "BEGIN IMMEDIATE");
 }
 
-void SqlDatabase::init()
+/** Copies commits from the write-ahead log back into the library. */
+bool SqlDatabase::checkpoint(CheckpointMode mode)
 {
-	open();
-	this->setPragmas();
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QSqlQuery walCheckpoint(*this);
+	walCheckpoint.setForwardOnly(true);
+	bool b = walCheckpoint.exec(mode == CM_Truncate ? "PRAGMA wal_checkpoint(TRUNCATE)" : "PRAGMA wal_checkpoint(PASSIVE)");
+	// First column is 1 when the checkpoint couldn't complete
+	if (b && walCheckpoint.next()) {
+		b = walCheckpoint.value(0).toInt() == 0;
+	} else {
+		qDebug() << Q_FUNC_INFO << walCheckpoint.lastError();
+	}
+	walCheckpoint.finish();
+	return b;
 }
 
-uint SqlDatabase::insertIntoTablePlaylists(const PlaylistDAO &playlist, const QStringList &tracks, bool isOverwriting)
+/** When disabled, the log is only copied back by explicit checkpoints. */
+void SqlDatabase::setAutoCheckpoint(bool enabled)
 {
 	if (!isOpen()) {
 		open();
 		this->setPragmas();
 	}
+	// 1000 pages is SQLite's default
+	this->exec(enabled ? "PRAGMA wal_autocheckpoint = 1000" : "PRAGMA wal_autocheckpoint = 0");
+}
 
-	qDebug() << Q_FUNC_INFO << tracks;
+void SqlDatabase::reset()
+{
+	exec("DELETE FROM tracks");
+	exec("DELETE FROM albums");
+	exec("DELETE FROM artists");
+	exec("DELETE FROM directories");
+	exec("DELETE FROM scanCheckpoints");
+	this->bumpLibraryGeneration();
+}
+
+/**
+ * Snapshots of the library are stale once this counter has changed. Called once by each transaction which modifies
+ * artists, albums or tracks, before it's committed, instead of once per row.
+ */
+bool SqlDatabase::bumpLibraryGeneration()
+{
+	QSqlQuery updateGeneration = this->cachedQuery("UPDATE libraryGeneration SET generation = generation + 1");
+	bool b = updateGeneration.exec();
+	if (!b) {
+		qDebug() << Q_FUNC_INFO << updateGeneration.lastError();
+	}
+	updateGeneration.finish();
+	return b;
+}
+
+void SqlDatabase::init()
+{
+	this->open();
+}
+
+/** Creates tables in a new file, or upgrades the ones which were created by previous versions of the player. */
+void SqlDatabase::createSchema()
+{
+	// Can be first launch or file was deleted manually. Versions before 5 stored tracks in table "cache"
+	QSqlQuery existingTables("SELECT name FROM sqlite_master WHERE type = 'table' AND name IN ('tracks', 'cache')", *this);
+	bool isNew = !existingTables.next();
+	existingTables.finish();
+	if (!isNew) {
+		this->upgradeSchema();
+		this->createSearchIndex();
+		return;
+	}
 
-	static std::uniform_int_distribution<uint> tt;
+	QSqlQuery createDb(*this);
+	createDb.exec("CREATE TABLE IF NOT EXISTS directories (id INTEGER PRIMARY KEY, path varchar(255) UNIQUE, cover varchar(255))");
+	this->createLibraryTables();
+
+	createDb.exec("CREATE TABLE IF NOT EXISTS playlists (id INTEGER PRIMARY KEY, title varchar(255), duration INTEGER, icon varchar(255), " \
+				  "host varchar(255), background varchar(255), checksum varchar(255))");
+	this->createPlaylistTracksTable();
+	createDb.exec("CREATE TABLE IF NOT EXISTS locations (path varchar(255) PRIMARY KEY ASC, entryCount INTEGER)");
+	createDb.exec("CREATE TABLE IF NOT EXISTS scanCheckpoints (location varchar(255) PRIMARY KEY ASC, folder varchar(255))");
+	createDb.exec("PRAGMA user_version = " + QString::number(schemaVersion));
+	this->createLibraryGeneration();
+	this->createSearchIndex();
+
+	// Wait for a few seconds and restart full scan
+	/// TODO: full rescan <> rebuild which is only for local tracks
+	/// Remote tracks (like Deezer) are still not synchronized
+	//QTimer *t = new QTimer(this);
+	//t->setSingleShot(true);
+	//t->start(5000);
+	//connect(t, &QTimer::timeout, this, &SqlDatabase::rebuild);
+}
+
+/** Artists, albums and tracks, with integer keys and typed columns. */
+void SqlDatabase::createLibraryTables()
+{
+	// Sort keys are computed once when a row is inserted, views compare them byte per byte
+	this->exec("CREATE TABLE IF NOT EXISTS artists (id INTEGER PRIMARY KEY, name TEXT NOT NULL, normalizedName TEXT NOT NULL UNIQUE, " \
+			   "icon TEXT, host TEXT, sortKey BLOB)");
+	this->exec("CREATE TABLE IF NOT EXISTS albums (id INTEGER PRIMARY KEY, artistId INTEGER NOT NULL REFERENCES artists(id), " \
+			   "name TEXT NOT NULL, normalizedName TEXT NOT NULL, year INTEGER, cover TEXT, sortKey BLOB, UNIQUE (artistId, normalizedName))");
+	this->exec("CREATE TABLE IF NOT EXISTS tracks (id INTEGER PRIMARY KEY, uri TEXT NOT NULL UNIQUE, " \
+			   "albumId INTEGER NOT NULL REFERENCES albums(id), artistId INTEGER NOT NULL REFERENCES artists(id), " \
+			   "directoryId INTEGER REFERENCES directories(id), title TEXT, trackNumber INTEGER, disc INTEGER, length INTEGER, " \
+			   "rating INTEGER, internalCover INTEGER NOT NULL DEFAULT 0, host TEXT, icon TEXT, " \
+			   "mtime INTEGER, fileSize INTEGER, inode INTEGER, sortKey BLOB)");
+
+	// Tracks of an album are read in order without sorting. Foreign keys are indexed too, so that removing an album or a
+	// folder doesn't scan the whole table
+	this->exec("CREATE INDEX IF NOT EXISTS tracksByAlbum ON tracks (albumId, disc, trackNumber)");
+	this->exec("CREATE INDEX IF NOT EXISTS tracksByArtist ON tracks (artistId)");
+	this->exec("CREATE INDEX IF NOT EXISTS tracksByDirectory ON tracks (directoryId)");
+
+	// Same columns as the table used before version 5, for plugins and dialogs which only read the library
+	this->exec("CREATE VIEW IF NOT EXISTS cache AS SELECT t.uri, t.trackNumber, t.title AS trackTitle, t.length AS trackLength, " \
+			   "ta.name AS artist, aa.normalizedName AS artistNormalized, al.name AS album, al.normalizedName AS albumNormalized, " \
+			   "aa.name AS artistAlbum, al.year AS albumYear, t.rating, t.disc, al.cover, " \
+			   "CASE WHEN t.internalCover THEN t.uri END AS internalCover, t.host, t.icon, t.mtime, t.fileSize, t.inode, t.directoryId, " \
+			   "aa.sortKey AS artistSortKey, al.sortKey AS albumSortKey, t.sortKey AS trackSortKey " \
+			   "FROM tracks t JOIN albums al ON al.id = t.albumId JOIN artists aa ON aa.id = al.artistId JOIN artists ta ON ta.id = t.artistId");
+}
+
+/** Counter increased each time artists, albums or tracks are modified, to know if a snapshot is still fresh. */
+void SqlDatabase::createLibraryGeneration()
+{
+	// The id is drawn once per file: a library which has been deleted then rebuilt can't be mistaken for the previous one
+	this->exec("CREATE TABLE IF NOT EXISTS libraryGeneration (libraryId INTEGER NOT NULL, generation INTEGER NOT NULL)");
+	this->exec("INSERT INTO libraryGeneration (libraryId, generation) SELECT random() & 9223372036854775807, 0 " \
+			   "WHERE NOT EXISTS (SELECT 1 FROM libraryGeneration)");
+}
+
+/** Ordered tracks of saved playlists. A track can be in many playlists, or many times in the same one. */
+void SqlDatabase::createPlaylistTracksTable()
+{
+	// Tracks of the library are linked by id, so that they can be found again if they are moved. The uri is kept for
+	// files outside the library, and for tracks which have been removed from it since the playlist was saved
+	this->exec("CREATE TABLE IF NOT EXISTS playlistTracks (playlistId INTEGER NOT NULL REFERENCES playlists(id) ON DELETE CASCADE, " \
+			   "position INTEGER NOT NULL, trackId INTEGER REFERENCES tracks(id) ON DELETE SET NULL, uri TEXT NOT NULL, " \
+			   "PRIMARY KEY (playlistId, position)) WITHOUT ROWID");
+	this->exec("CREATE INDEX IF NOT EXISTS playlistTracksByTrack ON playlistTracks (trackId)");
+	this->exec("CREATE INDEX IF NOT EXISTS playlistsByChecksum ON playlists (checksum)");
+}
+
+/** Full-text index of artists, albums and tracks, kept up to date by triggers. Built once if the library has none. */
+void SqlDatabase::createSearchIndex()
+{
+	QSqlQuery existingIndex("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'trackSearch'", *this);
+	isSearchIndexAvailable = existingIndex.next();
+	existingIndex.finish();
+	if (isSearchIndexAvailable) {
+		return;
+	}
+
+	// Case and accents are folded like normalizeField() does. Prefix indexes answer the first letters being typed
+	// without going through every term of the index. Each row has the same id as the artist, album or track it comes from
+	static const QString options = ", tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3')";
 	this->transaction();
-	uint id = 0;
-	if (isOverwriting) {
-		if (this->updateTablePlaylist(playlist)) {
-			id = playlist.id().toUInt();
-			this->insertIntoTablePlaylistTracks(id, tracks, isOverwriting);
+	QSqlQuery createIndex(*this);
+	if (!createIndex.exec("CREATE VIRTUAL TABLE artistSearch USING fts5(name, normalizedName" + options)) {
+		// SQLite was built without FTS5: search falls back to a scan of the library
+		qDebug() << Q_FUNC_INFO << createIndex.lastError();
+		createIndex.finish();
+		this->rollback();
+		return;
+	}
+	createIndex.finish();
+	this->exec("CREATE VIRTUAL TABLE albumSearch USING fts5(name, artist, normalizedName" + options);
+	this->exec("CREATE VIRTUAL TABLE trackSearch USING fts5(title, artist, album" + options);
+
+	this->exec("CREATE TRIGGER artistSearchInsert AFTER INSERT ON artists BEGIN " \
+			   "INSERT INTO artistSearch (rowid, name, normalizedName) VALUES (new.id, new.name, new.normalizedName); END");
+	this->exec("CREATE TRIGGER artistSearchDelete AFTER DELETE ON artists BEGIN " \
+			   "DELETE FROM artistSearch WHERE rowid = old.id; END");
+	this->exec("CREATE TRIGGER albumSearchInsert AFTER INSERT ON albums BEGIN " \
+			   "INSERT INTO albumSearch (rowid, name, artist, normalizedName) " \
+			   "VALUES (new.id, new.name, (SELECT name FROM artists WHERE id = new.artistId), new.normalizedName); END");
+	this->exec("CREATE TRIGGER albumSearchDelete AFTER DELETE ON albums BEGIN " \
+			   "DELETE FROM albumSearch WHERE rowid = old.id; END");
+	this->createSearchUpdateTriggers();
+	this->exec("CREATE TRIGGER trackSearchInsert AFTER INSERT ON tracks BEGIN " \
+			   "INSERT INTO trackSearch (rowid, title, artist, album) VALUES (new.id, new.title, " \
+			   "(SELECT name FROM artists WHERE id = new.artistId), (SELECT name FROM albums WHERE id = new.albumId)); END");
+	this->exec("CREATE TRIGGER trackSearchUpdate AFTER UPDATE OF title, artistId, albumId ON tracks BEGIN " \
+			   "DELETE FROM trackSearch WHERE rowid = old.id; " \
+			   "INSERT INTO trackSearch (rowid, title, artist, album) VALUES (new.id, new.title, " \
+			   "(SELECT name FROM artists WHERE id = new.artistId), (SELECT name FROM albums WHERE id = new.albumId)); END");
+	this->exec("CREATE TRIGGER trackSearchDelete AFTER DELETE ON tracks BEGIN " \
+			   "DELETE FROM trackSearch WHERE rowid = old.id; END");
+
+	// Library was filled by a previous version
+	this->exec("INSERT INTO artistSearch (rowid, name, normalizedName) SELECT id, name, normalizedName FROM artists");
+	this->exec("INSERT INTO albumSearch (rowid, name, artist, normalizedName) " \
+			   "SELECT al.id, al.name, ar.name, al.normalizedName FROM albums al JOIN artists ar ON ar.id = al.artistId");
+	this->exec("INSERT INTO trackSearch (rowid, title, artist, album) " \
+			   "SELECT t.id, t.title, ar.name, al.name FROM tracks t JOIN artists ar ON ar.id = t.artistId JOIN albums al ON al.id = t.albumId");
+	isSearchIndexAvailable = this->commit();
+}
+
+/** Names of artists and albums are copied in rows of the index which refer to them: they follow when a tag edit changes their case. */
+void SqlDatabase::createSearchUpdateTriggers()
+{
+	this->exec("CREATE TRIGGER IF NOT EXISTS artistSearchUpdate AFTER UPDATE OF name ON artists BEGIN " \
+			   "UPDATE artistSearch SET name = new.name WHERE rowid = new.id; " \
+			   "UPDATE albumSearch SET artist = new.name WHERE rowid IN (SELECT id FROM albums WHERE artistId = new.id); " \
+			   "UPDATE trackSearch SET artist = new.name WHERE rowid IN (SELECT id FROM tracks WHERE artistId = new.id); END");
+	this->exec("CREATE TRIGGER IF NOT EXISTS albumSearchUpdate AFTER UPDATE OF name ON albums BEGIN " \
+			   "UPDATE albumSearch SET name = new.name WHERE rowid = new.id; " \
+			   "UPDATE trackSearch SET album = new.name WHERE rowid IN (SELECT id FROM tracks WHERE albumId = new.id); END");
+}
+
+/** Alter tables created by previous versions of the player. */
+void SqlDatabase::upgradeSchema()
+{
+	int version = 0;
+	QSqlQuery userVersion("PRAGMA user_version", *this);
+	if (userVersion.next()) {
+		version = userVersion.record().value(0).toInt();
+	}
+	userVersion.finish();
+
+	// Steps which copy rows stop at their first failed statement: they are rolled back, legacy tables are kept and the
+	// version isn't changed, so the upgrade is tried again on next launch
+	auto execStep = [this](const QString &sql) -> bool {
+		QSqlQuery step(*this);
+		bool b = step.exec(sql);
+		if (!b) {
+			qDebug() << Q_FUNC_INFO << sql << step.lastError();
+		}
+		step.finish();
+		return b;
+	};
+
+	if (version < 1) {
+		// Fingerprints of local files, to rescan only what has changed
+		this->exec("ALTER TABLE cache ADD COLUMN mtime INTEGER");
+		this->exec("ALTER TABLE cache ADD COLUMN fileSize INTEGER");
+		this->exec("ALTER TABLE cache ADD COLUMN inode INTEGER");
+	}
+
+	if (version < 2) {
+		// Number of entries found in each music location, to estimate progress of next scan
+		this->exec("CREATE TABLE IF NOT EXISTS locations (path varchar(255) PRIMARY KEY ASC, entryCount INTEGER)");
+	}
+
+	if (version < 3) {
+		// Pictures next to tracks, resolved once per folder. Tracks are linked to their folder by the next scan
+		this->exec("CREATE TABLE IF NOT EXISTS directories (id INTEGER PRIMARY KEY, path varchar(255) UNIQUE, cover varchar(255))");
+		this->exec("ALTER TABLE cache ADD COLUMN directoryId INTEGER");
+	}
+
+	if (version < 4) {
+		// Position of the walk in each location, so that an interrupted scan can be resumed
+		this->exec("CREATE TABLE IF NOT EXISTS scanCheckpoints (location varchar(255) PRIMARY KEY ASC, entryIndex INTEGER)");
+	}
+
+	if (version < 5) {
+		// Artists and albums are stored once, tracks only keep integer keys to them
+		bool b = this->transaction() && execStep("ALTER TABLE cache RENAME TO legacyCache");
+		if (b) {
+			this->createLibraryTables();
+			b = execStep("INSERT OR IGNORE INTO artists (name, normalizedName, icon, host) " \
+						 "SELECT COALESCE(artistAlbum, artist, ''), COALESCE(artistNormalized, ''), MAX(icon), MAX(host) " \
+						 "FROM legacyCache GROUP BY COALESCE(artistNormalized, '')")
+				&& execStep("INSERT OR IGNORE INTO albums (artistId, name, normalizedName, year, cover) " \
+							"SELECT ar.id, COALESCE(c.album, ''), COALESCE(c.albumNormalized, ''), CAST(NULLIF(MAX(c.albumYear), '') AS INTEGER), MAX(c.cover) " \
+							"FROM legacyCache c JOIN artists ar ON ar.normalizedName = COALESCE(c.artistNormalized, '') " \
+							"GROUP BY ar.id, COALESCE(c.albumNormalized, '')")
+				&& execStep("INSERT INTO tracks (uri, albumId, artistId, directoryId, title, trackNumber, disc, length, rating, " \
+							"internalCover, host, icon, mtime, fileSize, inode) " \
+							"SELECT c.uri, al.id, ar.id, (SELECT d.id FROM directories d WHERE d.id = c.directoryId), " \
+							"c.trackTitle, CAST(c.trackNumber AS INTEGER), CAST(c.disc AS INTEGER), CAST(c.trackLength AS INTEGER), " \
+							"c.rating, c.internalCover IS NOT NULL, c.host, c.icon, c.mtime, c.fileSize, c.inode " \
+							"FROM legacyCache c JOIN artists ar ON ar.normalizedName = COALESCE(c.artistNormalized, '') " \
+							"JOIN albums al ON al.artistId = ar.id AND al.normalizedName = COALESCE(c.albumNormalized, '')");
+		}
+
+		// Artists of tracks which are not the artist of their album: names have to be normalized like new ones
+		QStringList trackArtists;
+		b = b && execStep("CREATE INDEX legacyArtists ON legacyCache (artist)");
+		if (b) {
+			QSqlQuery selectArtists(*this);
+			b = selectArtists.exec("SELECT DISTINCT artist FROM legacyCache WHERE artist <> COALESCE(artistAlbum, artist)");
+			while (selectArtists.next()) {
+				trackArtists << selectArtists.value(0).toString();
+			}
+			selectArtists.finish();
+		}
+		QSqlQuery linkArtist(*this);
+		linkArtist.prepare("UPDATE tracks SET artistId = ? WHERE uri IN (SELECT uri FROM legacyCache WHERE artist = ?)");
+		for (int i = 0; b && i < trackArtists.size(); i++) {
+			const QString &trackArtist = trackArtists.at(i);
+			int artistId = this->insertIntoTableArtists(trackArtist, this->normalizeField(trackArtist));
+			linkArtist.addBindValue(artistId);
+			linkArtist.addBindValue(trackArtist);
+			b = artistId != 0 && linkArtist.exec();
+		}
+		linkArtist.finish();
+		if (!(b && execStep("DROP TABLE legacyCache") && this->commit())) {
+			this->rollback();
+			return;
+		}
+	}
+
+	if (version < 6) {
+		// Tracks of playlists have a position instead of relying on rowid, and the uri isn't a unique key anymore
+		bool b = this->transaction() && execStep("ALTER TABLE playlistTracks RENAME TO legacyPlaylistTracks");
+		if (b) {
+			this->createPlaylistTracksTable();
+			b = execStep("INSERT INTO playlistTracks (playlistId, position, trackId, uri) " \
+						 "SELECT l.playlistId, l.rowid * " + QString::number(playlistPositionStep) + ", " \
+						 "(SELECT t.id FROM tracks t WHERE t.uri = l.uri), l.uri FROM legacyPlaylistTracks l " \
+						 "WHERE l.playlistId IN (SELECT id FROM playlists)")
+				&& execStep("DROP TABLE legacyPlaylistTracks");
+		}
+		if (!(b && this->commit())) {
+			this->rollback();
+			return;
+		}
+	}
+
+	if (version < 7) {
+		// Sort keys of existing rows. Tables created by the previous step already have the column
+		this->transaction();
+		if (version >= 5) {
+			this->exec("ALTER TABLE artists ADD COLUMN sortKey BLOB");
+			this->exec("ALTER TABLE albums ADD COLUMN sortKey BLOB");
+			this->exec("ALTER TABLE tracks ADD COLUMN sortKey BLOB");
+			this->exec("DROP VIEW IF EXISTS cache");
+			this->createLibraryTables();
 		}
+		// Names of artists and albums are already normalized, titles of tracks are not
+		this->exec("UPDATE artists SET sortKey = CAST(normalizedName AS BLOB) WHERE sortKey IS NULL");
+		this->exec("UPDATE albums SET sortKey = CAST(normalizedName AS BLOB) WHERE sortKey IS NULL");
+		QHash<int, QString> titles;
+		QSqlQuery selectTitles("SELECT id, title FROM tracks WHERE sortKey IS NULL", *this);
+		while (selectTitles.next()) {
+			titles.insert(selectTitles.value(0).toInt(), selectTitles.value(1).toString());
+		}
+		selectTitles.finish();
+		QSqlQuery updateSortKey(*this);
+		updateSortKey.prepare("UPDATE tracks SET sortKey = ? WHERE id = ?");
+		for (auto it = titles.cbegin(); it != titles.cend(); ++it) {
+			updateSortKey.addBindValue(sortKey(it.value()));
+			updateSortKey.addBindValue(it.key());
+			updateSortKey.exec();
+		}
+		updateSortKey.finish();
+		this->commit();
+	}
+
+	if (version < 8) {
+		// Snapshots of the library written by views are compared with this counter
+		this->createLibraryGeneration();
+	}
+
+	if (version < 9) {
+		// Names of existing artists and albums are updated by tag edits. A new index gets these triggers when it's created
+		QSqlQuery existingIndex("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'artistSearch'", *this);
+		bool hasSearchIndex = existingIndex.next();
+		existingIndex.finish();
+		if (hasSearchIndex) {
+			this->createSearchUpdateTriggers();
+		}
+	}
+
+	if (version < 10) {
+		// Generation is increased once per write transaction, instead of once per row by triggers
+		for (QString table : { "artists", "albums", "tracks" }) {
+			for (QString event : { "Insert", "Update", "Delete" }) {
+				this->exec("DROP TRIGGER IF EXISTS " + table + "Generation" + event);
+			}
+		}
+	}
+
+	if (version < 11) {
+		// Letters of other scripts than latin were removed from keys: they are computed again. An artist or an album whose
+		// new key is already taken keeps its old one, only its sort key changes
+		bool b = this->transaction();
+		for (QString table : { "artists", "albums" }) {
+			QHash<int, QString> names;
+			QSqlQuery selectNames(*this);
+			b = b && selectNames.exec("SELECT id, name FROM " + table);
+			while (selectNames.next()) {
+				names.insert(selectNames.value(0).toInt(), selectNames.value(1).toString());
+			}
+			selectNames.finish();
+			QSqlQuery updateKeys(*this);
+			updateKeys.prepare("UPDATE OR IGNORE " + table + " SET normalizedName = ? WHERE id = ?");
+			QSqlQuery updateSortKey(*this);
+			updateSortKey.prepare("UPDATE " + table + " SET sortKey = ? WHERE id = ?");
+			for (auto it = names.cbegin(); b && it != names.cend(); ++it) {
+				// Tracks without tag are grouped under an empty name, which is not NULL
+				QString key = normalizeField(it.value());
+				updateKeys.addBindValue(key.isNull() ? QStringLiteral("") : key);
+				updateKeys.addBindValue(it.key());
+				updateSortKey.addBindValue(sortKey(it.value()));
+				updateSortKey.addBindValue(it.key());
+				b = updateKeys.exec() && updateSortKey.exec();
+			}
+			updateKeys.finish();
+			updateSortKey.finish();
+		}
+		QHash<int, QString> titles;
+		QSqlQuery selectTitles(*this);
+		b = b && selectTitles.exec("SELECT id, title FROM tracks");
+		while (selectTitles.next()) {
+			titles.insert(selectTitles.value(0).toInt(), selectTitles.value(1).toString());
+		}
+		selectTitles.finish();
+		QSqlQuery updateSortKey(*this);
+		updateSortKey.prepare("UPDATE tracks SET sortKey = ? WHERE id = ?");
+		for (auto it = titles.cbegin(); b && it != titles.cend(); ++it) {
+			updateSortKey.addBindValue(sortKey(it.value()));
+			updateSortKey.addBindValue(it.key());
+			b = updateSortKey.exec();
+		}
+		updateSortKey.finish();
+
+		// Keys are copied in the search index, which has no trigger for them
+		QSqlQuery existingIndex("SELECT name FROM sqlite_master WHERE type = 'table' AND name = 'artistSearch'", *this);
+		bool hasSearchIndex = existingIndex.next();
+		existingIndex.finish();
+		if (b && hasSearchIndex) {
+			b = execStep("UPDATE artistSearch SET normalizedName = (SELECT normalizedName FROM artists WHERE id = artistSearch.rowid)")
+				&& execStep("UPDATE albumSearch SET normalizedName = (SELECT normalizedName FROM albums WHERE id = albumSearch.rowid)");
+		}
+		if (!(b && this->bumpLibraryGeneration() && this->commit())) {
+			qDebug() << Q_FUNC_INFO << this->lastError();
+			this->rollback();
+			return;
+		}
+	}
+
+	if (version < 12) {
+		// Scans are resumed from the path of a folder, not from an index which shifts when entries are added or removed.
+		// An interrupted scan runs again from the beginning, its files are still compared with their fingerprints
+		bool b = this->transaction()
+				&& execStep("DROP TABLE IF EXISTS scanCheckpoints")
+				&& execStep("CREATE TABLE scanCheckpoints (location varchar(255) PRIMARY KEY ASC, folder varchar(255))");
+		if (!(b && this->commit())) {
+			this->rollback();
+			return;
+		}
+	}
+
+	if (version < 13) {
+		// Folders were polled with this table, changes are now found with fingerprints of tracks
+		this->exec("DROP TABLE IF EXISTS filesystem");
+	}
+
+	if (version < schemaVersion) {
+		this->exec("PRAGMA user_version = " + QString::number(schemaVersion));
+	}
+}
+
+/**
+ * Id of an album of an artist. The album is added to the library if it's new. Otherwise, its year and the case of its
+ * name are the ones of the last track which was saved, like when they were stored with each track. 0 if it couldn't
+ * be written: the transaction should be rolled back.
+ */
+int SqlDatabase::insertIntoTableAlbums(int artistId, const QString &name, const QString &normalizedName, const QString &year)
+{
+	// Tracks without tag are grouped in an album without name
+	const QString key = normalizedName.isNull() ? QStringLiteral("") : normalizedName;
+	const QString displayName = name.isNull() ? QStringLiteral("") : name;
+	const QVariant yearTag = yearValue(year);
+	QSqlQuery selectAlbum = this->cachedQuery("SELECT id, name, year FROM albums WHERE artistId = ? AND normalizedName = ?");
+	selectAlbum.addBindValue(artistId);
+	selectAlbum.addBindValue(key);
+	if (selectAlbum.exec() && selectAlbum.next()) {
+		int id = selectAlbum.value(0).toInt();
+		QVariant storedYear = selectAlbum.value(2);
+		bool isSameYear = storedYear.isNull() ? yearTag.isNull() : (!yearTag.isNull() && storedYear.toInt() == yearTag.toInt());
+		bool hasChanged = selectAlbum.value(1).toString() != displayName || !isSameYear;
+		selectAlbum.finish();
+		if (hasChanged) {
+			QSqlQuery updateAlbum = this->cachedQuery("UPDATE albums SET name = ?, year = ? WHERE id = ?");
+			updateAlbum.addBindValue(displayName);
+			updateAlbum.addBindValue(yearTag);
+			updateAlbum.addBindValue(id);
+			if (!updateAlbum.exec()) {
+				qDebug() << Q_FUNC_INFO << updateAlbum.lastError();
+				id = 0;
+			}
+			updateAlbum.finish();
+		}
+		return id;
+	}
+	selectAlbum.finish();
+
+	QSqlQuery insertAlbum = this->cachedQuery("INSERT INTO albums (artistId, name, normalizedName, year, sortKey) VALUES (?, ?, ?, ?, ?)");
+	insertAlbum.addBindValue(artistId);
+	insertAlbum.addBindValue(displayName);
+	insertAlbum.addBindValue(key);
+	insertAlbum.addBindValue(yearTag);
+	insertAlbum.addBindValue(key.toUtf8());
+	int id = 0;
+	if (insertAlbum.exec()) {
+		id = insertAlbum.lastInsertId().toInt();
 	} else {
-		if (playlist.id().isEmpty()) {
-			auto seed = std::chrono::system_clock::now().time_since_epoch().count();
-			std::mt19937_64 generator(seed);
-			id = tt(generator);
-		} else {
-			id = playlist.id().toUInt();
+		qDebug() << Q_FUNC_INFO << insertAlbum.lastError();
+	}
+	insertAlbum.finish();
+	return id;
+}
+
+/**
+ * Id of an artist. The artist is added to the library if it's new. Otherwise, its name is the one of the last track which
+ * was saved. 0 if it couldn't be written: the transaction should be rolled back.
+ */
+int SqlDatabase::insertIntoTableArtists(const QString &name, const QString &normalizedName, const QString &icon, const QString &host)
+{
+	const QString key = normalizedName.isNull() ? QStringLiteral("") : normalizedName;
+	const QString displayName = name.isNull() ? QStringLiteral("") : name;
+	QSqlQuery selectArtist = this->cachedQuery("SELECT id, name FROM artists WHERE normalizedName = ?");
+	selectArtist.addBindValue(key);
+	if (selectArtist.exec() && selectArtist.next()) {
+		int id = selectArtist.value(0).toInt();
+		bool hasChanged = selectArtist.value(1).toString() != displayName;
+		selectArtist.finish();
+		if (hasChanged) {
+			QSqlQuery updateArtist = this->cachedQuery("UPDATE artists SET name = ? WHERE id = ?");
+			updateArtist.addBindValue(displayName);
+			updateArtist.addBindValue(id);
+			if (!updateArtist.exec()) {
+				qDebug() << Q_FUNC_INFO << updateArtist.lastError();
+				id = 0;
+			}
+			updateArtist.finish();
 		}
+		return id;
+	}
+	selectArtist.finish();
+
+	QSqlQuery insertArtist = this->cachedQuery("INSERT INTO artists (name, normalizedName, icon, host, sortKey) VALUES (?, ?, ?, ?, ?)");
+	insertArtist.addBindValue(displayName);
+	insertArtist.addBindValue(key);
+	insertArtist.addBindValue(icon.isEmpty() ? QVariant() : QVariant(icon));
+	insertArtist.addBindValue(host.isEmpty() ? QVariant() : QVariant(host));
+	insertArtist.addBindValue(key.toUtf8());
+	int id = 0;
+	if (insertArtist.exec()) {
+		id = insertArtist.lastInsertId().toInt();
+	} else {
+		qDebug() << Q_FUNC_INFO << insertArtist.lastError();
+	}
+	insertArtist.finish();
+	return id;
+}
 
-		QSqlQuery insert(*this);
-		insert.prepare("INSERT INTO playlists(id, title, duration, icon, host, checksum) VALUES (?, ?, ?, ?, ?, ?)");
+uint SqlDatabase::insertIntoTablePlaylists(const PlaylistDAO &playlist, const QStringList &tracks, bool isOverwriting)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	qDebug() << Q_FUNC_INFO << tracks;
+
+	if (!this->transaction()) {
+		qDebug() << Q_FUNC_INFO << this->lastError();
+		return 0;
+	}
+	uint id = playlist.id().isEmpty() ? this->generatePlaylistId() : playlist.id().toUInt();
+	bool b;
+	if (isOverwriting && this->updateTablePlaylist(playlist)) {
+		b = this->insertIntoTablePlaylistTracks(id, tracks, isOverwriting);
+	} else {
+		// Saves in background are merged: overwriting a playlist whose first save was merged with this one inserts it
+		QSqlQuery insert = this->cachedQuery("INSERT INTO playlists(id, title, duration, icon, host, checksum) VALUES (?, ?, ?, ?, ?, ?)");
 		insert.addBindValue(id);
 		insert.addBindValue(playlist.title());
 		insert.addBindValue(playlist.length());
 		insert.addBindValue(playlist.icon());
 		insert.addBindValue(playlist.host());
 		insert.addBindValue(playlist.checksum());
-		if (insert.exec()) {
-			this->insertIntoTablePlaylistTracks(id, tracks);
+		b = insert.exec();
+		if (!b) {
+			qDebug() << Q_FUNC_INFO << insert.lastError();
 		}
+		insert.finish();
+		b = b && this->insertIntoTablePlaylistTracks(id, tracks);
 	}
-	this->commit();
-	return id;
+
+	// Nothing is kept from a playlist which couldn't be saved entirely
+	if (b && this->commit()) {
+		return id;
+	}
+	this->rollback();
+	return 0;
 }
 
-bool SqlDatabase::insertIntoTablePlaylistTracks(uint playlistId, const QStringList &tracks, bool isOverwriting)
+/**
+ * Random id for a new playlist, which can be known before the playlist is written. Ids of saved playlists, and the ones
+ * which were given before in this session, are never drawn again.
+ */
+uint SqlDatabase::generatePlaylistId()
 {
 	if (!isOpen()) {
 		open();
 		this->setPragmas();
 	}
 
-	this->transaction();
-	if (isOverwriting) {
-		QSqlQuery deleteTracks(*this);
-		deleteTracks.prepare("DELETE FROM playlistTracks WHERE playlistId = ?");
-		deleteTracks.addBindValue(playlistId);
-		deleteTracks.exec();
-	}
-	/// TODO remote tracks?
-	for (QString track : tracks) {
-		QSqlQuery insert(*this);
-		insert.prepare("INSERT INTO playlistTracks (uri, playlistId) VALUES (?, ?)");
-		insert.addBindValue(track);
-		insert.addBindValue(playlistId);
-
-		insert.exec();
+	// Seeded once: two playlists saved within the resolution of the clock would get the same id otherwise. 0 means no id
+	static QMutex mutex;
+	static std::mt19937_64 generator(std::random_device()() ^ static_cast<quint64>(std::chrono::system_clock::now().time_since_epoch().count()));
+	static std::uniform_int_distribution<uint> ids(1, std::numeric_limits<uint>::max());
+	static QSet<uint> givenIds;
+
+	QMutexLocker locker(&mutex);
+	forever {
+		uint id = ids(generator);
+		if (givenIds.contains(id)) {
+			continue;
+		}
+		QSqlQuery selectPlaylist = this->cachedQuery("SELECT 1 FROM playlists WHERE id = ?");
+		selectPlaylist.addBindValue(id);
+		bool exists = selectPlaylist.exec() && selectPlaylist.next();
+		selectPlaylist.finish();
+		if (!exists) {
+			givenIds.insert(id);
+			return id;
+		}
 	}
-	this->commit();
-	return lastError().type() == QSqlError::NoError;
 }
 
-bool SqlDatabase::insertIntoTableTracks(const TrackDAO &track)
+/** Saves tracks of a playlist. When overwriting, only tracks which were inserted, removed or moved since last save are written. */
+bool SqlDatabase::insertIntoTablePlaylistTracks(uint playlistId, const QStringList &tracks, bool isOverwriting)
 {
 	if (!isOpen()) {
 		open();
 		this->setPragmas();
 	}
 
-	QSqlQuery insertTrack(*this);
-	insertTrack.prepare("INSERT INTO cache (uri, trackNumber, trackTitle, artist, album, artistAlbum, trackLength, rating, " \
-		"disc, host, icon) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	bool isOwningTransaction = this->transaction();
+
+	// Tracks saved last time, in order
+	QList<qint64> savedPositions;
+	QStringList savedUris;
+	QSqlQuery selectTracks = this->cachedQuery("SELECT p.position, COALESCE(t.uri, p.uri) FROM playlistTracks p " \
+											   "LEFT JOIN tracks t ON t.id = p.trackId WHERE p.playlistId = ? ORDER BY p.position");
+	selectTracks.addBindValue(playlistId);
+	if (selectTracks.exec()) {
+		while (selectTracks.next()) {
+			savedPositions << selectTracks.value(0).toLongLong();
+			savedUris << selectTracks.value(1).toString();
+		}
+	}
+	selectTracks.finish();
+	const QStringList uris = isOverwriting ? tracks : savedUris + tracks;
+	const int n = uris.size();
+
+	// Each track is matched with the first saved track with the same uri which hasn't been matched yet
+	QHash<QString, QList<int>> savedIndexes;
+	for (int i = 0; i < savedUris.size(); i++) {
+		savedIndexes[savedUris.at(i)].append(i);
+	}
+	QVector<int> matches(n, -1);
+	for (int j = 0; j < n; j++) {
+		auto it = savedIndexes.find(uris.at(j));
+		if (it != savedIndexes.end() && !it->isEmpty()) {
+			matches[j] = it->takeFirst();
+		}
+	}
+
+	// Saved tracks which are still in the same order keep their rows: they are the longest increasing subsequence of matches
+	QVector<int> tails;
+	QVector<int> previous(n, -1);
+	for (int j = 0; j < n; j++) {
+		if (matches.at(j) < 0) {
+			continue;
+		}
+		auto it = std::lower_bound(tails.begin(), tails.end(), matches.at(j), [&matches](int t, int match) {
+			return matches.at(t) < match;
+		});
+		if (it != tails.begin()) {
+			previous[j] = *(it - 1);
+		}
+		if (it == tails.end()) {
+			tails.append(j);
+		} else {
+			*it = j;
+		}
+	}
+	QVector<bool> isKept(n, false);
+	QVector<bool> isSavedKept(savedUris.size(), false);
+	for (int j = tails.isEmpty() ? -1 : tails.last(); j >= 0; j = previous.at(j)) {
+		isKept[j] = true;
+		isSavedKept[matches.at(j)] = true;
+	}
+
+	// Other tracks are spread between the positions of their kept neighbours. Everything is renumbered if there is no gap left
+	QVector<qint64> positions(n, 0);
+	bool isRenumbering = false;
+	for (int j = 0; j < n;) {
+		if (isKept.at(j)) {
+			positions[j] = savedPositions.at(matches.at(j));
+			j++;
+			continue;
+		}
+		int end = j;
+		while (end < n && !isKept.at(end)) {
+			end++;
+		}
+		qint64 k = end - j;
+		qint64 low, high;
+		if (j > 0) {
+			low = savedPositions.at(matches.at(j - 1));
+			high = end < n ? savedPositions.at(matches.at(end)) : low + (k + 1) * playlistPositionStep;
+		} else {
+			high = end < n ? savedPositions.at(matches.at(end)) : (k + 1) * playlistPositionStep;
+			low = high - (k + 1) * playlistPositionStep;
+		}
+		if (high - low <= k) {
+			isRenumbering = true;
+			break;
+		}
+		for (qint64 i = 0; i < k; i++) {
+			positions[j + i] = low + (high - low) * (i + 1) / (k + 1);
+		}
+		j = end;
+	}
+	if (isRenumbering) {
+		isKept.fill(false);
+		isSavedKept.fill(false);
+		for (int j = 0; j < n; j++) {
+			positions[j] = (j + 1) * playlistPositionStep;
+		}
+	}
 
-	QString artistAlbum = track.artistAlbum().isEmpty() ? track.artist() : track.artistAlbum();
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString albumNorm = this->normalizeField(track.album());
-	uint artistId = qHash(artistNorm);
-	uint albumId = artistId + qHash(albumNorm, 1);
+	// Rows are removed first, so that new positions can't collide with them
+	bool b = true;
+	QSqlQuery deleteTrack = this->cachedQuery("DELETE FROM playlistTracks WHERE playlistId = ? AND position = ?");
+	for (int i = 0; i < savedUris.size(); i++) {
+		if (!isSavedKept.at(i)) {
+			deleteTrack.addBindValue(playlistId);
+			deleteTrack.addBindValue(savedPositions.at(i));
+			b = deleteTrack.exec() && b;
+		}
+	}
+	deleteTrack.finish();
+
+	QSqlQuery insertTrack = this->cachedQuery("INSERT INTO playlistTracks (playlistId, position, trackId, uri) " \
+											  "VALUES (?, ?, (SELECT id FROM tracks WHERE uri = ?), ?)");
+	for (int j = 0; j < n; j++) {
+		if (!isKept.at(j)) {
+			insertTrack.addBindValue(playlistId);
+			insertTrack.addBindValue(positions.at(j));
+			insertTrack.addBindValue(uris.at(j));
+			insertTrack.addBindValue(uris.at(j));
+			if (!insertTrack.exec()) {
+				qDebug() << Q_FUNC_INFO << insertTrack.lastError();
+				b = false;
+			}
+		}
+	}
+	insertTrack.finish();
 
-	insertTrack.addBindValue(track.uri());
-	insertTrack.addBindValue(track.trackNumber());
-	insertTrack.addBindValue(track.title());
-	insertTrack.addBindValue(artistId);
-	insertTrack.addBindValue(albumId);
-	insertTrack.addBindValue(track.artistAlbum());
-	insertTrack.addBindValue(track.length());
-	insertTrack.addBindValue(track.rating());
-	insertTrack.addBindValue(track.disc());
-	insertTrack.addBindValue(track.host());
-	insertTrack.addBindValue(track.icon());
-	bool b = insertTrack.exec();
+	if (isOwningTransaction) {
+		if (b) {
+			b = this->commit();
+		}
+		if (!b) {
+			this->rollback();
+		}
+	}
+	return b;
+}
+
+bool SqlDatabase::insertIntoTableTracks(const TrackDAO &track)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+	bool b = this->saveTrackRecord(toTrackRecord(track));
+	if (b) {
+		this->bumpLibraryGeneration();
+	}
 	return b;
 }
 
 bool SqlDatabase::insertIntoTableTracks(const std::list<TrackDAO> &tracks)
+{
+	QVector<TrackRecord> records;
+	records.reserve(static_cast<int>(tracks.size()));
+	for (const TrackDAO &track : tracks) {
+		records.append(toTrackRecord(track));
+	}
+	return this->upsertTracks(records).failedCount == 0;
+}
+
+/** Adds tracks, or replaces the ones which already have the same uri, in a single transaction. */
+UpsertStatistics SqlDatabase::upsertTracks(const QVector<TrackRecord> &records)
 {
 	if (!isOpen()) {
 		open();
 		this->setPragmas();
 	}
 
-	bool b = true;
-	for (std::list<TrackDAO>::const_iterator it = tracks.cbegin(); it != tracks.cend(); ++it) {
-		TrackDAO track = *it;
-		bool g = this->insertIntoTableTracks(track);
-		b = b && g;
+	UpsertStatistics statistics;
+	QElapsedTimer timer;
+	timer.start();
+	bool isOwningTransaction = this->transaction();
+	for (const TrackRecord &record : records) {
+		if (!this->saveTrackRecord(record)) {
+			statistics.failedCount++;
+		}
 	}
-	return b;
+	statistics.trackCount = records.size();
+	if (statistics.failedCount < records.size()) {
+		this->bumpLibraryGeneration();
+	}
+	statistics.writeTime = timer.restart();
+
+	if (isOwningTransaction && !this->commit()) {
+		qDebug() << Q_FUNC_INFO << this->lastError();
+		this->rollback();
+		statistics.failedCount = records.size();
+	}
+	statistics.commitTime = timer.elapsed();
+	qDebug() << Q_FUNC_INFO << statistics.trackCount << "tracks," << statistics.failedCount << "failed, written in"
+			 << statistics.writeTime << "ms, committed in" << statistics.commitTime << "ms";
+	if (isOwningTransaction && statistics.failedCount < records.size()) {
+		emit aboutToUpdateView();
+	}
+	return statistics;
 }
 
 void SqlDatabase::removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm)
@@ -221,13 +1000,17 @@ void SqlDatabase::removeCoverForAlbum(bool internalCover, const QString &artistN
 	}
 	QSqlQuery updateTrack(*this);
 	if (internalCover) {
-		updateTrack.prepare("UPDATE cache SET internalCover = NULL WHERE artistNormalized = ? AND albumNormalized = ?");
+		updateTrack.prepare("UPDATE tracks SET internalCover = 0 WHERE albumId = " \
+							"(SELECT al.id FROM albums al JOIN artists ar ON ar.id = al.artistId WHERE ar.normalizedName = ? AND al.normalizedName = ?)");
 	} else {
-		updateTrack.prepare("UPDATE cache SET cover = NULL WHERE artistNormalized = ? AND albumNormalized = ?");
+		updateTrack.prepare("UPDATE albums SET cover = NULL WHERE artistId = (SELECT id FROM artists WHERE normalizedName = ?) AND normalizedName = ?");
 	}
 	updateTrack.addBindValue(artistNorm);
 	updateTrack.addBindValue(albumNorm);
 	bool b = updateTrack.exec();
+	if (b) {
+		this->bumpLibraryGeneration();
+	}
 	qDebug() << Q_FUNC_INFO << "database was updated" << b;
 }
 
@@ -237,18 +1020,23 @@ bool SqlDatabase::removePlaylist(uint playlistId)
 		open();
 		this->setPragmas();
 	}
-	this->transaction();
+	if (!this->transaction()) {
+		return false;
+	}
 	/// XXX: CASCADE not working?
 	QSqlQuery children(*this);
 	children.prepare("DELETE FROM playlistTracks WHERE playlistId = :id");
 	children.bindValue(":id", playlistId);
-	children.exec();
 
 	QSqlQuery remove(*this);
 	remove.prepare("DELETE FROM playlists WHERE id = :id");
 	remove.bindValue(":id", playlistId);
-	remove.exec();
-	return this->commit();
+	if (children.exec() && remove.exec() && this->commit()) {
+		return true;
+	}
+	qDebug() << Q_FUNC_INFO << this->lastError();
+	this->rollback();
+	return false;
 }
 
 void SqlDatabase::removePlaylistsFromHost(const QString &host)
@@ -283,13 +1071,192 @@ void SqlDatabase::removeRecordsFromHost(const QString &host)
 	qDebug() << Q_FUNC_INFO << host;
 	this->transaction();
 	QSqlQuery removeTracks(*this);
-	removeTracks.prepare("DELETE FROM cache WHERE host LIKE :h");
+	removeTracks.prepare("DELETE FROM tracks WHERE host LIKE :h");
 	removeTracks.bindValue(":h", host);
 	removeTracks.exec();
+	this->removeOrphans();
+	this->bumpLibraryGeneration();
 
 	this->commit();
 }
 
+/** Removes local tracks which couldn't be found anymore on the filesystem. A path can also be a folder. */
+void SqlDatabase::removeRecords(const QStringList &paths)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	// Can be part of a larger transaction, which is then responsible for orphans and for the generation
+	bool isOwningTransaction = this->transaction();
+	QSqlQuery removeTrack(*this);
+	// Everything under a folder is in range ["folder/", "folder0"[ ('0' follows '/'), so the index on uri can be used
+	removeTrack.prepare("DELETE FROM tracks WHERE uri = ? OR (uri >= ? AND uri < ?)");
+	for (QString path : paths) {
+		removeTrack.addBindValue(path);
+		removeTrack.addBindValue(path + "/");
+		removeTrack.addBindValue(path + "0");
+		if (!removeTrack.exec()) {
+			qDebug() << Q_FUNC_INFO << removeTrack.lastError();
+		}
+	}
+	if (isOwningTransaction) {
+		this->removeOrphans();
+		this->bumpLibraryGeneration();
+		this->commit();
+	}
+}
+
+/** Removes folders, albums and artists which don't have any track anymore. True if an album or an artist was removed. */
+bool SqlDatabase::removeOrphans()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	// Folders without tracks don't need their pictures anymore
+	this->exec("DELETE FROM directories WHERE id NOT IN (SELECT DISTINCT directoryId FROM tracks WHERE directoryId IS NOT NULL)");
+	int albumCount = this->exec("DELETE FROM albums WHERE id NOT IN (SELECT DISTINCT albumId FROM tracks)").numRowsAffected();
+	int artistCount = this->exec("DELETE FROM artists WHERE id NOT IN (SELECT DISTINCT artistId FROM tracks) " \
+								 "AND id NOT IN (SELECT artistId FROM albums)").numRowsAffected();
+	return albumCount > 0 || artistCount > 0;
+}
+
+/** Forgets the position of the last scan, once it has reached the end of every location. */
+void SqlDatabase::removeScanCheckpoints()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+	this->exec("DELETE FROM scanCheckpoints");
+}
+
+/** Updates references to a file, or to every file under a folder, which has been moved or renamed. Tracks at the new path are replaced. */
+void SqlDatabase::moveRecords(const QString &oldPath, const QString &newPath)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QString oldFolder = oldPath + "/";
+	QString oldFolderEnd = oldPath + "0";
+	int length = oldPath.length() + 1;
+
+	// A file renamed over another one replaces it: rows of the target would collide with the moved ones
+	QSqlQuery removeTargetTracks(*this);
+	removeTargetTracks.prepare("DELETE FROM tracks WHERE uri = ? OR (uri >= ? AND uri < ?)");
+	removeTargetTracks.addBindValue(newPath);
+	removeTargetTracks.addBindValue(newPath + "/");
+	removeTargetTracks.addBindValue(newPath + "0");
+	if (!removeTargetTracks.exec()) {
+		qDebug() << Q_FUNC_INFO << removeTargetTracks.lastError();
+	}
+	QSqlQuery removeTargetDirectories(*this);
+	removeTargetDirectories.prepare("DELETE FROM directories WHERE (path = ? OR (path >= ? AND path < ?)) " \
+									"AND id NOT IN (SELECT DISTINCT directoryId FROM tracks WHERE directoryId IS NOT NULL)");
+	removeTargetDirectories.addBindValue(newPath);
+	removeTargetDirectories.addBindValue(newPath + "/");
+	removeTargetDirectories.addBindValue(newPath + "0");
+	if (!removeTargetDirectories.exec()) {
+		qDebug() << Q_FUNC_INFO << removeTargetDirectories.lastError();
+	}
+
+	QSqlQuery moveTracks(*this);
+	moveTracks.prepare("UPDATE tracks SET uri = ? || substr(uri, ?) WHERE uri = ? OR (uri >= ? AND uri < ?)");
+	moveTracks.addBindValue(newPath);
+	moveTracks.addBindValue(length);
+	moveTracks.addBindValue(oldPath);
+	moveTracks.addBindValue(oldFolder);
+	moveTracks.addBindValue(oldFolderEnd);
+	if (!moveTracks.exec()) {
+		qDebug() << Q_FUNC_INFO << moveTracks.lastError();
+	}
+
+	QSqlQuery moveCovers(*this);
+	moveCovers.prepare("UPDATE albums SET cover = ? || substr(cover, ?) WHERE cover = ? OR (cover >= ? AND cover < ?)");
+	moveCovers.addBindValue(newPath);
+	moveCovers.addBindValue(length);
+	moveCovers.addBindValue(oldPath);
+	moveCovers.addBindValue(oldFolder);
+	moveCovers.addBindValue(oldFolderEnd);
+	if (!moveCovers.exec()) {
+		qDebug() << Q_FUNC_INFO << moveCovers.lastError();
+	}
+
+	QSqlQuery moveDirectories(*this);
+	moveDirectories.prepare("UPDATE directories SET path = ? || substr(path, ?), " \
+							"cover = CASE WHEN cover IS NULL THEN NULL ELSE ? || substr(cover, ?) END " \
+							"WHERE path = ? OR (path >= ? AND path < ?)");
+	moveDirectories.addBindValue(newPath);
+	moveDirectories.addBindValue(length);
+	moveDirectories.addBindValue(newPath);
+	moveDirectories.addBindValue(length);
+	moveDirectories.addBindValue(oldPath);
+	moveDirectories.addBindValue(oldFolder);
+	moveDirectories.addBindValue(oldFolderEnd);
+	if (!moveDirectories.exec()) {
+		qDebug() << Q_FUNC_INFO << moveDirectories.lastError();
+	}
+}
+
+/** Links tracks of a folder to this folder, and their albums to the picture which was chosen as their cover. */
+void SqlDatabase::saveDirectory(const QString &path, const QString &coverPath)
+{
+	QSqlQuery insertDirectory = this->cachedQuery("INSERT OR IGNORE INTO directories (path) VALUES (?)");
+	insertDirectory.addBindValue(path);
+	insertDirectory.exec();
+	insertDirectory.finish();
+
+	QSqlQuery selectDirectory = this->cachedQuery("SELECT id FROM directories WHERE path = ?");
+	selectDirectory.addBindValue(path);
+	if (!selectDirectory.exec() || !selectDirectory.next()) {
+		qDebug() << Q_FUNC_INFO << selectDirectory.lastError();
+		selectDirectory.finish();
+		return;
+	}
+	int directoryId = selectDirectory.value(0).toInt();
+	selectDirectory.finish();
+
+	// Rows which are already up to date aren't written again, so that they don't change the library for nothing
+	QVariant cover = coverPath.isEmpty() ? QVariant() : QVariant(coverPath);
+	QSqlQuery updateDirectory = this->cachedQuery("UPDATE directories SET cover = ? WHERE id = ? AND cover IS NOT ?");
+	updateDirectory.addBindValue(cover);
+	updateDirectory.addBindValue(directoryId);
+	updateDirectory.addBindValue(cover);
+	updateDirectory.exec();
+	updateDirectory.finish();
+
+	// Only files right under this folder, not in its subfolders
+	QSqlQuery linkTracks = this->cachedQuery("UPDATE tracks SET directoryId = ? " \
+					   "WHERE uri >= ? AND uri < ? AND instr(substr(uri, ?), '/') = 0 AND directoryId IS NOT ?");
+	linkTracks.addBindValue(directoryId);
+	linkTracks.addBindValue(path + "/");
+	linkTracks.addBindValue(path + "0");
+	linkTracks.addBindValue(path.length() + 2);
+	linkTracks.addBindValue(directoryId);
+	if (!linkTracks.exec()) {
+		qDebug() << Q_FUNC_INFO << linkTracks.lastError();
+	}
+	linkTracks.finish();
+
+	// A folder without picture doesn't reset existing covers, like the ones which were fetched from the Internet
+	if (!coverPath.isEmpty()) {
+		QSqlQuery linkAlbums = this->cachedQuery("UPDATE albums SET cover = ? WHERE id IN " \
+												 "(SELECT albumId FROM tracks WHERE directoryId = ?) AND cover IS NOT ?");
+		linkAlbums.addBindValue(coverPath);
+		linkAlbums.addBindValue(directoryId);
+		linkAlbums.addBindValue(coverPath);
+		if (!linkAlbums.exec()) {
+			qDebug() << Q_FUNC_INFO << linkAlbums.lastError();
+		}
+		linkAlbums.finish();
+	}
+}
+
 Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 {
 	if (!isOpen()) {
@@ -300,15 +1267,15 @@ Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 	Cover *c = nullptr;
 
 	QSqlQuery selectCover(*this);
-	selectCover.prepare("SELECT DISTINCT internalCover, cover FROM cache WHERE uri = ?");
+	selectCover.prepare("SELECT t.internalCover, al.cover, t.albumId FROM tracks t JOIN albums al ON al.id = t.albumId WHERE t.uri = ?");
 	selectCover.addBindValue(uri);
 	if (selectCover.exec() && selectCover.next()) {
-		QString internalCover = selectCover.record().value(0).toString();
+		bool internalCover = selectCover.record().value(0).toBool();
 		QString coverPath = selectCover.record().value(1).toString();
-		QString album = selectCover.record().value(2).toString();
-		if (!internalCover.isEmpty() || !coverPath.isEmpty()) {
+		int albumId = selectCover.record().value(2).toInt();
+		if (internalCover || !coverPath.isEmpty()) {
 			// If URI has an internal cover, i.e. uri points to a local file
-			if (internalCover.isEmpty()) {
+			if (!internalCover) {
 				c = new Cover(coverPath);
 			} else {
 				FileHelper fh(uri);
@@ -316,8 +1283,8 @@ Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 			}
 		} else {
 			// No direct cover for this file, let's search for the entire album if one track has an inner cover
-			selectCover.prepare("SELECT uri FROM cache WHERE album = ? AND internalCover <> NULL LIMIT 1");
-			selectCover.addBindValue(album);
+			selectCover.prepare("SELECT uri FROM tracks WHERE albumId = ? AND internalCover = 1 LIMIT 1");
+			selectCover.addBindValue(albumId);
 			if (selectCover.exec() && selectCover.next()) {
 				FileHelper fh(selectCover.record().value(0).toString());
 				c = fh.extractCover();
@@ -327,6 +1294,131 @@ Cover* SqlDatabase::selectCoverFromURI(const QString &uri)
 	return c;
 }
 
+/** Id of this library and number of changes to its artists, albums and tracks. False if they can't be read. */
+bool SqlDatabase::selectLibraryGeneration(qint64 &libraryId, qint64 &generation)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QSqlQuery selectGeneration = this->cachedQuery("SELECT libraryId, generation FROM libraryGeneration");
+	bool isFound = false;
+	if (!selectGeneration.exec()) {
+		qDebug() << Q_FUNC_INFO << selectGeneration.lastError();
+	} else if (selectGeneration.next()) {
+		libraryId = selectGeneration.value(0).toLongLong();
+		generation = selectGeneration.value(1).toLongLong();
+		isFound = true;
+	}
+	selectGeneration.finish();
+	return isFound;
+}
+
+/** Uris of the track at a path, or of every track under a folder. */
+QStringList SqlDatabase::selectTrackUris(const QString &path)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QStringList uris;
+	QSqlQuery selectTracks = this->cachedQuery("SELECT uri FROM tracks WHERE uri = ? OR (uri >= ? AND uri < ?)");
+	selectTracks.addBindValue(path);
+	selectTracks.addBindValue(path + "/");
+	selectTracks.addBindValue(path + "0");
+	if (selectTracks.exec()) {
+		while (selectTracks.next()) {
+			uris << selectTracks.value(0).toString();
+		}
+	} else {
+		qDebug() << Q_FUNC_INFO << selectTracks.lastError();
+	}
+	selectTracks.finish();
+	return uris;
+}
+
+/** Fingerprints of all local tracks, to find out which files have changed since last scan. */
+QHash<QString, FileFingerprint> SqlDatabase::selectFingerprints()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QHash<QString, FileFingerprint> fingerprints;
+	QSqlQuery results(*this);
+	results.setForwardOnly(true);
+	if (results.exec("SELECT uri, mtime, fileSize, inode FROM tracks WHERE host IS NULL")) {
+		while (results.next()) {
+			FileFingerprint fingerprint;
+			fingerprint.mtime = results.value(1).toLongLong();
+			fingerprint.size = results.value(2).toLongLong();
+			fingerprint.inode = results.value(3).toULongLong();
+			fingerprints.insert(results.value(0).toString(), fingerprint);
+		}
+	}
+	return fingerprints;
+}
+
+/** Folders with tracks, and the picture which was chosen for each of them, to save only the ones which have changed. */
+QHash<QString, QString> SqlDatabase::selectDirectories()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QHash<QString, QString> covers;
+	QSqlQuery results(*this);
+	results.setForwardOnly(true);
+	if (results.exec("SELECT path, cover FROM directories")) {
+		while (results.next()) {
+			covers.insert(results.value(0).toString(), results.value(1).toString());
+		}
+	}
+	return covers;
+}
+
+/** Number of entries found in each music location during last scan. */
+QHash<QString, int> SqlDatabase::selectLocationEntryCounts()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QHash<QString, int> entryCounts;
+	QSqlQuery results(*this);
+	results.setForwardOnly(true);
+	if (results.exec("SELECT path, entryCount FROM locations")) {
+		while (results.next()) {
+			entryCounts.insert(results.value(0).toString(), results.value(1).toInt());
+		}
+	}
+	return entryCounts;
+}
+
+/** Last folder reached by the walk in each location if last scan was interrupted, an empty list otherwise. */
+QHash<QString, QString> SqlDatabase::selectScanCheckpoints()
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QHash<QString, QString> checkpoints;
+	QSqlQuery results(*this);
+	results.setForwardOnly(true);
+	if (results.exec("SELECT location, folder FROM scanCheckpoints")) {
+		while (results.next()) {
+			checkpoints.insert(results.value(0).toString(), results.value(1).toString());
+		}
+	}
+	return checkpoints;
+}
+
 QStringList SqlDatabase::selectPlaylistTracks(uint playlistID, bool withPrefix)
 {
 	if (!isOpen()) {
@@ -336,7 +1428,9 @@ QStringList SqlDatabase::selectPlaylistTracks(uint playlistID, bool withPrefix)
 
 	QStringList tracks;
 	QSqlQuery results(*this);
-	results.prepare("SELECT uri FROM playlistTracks WHERE playlistId = ?");
+	results.setForwardOnly(true);
+	results.prepare("SELECT COALESCE(t.uri, p.uri) FROM playlistTracks p LEFT JOIN tracks t ON t.id = p.trackId " \
+					"WHERE p.playlistId = ? ORDER BY p.position");
 	results.addBindValue(playlistID);
 	if (results.exec()) {
 		while (results.next()) {
@@ -371,6 +1465,29 @@ PlaylistDAO SqlDatabase::selectPlaylist(uint playlistId)
 	return playlist;
 }
 
+/** Playlist which has exactly the same tracks, or an empty one. */
+PlaylistDAO SqlDatabase::selectPlaylistByChecksum(const QString &checksum)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	PlaylistDAO playlist;
+	QSqlQuery results = this->cachedQuery("SELECT id, title, checksum, icon, background FROM playlists WHERE checksum = ? LIMIT 1");
+	results.addBindValue(checksum);
+	if (results.exec() && results.next()) {
+		int i = -1;
+		playlist.setId(results.value(++i).toString());
+		playlist.setTitle(results.value(++i).toString());
+		playlist.setChecksum(results.value(++i).toString());
+		playlist.setIcon(results.value(++i).toString());
+		playlist.setBackground(results.value(++i).toString());
+	}
+	results.finish();
+	return playlist;
+}
+
 QList<PlaylistDAO> SqlDatabase::selectPlaylists()
 {
 	if (!isOpen()) {
@@ -426,10 +1543,10 @@ TrackDAO SqlDatabase::selectTrackByURI(const QString &uri)
 	}
 
 	TrackDAO track;
-	QSqlQuery qTracks(*this);
-	qTracks.prepare("SELECT uri, trackNumber, trackTitle, artist, album, artistAlbum, trackLength, " \
-					"rating, disc, host, icon, albumYear " \
-					"FROM cache WHERE uri = ?");
+	QSqlQuery qTracks = this->cachedQuery("SELECT t.uri, t.trackNumber, t.title, ta.name, al.name, aa.name, t.length, " \
+					"t.rating, t.disc, t.host, t.icon, al.year " \
+					"FROM tracks t JOIN albums al ON al.id = t.albumId JOIN artists aa ON aa.id = al.artistId " \
+					"JOIN artists ta ON ta.id = t.artistId WHERE t.uri = ?");
 	qTracks.addBindValue(uri);
 	if (qTracks.exec() && qTracks.next()) {
 		QSqlRecord r = qTracks.record();
@@ -447,9 +1564,118 @@ TrackDAO SqlDatabase::selectTrackByURI(const QString &uri)
 		track.setIcon(r.value(++j).toString());
 		track.setYear(r.value(++j).toString());
 	}
+	qTracks.finish();
 	return track;
 }
 
+/** Artists whose name starts with words being typed, best matches first. */
+QStringList SqlDatabase::searchArtists(const QString &text, int limit)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QStringList artists;
+	QSqlQuery qArtists;
+	if (isSearchIndexAvailable) {
+		QString match = matchExpression(text, true);
+		if (match.isEmpty()) {
+			return artists;
+		}
+		qArtists = this->cachedQuery(isRankedSearch(text) ? "SELECT name FROM artistSearch WHERE artistSearch MATCH ? ORDER BY rank LIMIT ?"
+														  : "SELECT name FROM artistSearch WHERE artistSearch MATCH ? LIMIT ?");
+		qArtists.addBindValue(match);
+	} else {
+		qArtists = this->cachedQuery("SELECT name FROM artists WHERE name LIKE ? LIMIT ?");
+		qArtists.addBindValue("%" + text + "%");
+	}
+	qArtists.addBindValue(limit);
+	if (qArtists.exec()) {
+		while (qArtists.next()) {
+			artists << qArtists.value(0).toString();
+		}
+	} else {
+		qDebug() << Q_FUNC_INFO << qArtists.lastError();
+	}
+	qArtists.finish();
+	return artists;
+}
+
+/** Albums whose name starts with words being typed, with their artist, best matches first. */
+QList<QPair<QString, QString>> SqlDatabase::searchAlbums(const QString &text, int limit)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	QList<QPair<QString, QString>> albums;
+	QSqlQuery qAlbums;
+	if (isSearchIndexAvailable) {
+		QString match = matchExpression(text, true);
+		if (match.isEmpty()) {
+			return albums;
+		}
+		qAlbums = this->cachedQuery(isRankedSearch(text) ? "SELECT name, artist FROM albumSearch WHERE albumSearch MATCH ? ORDER BY rank LIMIT ?"
+														 : "SELECT name, artist FROM albumSearch WHERE albumSearch MATCH ? LIMIT ?");
+		qAlbums.addBindValue(match);
+	} else {
+		qAlbums = this->cachedQuery("SELECT al.name, ar.name FROM albums al JOIN artists ar ON ar.id = al.artistId WHERE al.name LIKE ? LIMIT ?");
+		qAlbums.addBindValue("%" + text + "%");
+	}
+	qAlbums.addBindValue(limit);
+	if (qAlbums.exec()) {
+		while (qAlbums.next()) {
+			albums.append(qMakePair(qAlbums.value(0).toString(), qAlbums.value(1).toString()));
+		}
+	} else {
+		qDebug() << Q_FUNC_INFO << qAlbums.lastError();
+	}
+	qAlbums.finish();
+	return albums;
+}
+
+/** Tracks whose title, artist or album starts with words being typed, best matches first. */
+std::list<TrackDAO> SqlDatabase::searchTracks(const QString &text, int limit)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	std::list<TrackDAO> tracks;
+	QSqlQuery qTracks;
+	if (isSearchIndexAvailable) {
+		QString match = matchExpression(text, false);
+		if (match.isEmpty()) {
+			return tracks;
+		}
+		qTracks = this->cachedQuery(isRankedSearch(text) ? "SELECT s.title, s.artist, t.uri FROM trackSearch s JOIN tracks t ON t.id = s.rowid " \
+														   "WHERE trackSearch MATCH ? ORDER BY s.rank LIMIT ?"
+														 : "SELECT s.title, s.artist, t.uri FROM trackSearch s JOIN tracks t ON t.id = s.rowid " \
+														   "WHERE trackSearch MATCH ? LIMIT ?");
+		qTracks.addBindValue(match);
+	} else {
+		qTracks = this->cachedQuery("SELECT t.title, ar.name, t.uri FROM tracks t JOIN artists ar ON ar.id = t.artistId WHERE t.title LIKE ? LIMIT ?");
+		qTracks.addBindValue("%" + text + "%");
+	}
+	qTracks.addBindValue(limit);
+	if (qTracks.exec()) {
+		while (qTracks.next()) {
+			TrackDAO track;
+			track.setTitle(qTracks.value(0).toString());
+			track.setArtist(qTracks.value(1).toString());
+			track.setUri(qTracks.value(2).toString());
+			tracks.push_back(track);
+		}
+	} else {
+		qDebug() << Q_FUNC_INFO << qTracks.lastError();
+	}
+	qTracks.finish();
+	return tracks;
+}
+
 bool SqlDatabase::playlistHasBackgroundImage(uint playlistID)
 {
 	if (!isOpen()) {
@@ -464,6 +1690,7 @@ bool SqlDatabase::playlistHasBackgroundImage(uint playlistID)
 	return result;
 }
 
+/** False if the playlist hasn't been saved yet. */
 bool SqlDatabase::updateTablePlaylist(const PlaylistDAO &playlist)
 {
 	if (!isOpen()) {
@@ -471,12 +1698,13 @@ bool SqlDatabase::updateTablePlaylist(const PlaylistDAO &playlist)
 		this->setPragmas();
 	}
 
-	QSqlQuery update(*this);
-	update.prepare("UPDATE playlists SET title = ?, checksum = ? WHERE id = ?");
+	QSqlQuery update = this->cachedQuery("UPDATE playlists SET title = ?, checksum = ? WHERE id = ?");
 	update.addBindValue(playlist.title());
 	update.addBindValue(playlist.checksum());
 	update.addBindValue(playlist.id());
-	return update.exec();
+	bool b = update.exec() && update.numRowsAffected() > 0;
+	update.finish();
+	return b;
 }
 
 void SqlDatabase::updateTablePlaylistWithBackgroundImage(uint playlistID, const QString &backgroundImagePath)
@@ -493,7 +1721,27 @@ void SqlDatabase::updateTablePlaylistWithBackgroundImage(uint playlistID, const
 	update.exec();
 }
 
-void SqlDatabase::updateTableAlbumWithCoverImage(const QString &coverPath, const QString &album, const QString &artist)
+/** Replaces counts stored by previous scan. Locations which aren't in the list are forgotten. */
+void SqlDatabase::updateLocationEntryCounts(const QHash<QString, int> &entryCounts)
+{
+	if (!isOpen()) {
+		open();
+		this->setPragmas();
+	}
+
+	this->transaction();
+	this->exec("DELETE FROM locations");
+	QSqlQuery insert(*this);
+	insert.prepare("INSERT INTO locations (path, entryCount) VALUES (?, ?)");
+	for (auto it = entryCounts.cbegin(); it != entryCounts.cend(); ++it) {
+		insert.addBindValue(it.key());
+		insert.addBindValue(it.value());
+		insert.exec();
+	}
+	this->commit();
+}
+
+bool SqlDatabase::updateTableAlbumWithCoverImage(const QString &coverPath, const QString &album, const QString &artist)
 {
 	if (!isOpen()) {
 		open();
@@ -505,59 +1753,61 @@ void SqlDatabase::updateTableAlbumWithCoverImage(const QString &coverPath, const
 	update.addBindValue(coverPath);
 	update.addBindValue(this->normalizeField(album));
 	update.addBindValue(this->normalizeField(artist));
-	update.exec();
+	bool b = update.exec();
+	if (b) {
+		this->bumpLibraryGeneration();
+	}
+	return b;
 }
 
 
-void SqlDatabase::updateTrack(const QString &absFilePath)
+bool SqlDatabase::updateTrack(const QString &absFilePath)
 {
-	FileHelper fh(absFilePath);
+	// Only tags have been edited: length which is already in the library is still valid
+	FileHelper fh(absFilePath, FileHelper::RO_SkipAudioProperties);
 	if (!fh.isValid()) {
 		qDebug() << Q_FUNC_INFO << "file is not valid, won't be updated";
-		return;
+		return true;
 	}
 
-	QSqlQuery updateTrack(*this);
-	updateTrack.setForwardOnly(true);
-	updateTrack.prepare("UPDATE cache SET trackNumber = ?, trackTitle = ?, artist = ?, artistNormalized = ?, album = ?, albumNormalized = ?, " \
-						"albumYear = ?, artistAlbum = ?, trackLength = ?, disc = ?, internalCover = ?, rating = ? WHERE uri = ?");
-
-	QString tn = fh.trackNumber();
-	QString title = fh.title();
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
+	FileHelper::Snapshot tags = fh.snapshot();
+	QString artistAlbum = tags.artistAlbum.isEmpty() ? tags.artist : tags.artistAlbum;
 
-	// Use Artist Album to reference tracks in table "tracks", not Artist
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString album = fh.album();
-	QString albumNorm = this->normalizeField(album);
-	QString length = fh.length();
-	int dn = fh.discNumber();
-
-	updateTrack.addBindValue(tn.toInt());
-	if (title.isEmpty()) {
-		updateTrack.addBindValue(fh.fileInfo().baseName());
-	} else {
-		updateTrack.addBindValue(title);
+	// Use Artist Album to reference albums, not Artist
+	int albumArtistId = this->insertIntoTableArtists(artistAlbum, this->normalizeField(artistAlbum));
+	int albumId = this->insertIntoTableAlbums(albumArtistId, tags.album, this->normalizeField(tags.album), tags.year);
+	int artistId = albumArtistId;
+	if (tags.artist != artistAlbum) {
+		artistId = this->insertIntoTableArtists(tags.artist, this->normalizeField(tags.artist));
 	}
-	updateTrack.addBindValue(fh.artist());
-	updateTrack.addBindValue(artistNorm);
-	updateTrack.addBindValue(fh.album());
-	updateTrack.addBindValue(albumNorm);
-	updateTrack.addBindValue(fh.year());
-	updateTrack.addBindValue(artistAlbum);
-	updateTrack.addBindValue(length);
-	updateTrack.addBindValue(dn);
-	if (fh.hasCover()) {
-		updateTrack.addBindValue(absFilePath);
-	} else {
-		updateTrack.addBindValue(QVariant());
+	if (albumArtistId == 0 || albumId == 0 || artistId == 0) {
+		return false;
 	}
-	updateTrack.addBindValue(fh.rating());
+
+	// Sort key follows the title, which is the name of the file when the tag is empty
+	QString title = tags.title.isEmpty() ? fh.fileInfo().baseName() : tags.title;
+	QSqlQuery updateTrack = this->cachedQuery("UPDATE tracks SET albumId = ?, artistId = ?, trackNumber = ?, title = ?, sortKey = ?, disc = ?, " \
+											  "internalCover = ?, rating = ?, mtime = ?, fileSize = ?, inode = ? WHERE uri = ?");
+	updateTrack.addBindValue(albumId);
+	updateTrack.addBindValue(artistId);
+	updateTrack.addBindValue(tags.trackNumber);
+	updateTrack.addBindValue(title);
+	updateTrack.addBindValue(sortKey(title));
+	updateTrack.addBindValue(tags.disc);
+	updateTrack.addBindValue(tags.hasCover);
+	updateTrack.addBindValue(tags.rating);
+	FileFingerprint fingerprint = FileFingerprint::fromFileInfo(fh.fileInfo());
+	updateTrack.addBindValue(fingerprint.mtime);
+	updateTrack.addBindValue(fingerprint.size);
+	updateTrack.addBindValue(fingerprint.inode);
 	updateTrack.addBindValue(absFilePath);
 
-	if (!updateTrack.exec()) {
+	bool b = updateTrack.exec();
+	if (!b) {
 		qDebug() << Q_FUNC_INFO << updateTrack.lastError();
 	}
+	updateTrack.finish();
+	return b;
 }
 
 /** Update a list of tracks. If track name has changed, will be removed from Library then added right after. */
@@ -566,50 +1816,57 @@ void SqlDatabase::updateTracks(const QStringList &oldPaths, const QStringList &n
 	this->init();
 
 	// Signals are blocked to prevent saveFileRef method to emit one. Load method will tell connected views to rebuild themselves
-	transaction();
+	if (!this->transaction()) {
+		qDebug() << Q_FUNC_INFO << this->lastError();
+		return;
+	}
 	Q_ASSERT(oldPaths.size() == newPaths.size());
 
-	//qDebug() << Q_FUNC_INFO << "oldPaths" << oldPaths;
-	//qDebug() << Q_FUNC_INFO << "newPaths" << newPaths;
-	for (int i = 0; i < newPaths.size(); i++) {
+	bool b = true;
+	QStringList removedUris, savedUris;
+	for (int i = 0; i < newPaths.size() && b; i++) {
 		QString newPath = newPaths.at(i);
 		QString oldPath = oldPaths.at(i);
 		if (newPath.isEmpty()) {
-			this->updateTrack(oldPath);
+			b = this->updateTrack(oldPath);
+			savedUris << oldPath;
 		} else {
+			removedUris << oldPath;
+			savedUris << newPath;
 
 			QSqlQuery removeTrack(*this);
-			removeTrack.prepare("DELETE FROM cache WHERE uri = :h");
+			removeTrack.prepare("DELETE FROM tracks WHERE uri = :h");
 			removeTrack.bindValue(":h", oldPath);
-			removeTrack.exec();
+			b = removeTrack.exec();
+			if (!b) {
+				qDebug() << Q_FUNC_INFO << removeTrack.lastError();
+			}
 
-			this->saveFileRef(newPath);
+			TrackRecord record;
+			if (b && readFileRef(newPath, record)) {
+				b = this->saveTrackRecord(record);
+			}
 		}
 	}
+	// Edited tags can move tracks to other albums
+	if (b) {
+		this->removeOrphans();
+		b = this->bumpLibraryGeneration() && this->commit();
+	}
 
-	commit();
+	// Views keep showing the library as it was before the edit
+	if (!b) {
+		this->rollback();
+		return;
+	}
 	emit aboutToUpdateView();
+	emit tracksChanged(removedUris, savedUris);
 }
 
-/** Reads an external picture which is close to multimedia files (same folder). */
-void SqlDatabase::saveCoverRef(const QString &coverPath, const QString &track)
+QString SqlDatabase::normalizeField(const QString &s)
 {
-	FileHelper fh(track);
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString albumNorm = this->normalizeField(fh.album());
-
-	QSqlQuery updateCoverPath("UPDATE cache SET cover = ? WHERE artistNormalized = ? AND albumNormalized = ?", *this);
-	updateCoverPath.setForwardOnly(true);
-	updateCoverPath.addBindValue(coverPath);
-	updateCoverPath.addBindValue(artistNorm);
-	updateCoverPath.addBindValue(albumNorm);
-	updateCoverPath.exec();
-}
-
-QString SqlDatabase::normalizeField(const QString &s) const
-{
-	static QRegularExpression regExp("[^\\w]");
+	// Marks which are left by the decomposition of accented letters are removed, letters and digits of every script are kept
+	static QRegularExpression regExp("[^\\p{L}\\p{N}_]", QRegularExpression::UseUnicodePropertiesOption);
 	QString sNormed = s.toLower().normalized(QString::NormalizationForm_KD).remove(regExp).trimmed();
 	if (sNormed.isEmpty()) {
 		return s.toLower().remove(" ").trimmed();
@@ -618,63 +1875,141 @@ QString SqlDatabase::normalizeField(const QString &s) const
 	}
 }
 
+/** Bytes which sort like the text they come from, ignoring case, accents and punctuation. Compared with memcmp(). */
+QByteArray SqlDatabase::sortKey(const QString &s)
+{
+	// Normalized text is folded to lower case and decomposed: the order of its code points, which is also the order of its
+	// UTF-8 bytes, is the order of the locale for latin scripts. QCollatorSortKey can't be stored, its bytes are hidden
+	return normalizeField(s).toUtf8();
+}
+
+/** Statement prepared once on the connection of this thread. Call finish() once results have been read. */
+QSqlQuery SqlDatabase::cachedQuery(const QString &sql)
+{
+	return SqlConnectionPool::statement(sql, _mode);
+}
+
 void SqlDatabase::setPragmas()
 {
-	this->exec("PRAGMA journal_mode = OFF");
-	this->exec("PRAGMA synchronous = OFF");
-	this->exec("PRAGMA temp_store = 2");
-	this->exec("PRAGMA foreign_keys = 1");
-	this->exec("PRAGMA count_changes = OFF");
+	SqlConnectionPool::setPragmas(*this, _mode);
 }
 
-/** Reads a file from the filesystem and adds it into the library. */
-void SqlDatabase::saveFileRef(const QString &absFilePath)
+/** Reads tags of a local file into a record. Doesn't need a connection, so it can be called from any thread. */
+bool SqlDatabase::readFileRef(const QString &absFilePath, TrackRecord &record)
 {
-	FileHelper fh(absFilePath);
+	FileHelper fh(absFilePath, FileHelper::RO_BoundedRead);
 	if (!fh.isValid()) {
 		qDebug() << Q_FUNC_INFO << "file is not valid, won't be saved:" << absFilePath;
-		return;
+		return false;
 	}
 
-	QSqlQuery insertTrack(*this);
-	insertTrack.setForwardOnly(true);
-	insertTrack.prepare("INSERT INTO cache (uri, trackNumber, trackTitle, artist, artistNormalized, album, albumNormalized, " \
-						"albumYear, artistAlbum, trackLength, disc, internalCover, rating) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
-
-	QString tn = fh.trackNumber();
-	QString title = fh.title();
-	QString artistAlbum = fh.artistAlbum().isEmpty() ? fh.artist() : fh.artistAlbum();
+	FileHelper::Snapshot tags = fh.snapshot();
+	QString artistAlbum = tags.artistAlbum.isEmpty() ? tags.artist : tags.artistAlbum;
 
+	record.uri = absFilePath;
+	record.trackNumber = tags.trackNumber;
+	record.title = tags.title.isEmpty() ? fh.fileInfo().baseName() : tags.title;
+	record.sortKey = sortKey(record.title);
+	record.artist = tags.artist;
+	record.album = tags.album;
+	record.year = tags.year;
 	// Use Artist Album to reference tracks in table "tracks", not Artist
-	QString artistNorm = this->normalizeField(artistAlbum);
-	QString album = fh.album();
-	QString albumNorm = this->normalizeField(album);
-	QString length = fh.length();
-	int dn = fh.discNumber();
-
-	insertTrack.addBindValue(absFilePath);
-	insertTrack.addBindValue(tn.toInt());
-	if (title.isEmpty()) {
-		insertTrack.addBindValue(fh.fileInfo().baseName());
-	} else {
-		insertTrack.addBindValue(title);
-	}
-	insertTrack.addBindValue(fh.artist());
-	insertTrack.addBindValue(artistNorm);
-	insertTrack.addBindValue(fh.album());
-	insertTrack.addBindValue(albumNorm);
-	insertTrack.addBindValue(fh.year());
-	insertTrack.addBindValue(artistAlbum);
-	insertTrack.addBindValue(length);
-	insertTrack.addBindValue(dn);
-	if (fh.hasCover()) {
-		insertTrack.addBindValue(absFilePath);
-	} else {
-		insertTrack.addBindValue(QVariant());
+	record.artistAlbum = artistAlbum;
+	record.artistNormalized = normalizeField(artistAlbum);
+	record.albumNormalized = normalizeField(record.album);
+	record.length = QString::number(tags.length);
+	record.disc = tags.disc;
+	record.hasInternalCover = tags.hasCover;
+	record.rating = tags.rating;
+	record.fingerprint = FileFingerprint::fromFileInfo(fh.fileInfo());
+	record.bytesRead = fh.bytesRead();
+	return true;
+}
+
+/** Adds a record into the library, or replaces the track which has the same uri. Its id and its folder are kept. */
+bool SqlDatabase::saveTrackRecord(const TrackRecord &record)
+{
+	int albumArtistId = this->insertIntoTableArtists(record.artistAlbum, record.artistNormalized, record.icon, record.host);
+	int albumId = this->insertIntoTableAlbums(albumArtistId, record.album, record.albumNormalized, record.year);
+	int artistId = albumArtistId;
+	if (record.artist != record.artistAlbum) {
+		artistId = this->insertIntoTableArtists(record.artist, this->normalizeField(record.artist), record.icon, record.host);
+	}
+	if (albumArtistId == 0 || albumId == 0 || artistId == 0) {
+		return false;
+	}
+
+	// A record can replace an existing one when a file has changed since last scan. Its id and its folder are kept
+	QSqlQuery updateTrack = this->cachedQuery("UPDATE tracks SET albumId = ?, artistId = ?, title = ?, trackNumber = ?, disc = ?, " \
+											  "length = ?, rating = ?, internalCover = ?, host = ?, icon = ?, mtime = ?, fileSize = ?, inode = ?, sortKey = ? WHERE uri = ?");
+	updateTrack.addBindValue(albumId);
+	updateTrack.addBindValue(artistId);
+	updateTrack.addBindValue(record.title);
+	updateTrack.addBindValue(record.trackNumber);
+	updateTrack.addBindValue(record.disc);
+	updateTrack.addBindValue(record.length.toInt());
+	updateTrack.addBindValue(record.rating);
+	updateTrack.addBindValue(record.hasInternalCover);
+	updateTrack.addBindValue(record.host);
+	updateTrack.addBindValue(record.icon);
+	updateTrack.addBindValue(record.fingerprint.mtime);
+	updateTrack.addBindValue(record.fingerprint.size);
+	updateTrack.addBindValue(record.fingerprint.inode);
+	updateTrack.addBindValue(record.sortKey);
+	updateTrack.addBindValue(record.uri);
+	bool b = updateTrack.exec();
+	bool isUpdated = b && updateTrack.numRowsAffected() > 0;
+	updateTrack.finish();
+	if (isUpdated) {
+		return true;
 	}
-	insertTrack.addBindValue(fh.rating());
 
-	if (!insertTrack.exec()) {
+	QSqlQuery insertTrack = this->cachedQuery("INSERT INTO tracks (uri, albumId, artistId, title, trackNumber, disc, length, rating, " \
+											  "internalCover, host, icon, mtime, fileSize, inode, sortKey) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	insertTrack.addBindValue(record.uri);
+	insertTrack.addBindValue(albumId);
+	insertTrack.addBindValue(artistId);
+	insertTrack.addBindValue(record.title);
+	insertTrack.addBindValue(record.trackNumber);
+	insertTrack.addBindValue(record.disc);
+	insertTrack.addBindValue(record.length.toInt());
+	insertTrack.addBindValue(record.rating);
+	insertTrack.addBindValue(record.hasInternalCover);
+	insertTrack.addBindValue(record.host);
+	insertTrack.addBindValue(record.icon);
+	insertTrack.addBindValue(record.fingerprint.mtime);
+	insertTrack.addBindValue(record.fingerprint.size);
+	insertTrack.addBindValue(record.fingerprint.inode);
+	insertTrack.addBindValue(record.sortKey);
+
+	b = insertTrack.exec();
+	if (!b) {
 		qDebug() << Q_FUNC_INFO << insertTrack.lastError();
 	}
+	insertTrack.finish();
+	return b;
+}
+
+/**
+ * Every file found before this folder in a location has been committed. A null folder means nothing has, the location
+ * itself means everything has. Called in the same transaction as the tracks.
+ */
+void SqlDatabase::saveScanCheckpoint(const QString &location, const QString &folder)
+{
+	QSqlQuery saveCheckpoint = this->cachedQuery("INSERT OR REPLACE INTO scanCheckpoints (location, folder) VALUES (?, ?)");
+	saveCheckpoint.addBindValue(location);
+	saveCheckpoint.addBindValue(folder);
+	if (!saveCheckpoint.exec()) {
+		qDebug() << Q_FUNC_INFO << saveCheckpoint.lastError();
+	}
+	saveCheckpoint.finish();
+}
+
+/** Reads a file from the filesystem and adds it into the library. */
+void SqlDatabase::saveFileRef(const QString &absFilePath)
+{
+	TrackRecord record;
+	if (readFileRef(absFilePath, record) && this->saveTrackRecord(record)) {
+		this->bumpLibraryGeneration();
+	}
 }
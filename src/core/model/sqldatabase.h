@@ -3,7 +3,9 @@
 
 #include "../miamcore_global.h"
 #include "settings.h"
+#include "sqlconnectionpool.h"
 #include "trackdao.h"
+#include "trackrecord.h"
 #include "playlistdao.h"
 
 #include <QFileInfo>
@@ -11,72 +13,246 @@
 #include <QSqlTableModel>
 #include <QThread>
 #include <QUrl>
+#include <QVector>
 
 /// Forward declarations
 class Cover;
 class FileHelper;
 
+/**
+ * \brief		The UpsertStatistics struct tells how a batch of tracks was written, for logs of remote plugins.
+ * \details		Durations are in ms. Writing covers artists, albums and tracks, committing is the time spent to make the
+ *				transaction durable.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+struct MIAMCORE_LIBRARY UpsertStatistics
+{
+	int trackCount;
+	int failedCount;
+	qint64 writeTime;
+	qint64 commitTime;
+
+	UpsertStatistics()
+		: trackCount(0)
+		, failedCount(0)
+		, writeTime(0)
+		, commitTime(0)
+	{}
+};
+
 /**
  * \brief		The SqlDatabase class uses SQLite to store few but useful tables for tracks, playlists, etc.
+ * \details		Instances are cheap and can be built on the fly: they share the connection of their thread, which is
+ *				provided by SqlConnectionPool.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMCORE_LIBRARY SqlDatabase : public QObject, public QSqlDatabase
 {
 	Q_OBJECT
+public:
+	enum CheckpointMode {
+		CM_Passive	= 0,
+		CM_Truncate	= 1
+	};
+
 private:
 	QHash<uint, GenericDAO*> _cache;
+	SqlConnectionPool::AccessMode _mode;
 
 public:
 	explicit SqlDatabase(QObject *parent = nullptr);
 
+	/** Read-only instances can't modify the library, they are meant for background workers. */
+	explicit SqlDatabase(SqlConnectionPool::AccessMode mode, QObject *parent = nullptr);
+
 	~SqlDatabase();
 
+	/** Connections are opened by the pool. Reopening one would drop its pragmas and its prepared statements. */
+	bool open();
+
+	/** Write transactions take the lock of the library when they start, not on their first write. */
+	bool transaction();
+
+	/**
+	 * Copies commits from the write-ahead log back into the library. A passive checkpoint doesn't wait for readers, it
+	 * stops at the oldest snapshot still in use. A truncating one waits for them, then empties the log.
+	 */
+	bool checkpoint(CheckpointMode mode = CM_Passive);
+
+	/** When disabled, the log is only copied back by explicit checkpoints. */
+	void setAutoCheckpoint(bool enabled);
+
 	void reset();
 
+	/**
+	 * Snapshots of the library are stale once this counter has changed. Called once by each transaction which modifies
+	 * artists, albums or tracks, before it's committed, instead of once per row.
+	 */
+	bool bumpLibraryGeneration();
+
+	/**
+	 * Id of an album of an artist. The album is added to the library if it's new. Otherwise, its year and the case of its
+	 * name are the ones of the last track which was saved, like when they were stored with each track. 0 if it couldn't
+	 * be written: the transaction should be rolled back.
+	 */
+	int insertIntoTableAlbums(int artistId, const QString &name, const QString &normalizedName, const QString &year = QString());
+
+	/**
+	 * Id of an artist. The artist is added to the library if it's new. Otherwise, its name is the one of the last track which
+	 * was saved. 0 if it couldn't be written: the transaction should be rolled back.
+	 */
+	int insertIntoTableArtists(const QString &name, const QString &normalizedName, const QString &icon = QString(), const QString &host = QString());
+
+	/**
+	 * Random id for a new playlist, which can be known before the playlist is written. Ids of saved playlists, and the ones
+	 * which were given before in this session, are never drawn again.
+	 */
+	uint generatePlaylistId();
+
+	/** Saves a playlist with its tracks in one transaction. 0 if nothing could be saved. */
 	uint insertIntoTablePlaylists(const PlaylistDAO &playlist, const QStringList &tracks, bool isOverwriting);
+	/** Saves tracks of a playlist. When overwriting, only tracks which were inserted, removed or moved since last save are written. */
 	bool insertIntoTablePlaylistTracks(uint playlistId, const QStringList &tracks, bool isOverwriting = false);
 	bool insertIntoTableTracks(const TrackDAO &track);
 	bool insertIntoTableTracks(const std::list<TrackDAO> &tracks);
 
+	/**
+	 * Adds tracks, or replaces the ones which already have the same uri, in a single transaction. Statements are
+	 * prepared once for the whole batch. If a transaction is already running, it's left to the caller to commit.
+	 */
+	UpsertStatistics upsertTracks(const QVector<TrackRecord> &records);
+
 	void removeCoverForAlbum(bool internalCover, const QString &artistNorm, const QString &albumNorm);
 	bool removePlaylist(uint playlistId);
 	void removePlaylistsFromHost(const QString &host);
 	void removeRecordsFromHost(const QString &host);
 
+	/** Removes local tracks which couldn't be found anymore on the filesystem. A path can also be a folder. */
+	void removeRecords(const QStringList &paths);
+
+	/** Removes folders, albums and artists which don't have any track anymore. True if an album or an artist was removed. */
+	bool removeOrphans();
+
+	/** Forgets the position of the last scan, once it has reached the end of every location. */
+	void removeScanCheckpoints();
+
+	/** Updates references to a file, or to every file under a folder, which has been moved or renamed. Tracks at the new path are replaced. */
+	void moveRecords(const QString &oldPath, const QString &newPath);
+
 	Cover *selectCoverFromURI(const QString &uri);
+
+	/** Id of this library and number of changes to its artists, albums and tracks. False if they can't be read. */
+	bool selectLibraryGeneration(qint64 &libraryId, qint64 &generation);
+
+	/** Uris of the track at a path, or of every track under a folder. */
+	QStringList selectTrackUris(const QString &path);
+
+	/** Fingerprints of all local tracks, to find out which files have changed since last scan. */
+	QHash<QString, FileFingerprint> selectFingerprints();
+
+	/** Folders with tracks, and the picture which was chosen for each of them, to save only the ones which have changed. */
+	QHash<QString, QString> selectDirectories();
+
+	/** Number of entries found in each music location during last scan. */
+	QHash<QString, int> selectLocationEntryCounts();
+
+	/** Last folder reached by the walk in each location if last scan was interrupted, an empty list otherwise. */
+	QHash<QString, QString> selectScanCheckpoints();
+
 	QStringList selectPlaylistTracks(uint playlistID, bool withPrefix = true);
 	PlaylistDAO selectPlaylist(uint playlistId);
+
+	/** Playlist which has exactly the same tracks, or an empty one. */
+	PlaylistDAO selectPlaylistByChecksum(const QString &checksum);
+
 	QList<PlaylistDAO> selectPlaylists();
 
 	TrackDAO selectTrackByURI(const QString &uri);
 
+	/** Artists whose name starts with words being typed, best matches first. */
+	QStringList searchArtists(const QString &text, int limit);
+
+	/** Albums whose name starts with words being typed, with their artist, best matches first. */
+	QList<QPair<QString, QString>> searchAlbums(const QString &text, int limit);
+
+	/** Tracks whose title, artist or album starts with words being typed, best matches first. */
+	std::list<TrackDAO> searchTracks(const QString &text, int limit);
+
 	bool playlistHasBackgroundImage(uint playlistID);
+	/** False if the playlist hasn't been saved yet. */
 	bool updateTablePlaylist(const PlaylistDAO &playlist);
 	void updateTablePlaylistWithBackgroundImage(uint playlistID, const QString &backgroundImagePath);
-	void updateTableAlbumWithCoverImage(const QString &coverPath, const QString &album, const QString &artist);
+	/** Replaces counts stored by previous scan. Locations which aren't in the list are forgotten. */
+	void updateLocationEntryCounts(const QHash<QString, int> &entryCounts);
+
+	bool updateTableAlbumWithCoverImage(const QString &coverPath, const QString &album, const QString &artist);
 
 	/** Update a list of tracks. If track name has changed, it will be removed from Library then added right after. */
 	void updateTracks(const QStringList &oldPaths, const QStringList &newPaths);
 
-	QString normalizeField(const QString &s) const;
+	static QString normalizeField(const QString &s);
+
+	/** Bytes which sort like the text they come from, ignoring case, accents and punctuation. Compared with memcmp(). */
+	static QByteArray sortKey(const QString &s);
+
+	/** Reads tags of a local file into a record. Doesn't need a connection, so it can be called from any thread. */
+	static bool readFileRef(const QString &absFilePath, TrackRecord &record);
+
+	/** Adds a record into the library, or replaces the track which has the same uri. Its id and its folder are kept. */
+	bool saveTrackRecord(const TrackRecord &record);
+
+	/** Links tracks of a folder to this folder, and their albums to the picture which was chosen as their cover. */
+	void saveDirectory(const QString &path, const QString &coverPath);
+
+	/**
+	 * Every file found before this folder in a location has been committed. A null folder means nothing has, the location
+	 * itself means everything has. Called in the same transaction as the tracks.
+	 */
+	void saveScanCheckpoint(const QString &location, const QString &folder);
 
 private:
 	void init();
 
+	/** Statement prepared once on the connection of this thread. Call finish() once results have been read. */
+	QSqlQuery cachedQuery(const QString &sql);
+
 	void setPragmas();
 
-	void updateTrack(const QString &absFilePath);
+	/** Creates tables in a new file, or upgrades the ones which were created by previous versions of the player. */
+	void createSchema();
 
-public slots:
-	/** Reads an external picture which is close to multimedia files (same folder). */
-	void saveCoverRef(const QString &coverPath, const QString &track);
+	/** Artists, albums and tracks, with integer keys and typed columns. */
+	void createLibraryTables();
+
+	/** Counter increased each time artists, albums or tracks are modified, to know if a snapshot is still fresh. */
+	void createLibraryGeneration();
+
+	/** Ordered tracks of saved playlists. A track can be in many playlists, or many times in the same one. */
+	void createPlaylistTracksTable();
 
+	/** Full-text index of artists, albums and tracks, kept up to date by triggers. Built once if the library has none. */
+	void createSearchIndex();
+
+	/** Names of artists and albums are copied in rows of the index which refer to them: they follow when a tag edit changes their case. */
+	void createSearchUpdateTriggers();
+
+	/** Alter tables created by previous versions of the player. */
+	void upgradeSchema();
+
+	/** Tags of a file which is already in the library. False if the transaction should be rolled back. */
+	bool updateTrack(const QString &absFilePath);
+
+public slots:
 	/** Reads a file from the filesystem and adds it into the library. */
 	void saveFileRef(const QString &absFilePath);
 
 signals:
 	void aboutToUpdateView();
+
+	/** Tracks which have been modified or moved, by their previous uri and by their current one. */
+	void tracksChanged(const QStringList &removedUris, const QStringList &savedUris);
 };
 
 #endif // SQLDATABASE_H
@@ -0,0 +1,90 @@
+#include "sqlqueryservice.h"
+
+#include <QCoreApplication>
+
+#include <QtDebug>
+
+SqlQueryService* SqlQueryService::_service = nullptr;
+
+SqlQueryService::SqlQueryService(QObject *parent)
+	: QThread(parent)
+	, _sequence(0)
+	, _isStopping(false)
+{
+	this->setObjectName("SqlQueryService");
+}
+
+SqlQueryService::~SqlQueryService()
+{
+	this->stop();
+}
+
+/** Singleton pattern to be able to easily use the service everywhere in the app. */
+SqlQueryService* SqlQueryService::instance()
+{
+	if (_service == nullptr) {
+		_service = new SqlQueryService;
+		// Playlists saved when the main window is closed are still waiting at this moment
+		connect(qApp, &QCoreApplication::aboutToQuit, _service, &SqlQueryService::stop, Qt::DirectConnection);
+		_service->start();
+	}
+	return _service;
+}
+
+/** Runs requests which are still waiting, then finishes the thread. Called when the application quits. */
+void SqlQueryService::stop()
+{
+	QMutexLocker locker(&_mutex);
+	_isStopping = true;
+	_wakeUp.wakeAll();
+	locker.unlock();
+	this->wait();
+}
+
+void SqlQueryService::run()
+{
+	forever {
+		QMutexLocker locker(&_mutex);
+		while (_queue.isEmpty() && !_isStopping) {
+			_wakeUp.wait(&_mutex);
+		}
+		if (_queue.isEmpty()) {
+			break;
+		}
+		QPair<int, quint64> position = _queue.firstKey();
+		Request request = _queue.take(position);
+		// Key may be held by a newer request, which has another type of result
+		auto pending = request.key.isEmpty() ? _pendingKeys.end() : _pendingKeys.find(request.key);
+		if (pending != _pendingKeys.end() && pending.value() == position) {
+			_pendingKeys.erase(pending);
+		}
+		locker.unlock();
+
+		// Instances are cheap: they share the connection of this thread
+		SqlDatabase db(request.mode);
+		request.run(db);
+	}
+}
+
+/** Queues a request, or replaces the one which is waiting with the same key and the same type of result. */
+void SqlQueryService::schedule(Priority priority, const Request &request)
+{
+	if (!request.key.isEmpty()) {
+		auto pending = _pendingKeys.find(request.key);
+		if (pending != _pendingKeys.end() && *_queue.value(pending.value()).resultType == *request.resultType) {
+			// An interactive request can't wait behind background ones because it has been coalesced with one of them
+			QPair<int, quint64> position = pending.value();
+			_queue.remove(position);
+			position.first = qMin(position.first, static_cast<int>(priority));
+			_queue.insert(position, request);
+			pending.value() = position;
+			return;
+		}
+	}
+	QPair<int, quint64> position(priority, _sequence++);
+	_queue.insert(position, request);
+	if (!request.key.isEmpty()) {
+		_pendingKeys.insert(request.key, position);
+	}
+	_wakeUp.wakeOne();
+}
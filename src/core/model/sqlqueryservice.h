@@ -0,0 +1,146 @@
+#ifndef SQLQUERYSERVICE_H
+#define SQLQUERYSERVICE_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <functional>
+#include <memory>
+#include <typeinfo>
+
+#include "sqldatabase.h"
+
+/**
+ * \brief		The SqlQueryService class runs requests to the library on its own thread, so that views never wait for SQL.
+ * \details		Requests are functions which receive a SqlDatabase built in the service thread, and their result is sent
+ *				back in a QFuture. Interactive requests, like a lookup for the title of the window, always go ahead of
+ *				background ones, like saving a playlist. Requests with the same key and the same type of result are
+ *				coalesced: if one is still waiting when another one is sent, only the last function will run, and both
+ *				callers share its result.
+ *				When the application quits, requests still waiting are run before the thread finishes.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMCORE_LIBRARY SqlQueryService : public QThread
+{
+	Q_OBJECT
+public:
+	enum Priority {
+		QP_Interactive	= 0,
+		QP_Background	= 1
+	};
+
+private:
+	struct Request
+	{
+		QString key;
+		SqlConnectionPool::AccessMode mode;
+		std::function<void(SqlDatabase &)> run;
+		std::shared_ptr<QFutureInterfaceBase> future;
+
+		/** Type of the result reported in the future: requests with different types can't share it. */
+		const std::type_info *resultType;
+	};
+
+	/** Ordered by priority first, then by arrival. */
+	QMap<QPair<int, quint64>, Request> _queue;
+	QHash<QString, QPair<int, quint64>> _pendingKeys;
+	quint64 _sequence;
+	bool _isStopping;
+	QMutex _mutex;
+	QWaitCondition _wakeUp;
+
+	static SqlQueryService *_service;
+
+	explicit SqlQueryService(QObject *parent = nullptr);
+
+public:
+	virtual ~SqlQueryService();
+
+	/** Singleton pattern to be able to easily use the service everywhere in the app. */
+	static SqlQueryService *instance();
+
+	/**
+	 * Queues a function which will run in the service thread. An empty key is never coalesced. After the service has
+	 * been stopped, the function runs immediately in the calling thread.
+	 */
+	template<typename T>
+	QFuture<T> submit(Priority priority, const QString &key, SqlConnectionPool::AccessMode mode, std::function<T(SqlDatabase &)> work)
+	{
+		QMutexLocker locker(&_mutex);
+		if (_isStopping) {
+			locker.unlock();
+			QFutureInterface<T> future;
+			future.reportStarted();
+			SqlDatabase db(mode);
+			report(future, work, db);
+			return future.future();
+		}
+
+		std::shared_ptr<QFutureInterface<T>> future;
+		auto pending = key.isEmpty() ? _pendingKeys.constEnd() : _pendingKeys.constFind(key);
+		if (pending != _pendingKeys.constEnd() && *_queue.value(pending.value()).resultType == typeid(T)) {
+			future = std::static_pointer_cast<QFutureInterface<T>>(_queue.value(pending.value()).future);
+		} else {
+			future = std::make_shared<QFutureInterface<T>>();
+			future->reportStarted();
+		}
+		Request request;
+		request.key = key;
+		request.mode = mode;
+		request.run = [future, work](SqlDatabase &db) {
+			report(*future, work, db);
+		};
+		request.future = future;
+		request.resultType = &typeid(T);
+		this->schedule(priority, request);
+		return future->future();
+	}
+
+	/**
+	 * Calls back a function in the thread of the context when the result is ready. Nothing is called if the context has
+	 * been deleted, or if the future was canceled without a result.
+	 */
+	template<typename T>
+	static void whenReady(const QFuture<T> &future, QObject *context, std::function<void(const T &)> callback)
+	{
+		QFutureWatcher<T> *watcher = new QFutureWatcher<T>(context);
+		connect(watcher, &QFutureWatcherBase::finished, context, [watcher, callback]() {
+			if (!watcher->isCanceled() && watcher->future().resultCount() > 0) {
+				callback(watcher->result());
+			}
+			watcher->deleteLater();
+		});
+		watcher->setFuture(future);
+	}
+
+	/** Runs requests which are still waiting, then finishes the thread. Called when the application quits. */
+	void stop();
+
+protected:
+	virtual void run() override;
+
+private:
+	/** Queues a request, or replaces the one which is waiting with the same key and the same type of result. */
+	void schedule(Priority priority, const Request &request);
+
+	template<typename T>
+	static void report(QFutureInterface<T> &future, const std::function<T(SqlDatabase &)> &work, SqlDatabase &db)
+	{
+		future.reportResult(work(db));
+		future.reportFinished();
+	}
+
+	static void report(QFutureInterface<void> &future, const std::function<void(SqlDatabase &)> &work, SqlDatabase &db)
+	{
+		work(db);
+		future.reportFinished();
+	}
+};
+
+#endif // SQLQUERYSERVICE_H
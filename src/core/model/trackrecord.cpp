@@ -0,0 +1,26 @@
+#include "trackrecord.h"
+
+#include <QDateTime>
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+/** Builds a fingerprint from a single call to stat(). Inode is always 0 on platforms which don't have one. */
+FileFingerprint FileFingerprint::fromFileInfo(const QFileInfo &fileInfo)
+{
+	FileFingerprint fingerprint;
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if (::stat(QFile::encodeName(fileInfo.absoluteFilePath()).constData(), &st) == 0) {
+		fingerprint.mtime = st.st_mtime;
+		fingerprint.size = st.st_size;
+		fingerprint.inode = st.st_ino;
+	}
+#else
+	fingerprint.mtime = fileInfo.lastModified().toTime_t();
+	fingerprint.size = fileInfo.size();
+#endif
+	return fingerprint;
+}
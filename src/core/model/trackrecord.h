@@ -0,0 +1,84 @@
+#ifndef TRACKRECORD_H
+#define TRACKRECORD_H
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QString>
+
+#include "../miamcore_global.h"
+
+/**
+ * \brief		The FileFingerprint struct is a cheap identity of a file on disk.
+ * \details		If modification time, size and inode are the same as the ones stored in the library, tags are not read again
+ *				when one is rescanning music locations.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+struct MIAMCORE_LIBRARY FileFingerprint
+{
+	qint64 mtime;
+	qint64 size;
+	quint64 inode;
+
+	FileFingerprint()
+		: mtime(0)
+		, size(0)
+		, inode(0)
+	{}
+
+	/** Builds a fingerprint from a single call to stat(). Inode is always 0 on platforms which don't have one. */
+	static FileFingerprint fromFileInfo(const QFileInfo &fileInfo);
+
+	inline bool operator==(const FileFingerprint &other) const
+	{
+		return mtime == other.mtime && size == other.size && inode == other.inode;
+	}
+
+	inline bool operator!=(const FileFingerprint &other) const { return !(*this == other); }
+};
+
+Q_DECLARE_TYPEINFO(FileFingerprint, Q_PRIMITIVE_TYPE);
+
+/**
+ * \brief		The TrackRecord struct is a plain copy of the fields stored for a track in the library.
+ * \details		Unlike TrackDAO, it is not a QObject: records can be filled in worker threads, passed between stages of
+ *				the scan pipeline and written in batches by a single connection. Remote tracks have a host and an icon,
+ *				and no fingerprint.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+struct TrackRecord
+{
+	QString uri;
+	QString title;
+	QByteArray sortKey;
+	QString artist;
+	QString artistNormalized;
+	QString album;
+	QString albumNormalized;
+	QString artistAlbum;
+	QString year;
+	QString length;
+	int trackNumber;
+	int disc;
+	int rating;
+	bool hasInternalCover;
+	QString host;
+	QString icon;
+	FileFingerprint fingerprint;
+
+	/** Not stored: bytes fetched from the device to read tags, for statistics. */
+	qint64 bytesRead;
+
+	TrackRecord()
+		: trackNumber(0)
+		, disc(0)
+		, rating(-1)
+		, hasInternalCover(false)
+		, bytesRead(0)
+	{}
+};
+
+Q_DECLARE_TYPEINFO(TrackRecord, Q_MOVABLE_TYPE);
+
+#endif // TRACKRECORD_H
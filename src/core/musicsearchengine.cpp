@@ -1,32 +1,60 @@
 #include "musicsearchengine.h"
+#include "boundedfilestream.h"
+#include "boundedqueue.h"
+#include "cover.h"
 #include "filehelper.h"
+#include "librarywatcher.h"
 #include "settingsprivate.h"
 #include "model/sqldatabase.h"
 
-#include <QDateTime>
+#include <QAtomicInt>
 #include <QDirIterator>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
 #include <QThread>
+#include <QThreadPool>
+#include <QVector>
 
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QSqlRecord>
 
 #include <QtDebug>
 
-bool MusicSearchEngine::isScanning = false;
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/sysmacros.h>
+#endif
+
+QAtomicInt MusicSearchEngine::isScanning(0);
+
+/** Number of tracks inserted between two commits while scanning. */
+static const int scanBatchSize = 500;
+
+/** Minimum delay (in ms) between two notifications of progress while scanning. */
+static const int progressInterval = 250;
+
+/** Maximum delay (in ms) between two checkpoints while scanning, even if there are only a few tracks to insert. */
+static const int checkpointInterval = 5000;
+
+/** Delay (in ms) between two comparisons of music locations with the library, when the filesystem can't notify changes. */
+static const int pollingInterval = 60000;
+
+/** Delay (in ms) before checking again if the library is still being written, when a scan has to wait for it. */
+static const int scanRetryDelay = 2000;
 
 MusicSearchEngine::MusicSearchEngine(QObject *parent)
 	: QObject(parent)
 	, _timer(new QTimer(this))
+	, _watcher(nullptr)
 {
-	//_timer->setInterval(5000);
-	//connect(_timer, &QTimer::timeout, this, &MusicSearchEngine::watchForChanges);
-
-	// Monitor filesystem
-	if (SettingsPrivate::instance()->isFileSystemMonitored()) {
-		setWatchForChanges(true);
-	}
+	_timer->setInterval(pollingInterval);
+	connect(_timer, &QTimer::timeout, this, &MusicSearchEngine::pollChanges);
 }
 
 MusicSearchEngine::~MusicSearchEngine()
@@ -39,180 +67,769 @@ MusicSearchEngine::~MusicSearchEngine()
 
 void MusicSearchEngine::setWatchForChanges(bool b)
 {
+	if (!LibraryWatcher::isAvailable()) {
+		if (b) {
+			_timer->start();
+		} else {
+			_timer->stop();
+		}
+		return;
+	}
+
 	if (b) {
-		_timer->start();
-	} else {
-		_timer->stop();
+		// Watches are created in the current thread, which is also the one receiving events
+		if (!_watcher) {
+			_watcher = new LibraryWatcher(this);
+			connect(_watcher, &LibraryWatcher::changesDetected, this, &MusicSearchEngine::updateLibrary);
+			// Queued, so the watcher isn't reset while it's still reading its events
+			connect(_watcher, &LibraryWatcher::overflow, this, &MusicSearchEngine::rescanAfterOverflow, Qt::QueuedConnection);
+		}
+		_watcher->watch(SettingsPrivate::instance()->musicLocations());
+	} else if (_watcher) {
+		_watcher->deleteLater();
+		_watcher = nullptr;
+	}
+}
+
+/** Remaining time of a scan, like "4:07", or "1:05:00" beyond an hour. */
+QString MusicSearchEngine::remainingTimeText(int seconds)
+{
+	// Large libraries on spinning disks can take hours: QTime would wrap after a day
+	seconds = qMax(0, seconds);
+	int hours = seconds / 3600;
+	int minutes = seconds / 60 % 60;
+	if (hours > 0) {
+		return QString("%1:%2:%3").arg(hours).arg(minutes, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+	}
+	return QString("%1:%2").arg(minutes).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+/** Identifier of the device which holds a file, or 0 if it's unknown. */
+static quint64 deviceOf(const QString &path)
+{
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if (::stat(QFile::encodeName(path).constData(), &st) == 0) {
+		return st.st_dev;
+	}
+#else
+	Q_UNUSED(path)
+#endif
+	return 0;
+}
+
+/** True for spinning disks, where seeking is much more expensive than reading. */
+static bool isRotational(quint64 device)
+{
+#ifdef Q_OS_LINUX
+	// Partitions don't have their own queue, it belongs to the parent disk
+	QString block = QString("/sys/dev/block/%1:%2").arg(major(device)).arg(minor(device));
+	for (QString queue : { block + "/queue/rotational", block + "/../queue/rotational" }) {
+		QFile rotational(queue);
+		if (rotational.open(QIODevice::ReadOnly)) {
+			return rotational.readAll().trimmed() == "1";
+		}
+	}
+#else
+	Q_UNUSED(device)
+#endif
+	return false;
+}
+
+/** Best picture found in a folder so far. */
+struct DirectoryArtwork
+{
+	QString cover;
+	qint64 coverRank;
+	bool hasAudioFiles;
+	/** New or modified files have to be linked to their folder. */
+	bool hasChangedFiles;
+
+	DirectoryArtwork() : coverRank(-1), hasAudioFiles(false), hasChangedFiles(false) {}
+};
+
+/** A file sent to readers, with its position in the walk of its device. */
+struct ScanItem
+{
+	QString path;
+	int device;
+	int sequence;
+
+	ScanItem() : device(0), sequence(0) {}
+	ScanItem(const QString &p, int d, int s) : path(p), device(d), sequence(s) {}
+};
+
+/** Tags read by a reader. Files which couldn't be read are sent as well, so that checkpoints can move forward. */
+struct ScanResult
+{
+	TrackRecord record;
+	bool isValid;
+	int device;
+	int sequence;
+
+	ScanResult() : isValid(false), device(0), sequence(0) {}
+};
+
+/** Once files sent before this sequence are committed, files found before this folder of the location are in the library. */
+struct ScanCheckpoint
+{
+	int sequence;
+	QString location;
+	QString folder;
+};
+
+/**
+ * \brief		The ScanContext struct holds everything which is shared by the stages of a scan.
+ * \details		Each device has its own walker and there can be several of them running at the same time, hence the mutex
+ *				for containers. Counters are atomic and can be read by the writer at any time.
+ */
+struct ScanContext
+{
+	QMutex mutex;
+	QHash<QString, FileFingerprint> knownFiles;
+	/** Folders saved by previous scans, and their picture. */
+	QHash<QString, QString> knownDirectories;
+	/** Folders with at least one audio file which are new, or have new files or another picture, and their best picture. */
+	QList<QPair<QString, QString>> directories;
+	QHash<QString, int> previousEntryCounts;
+	QHash<QString, int> entryCounts;
+
+	/** Folder where an interrupted scan has stopped in each location. Empty if previous scan has completed. */
+	QHash<QString, QString> resumeFolders;
+
+	/** Checkpoints of each device, in the order of the walk. They are saved by the writer once their files are committed. */
+	QVector<QList<ScanCheckpoint>> checkpoints;
+
+	QAtomicInt currentEntry;
+	QAtomicInt estimatedEntryCount;
+	QAtomicInt activeReaders;
+
+	/** Started with the scan, stages measure their durations with it. */
+	QElapsedTimer timer;
+	/** When the last walker has finished, in ms. */
+	qint64 walkTime;
+	/** Time spent by all readers to parse tags, in ns. */
+	QAtomicInteger<qint64> readTime;
+
+	ScanContext() : walkTime(0) {}
+};
+
+/**
+ * \brief		The DirectoryWalker class is the first stage of the scan pipeline.
+ * \details		It walks music locations of one device, sends new or modified audio files to readers and chooses the best
+ *				picture of each folder, without reading any tag. Files found on disk are removed from the list of known fingerprints: when the walk is
+ *				over, what remains in this list are tracks which have been deleted since last scan.
+ *				Files are sent one folder at a time. On spinning disks they are sorted by inode, which is close to the order
+ *				of their blocks, and the kernel is asked to prefetch regions with tags a few files ahead of readers.
+ *				A checkpoint is added each time a folder begins, with the path of this folder. When an interrupted scan is
+ *				resumed, folders found before the checkpoint of their location are saved again, since their files may have been
+ *				committed without them. Files are still compared with their fingerprints: the order of the walk can change
+ *				between two scans.
+ */
+class DirectoryWalker : public QRunnable
+{
+private:
+	QList<QDir> _locations;
+	BoundedQueue<ScanItem> *_paths;
+	ScanContext *_context;
+	bool _sortByInode;
+	int _device;
+
+	/** Number of files sent to readers so far. */
+	int _sequence;
+
+	/** Number of files which are prefetched ahead of the one being sent to readers. */
+	static const int prefetchDistance = 32;
+
+public:
+	DirectoryWalker(const QList<QDir> &locations, BoundedQueue<ScanItem> *paths, ScanContext *context, bool sortByInode, int device)
+		: QRunnable()
+		, _locations(locations)
+		, _paths(paths)
+		, _context(context)
+		, _sortByInode(sortByInode)
+		, _device(device)
+		, _sequence(0)
+	{}
+
+	virtual void run() override
+	{
+		// Changed files of the current folder, with their inode
+		QList<QPair<quint64, QString>> pendingFiles;
+
+		for (QDir location : _locations) {
+			QString locationPath = location.absolutePath();
+			int entryCount = 0;
+			// Location itself is never walked: if it's the checkpoint, every folder is before it
+			QString resumeFolder = _context->resumeFolders.value(locationPath);
+			bool isCommitted = !resumeFolder.isEmpty();
+
+			// Files of a folder can be listed before and after its subfolders, so folders are resolved at the end
+			QHash<QString, DirectoryArtwork> artworks;
+
+			QDirIterator it(locationPath, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+			while (it.hasNext()) {
+				QString entry = it.next();
+				QFileInfo qFileInfo(entry);
+				_context->currentEntry.ref();
+				entryCount++;
+
+				if (qFileInfo.isDir()) {
+					isCommitted = isCommitted && entry != resumeFolder;
+					this->sendFiles(pendingFiles);
+					this->addCheckpoint(locationPath, entry);
+					continue;
+				} else if (FileHelper::isLibraryFile(qFileInfo)) {
+					QString absFilePath = qFileInfo.absoluteFilePath();
+					FileFingerprint known;
+					bool isKnown = this->takeKnownFile(absFilePath, known);
+					DirectoryArtwork &artwork = artworks[qFileInfo.absolutePath()];
+					artwork.hasAudioFiles = true;
+					// Tags are read again only if the file has changed since last scan. New files need a stat() only for sorting
+					if (isKnown || _sortByInode) {
+						FileFingerprint current = FileFingerprint::fromFileInfo(qFileInfo);
+						if (!isKnown || current != known) {
+							pendingFiles.append(qMakePair(current.inode, absFilePath));
+							artwork.hasChangedFiles = true;
+						} else if (isCommitted) {
+							// Interrupted scan has already saved this file, but its folder may not have been saved
+							artwork.hasChangedFiles = true;
+						}
+					} else {
+						pendingFiles.append(qMakePair(Q_UINT64_C(0), absFilePath));
+						artwork.hasChangedFiles = true;
+					}
+				} else {
+					qint64 rank = Cover::rank(qFileInfo);
+					if (rank >= 0) {
+						DirectoryArtwork &artwork = artworks[qFileInfo.absolutePath()];
+						if (rank > artwork.coverRank) {
+							artwork.coverRank = rank;
+							artwork.cover = qFileInfo.absoluteFilePath();
+						}
+					}
+				}
+			}
+			this->sendFiles(pendingFiles);
+			this->addCheckpoint(locationPath, locationPath);
+			this->addDirectories(artworks);
+
+			// Now that this location is known for sure, estimation for the whole scan can be corrected
+			QMutexLocker locker(&_context->mutex);
+			_context->entryCounts.insert(locationPath, entryCount);
+			_context->estimatedEntryCount.fetchAndAddOrdered(entryCount - _context->previousEntryCounts.value(locationPath));
+		}
+		QMutexLocker locker(&_context->mutex);
+		_context->walkTime = qMax(_context->walkTime, _context->timer.elapsed());
+		locker.unlock();
+		_paths->close();
+	}
+
+private:
+	/** Files which are still in this list after the walk have been removed from the filesystem. */
+	bool takeKnownFile(const QString &absFilePath, FileFingerprint &fingerprint)
+	{
+		QMutexLocker locker(&_context->mutex);
+		auto it = _context->knownFiles.find(absFilePath);
+		if (it == _context->knownFiles.end()) {
+			return false;
+		}
+		fingerprint = it.value();
+		_context->knownFiles.erase(it);
+		return true;
+	}
+
+	/** Files of a location found before this folder are done, once all files sent so far are committed. */
+	void addCheckpoint(const QString &location, const QString &folder)
+	{
+		ScanCheckpoint checkpoint;
+		checkpoint.sequence = _sequence;
+		checkpoint.location = location;
+		checkpoint.folder = folder;
+		QMutexLocker locker(&_context->mutex);
+		_context->checkpoints[_device].append(checkpoint);
+	}
+
+	/**
+	 * Folders without picture, like "CD1" and "CD2", can use the one in their parent folder. Folders which are already
+	 * in the library, with the same files and the same picture, are left as they are.
+	 */
+	void addDirectories(const QHash<QString, DirectoryArtwork> &artworks)
+	{
+		QMutexLocker locker(&_context->mutex);
+		for (auto it = artworks.cbegin(); it != artworks.cend(); ++it) {
+			if (!it.value().hasAudioFiles) {
+				continue;
+			}
+			QString cover = it.value().cover;
+			if (cover.isEmpty()) {
+				cover = artworks.value(QFileInfo(it.key()).absolutePath()).cover;
+			}
+			auto known = _context->knownDirectories.constFind(it.key());
+			if (!it.value().hasChangedFiles && known != _context->knownDirectories.constEnd() && known.value() == cover) {
+				continue;
+			}
+			_context->directories.append(qMakePair(it.key(), cover));
+		}
+	}
+
+	void sendFiles(QList<QPair<quint64, QString>> &files)
+	{
+		if (_sortByInode) {
+			std::sort(files.begin(), files.end());
+		}
+		int prefetched = 0;
+		for (int i = 0; i < files.size(); i++) {
+			for (; prefetched < files.size() && prefetched < i + prefetchDistance; prefetched++) {
+				BoundedFileStream::prefetch(files.at(prefetched).second);
+			}
+			_paths->push(ScanItem(files.at(i).second, _device, _sequence++));
+		}
+		files.clear();
+	}
+};
+
+/**
+ * \brief		The TagReader class is the second stage of the scan pipeline: it parses tags, one file at a time.
+ * \details		Several readers are running concurrently for each device. The last one to finish tells the writer there's
+ *				nothing left.
+ */
+class TagReader : public QRunnable
+{
+private:
+	BoundedQueue<ScanItem> *_paths;
+	BoundedQueue<ScanResult> *_records;
+	ScanContext *_context;
+
+public:
+	TagReader(BoundedQueue<ScanItem> *paths, BoundedQueue<ScanResult> *records, ScanContext *context)
+		: QRunnable()
+		, _paths(paths)
+		, _records(records)
+		, _context(context)
+	{}
+
+	virtual void run() override
+	{
+		ScanItem item;
+		QElapsedTimer timer;
+		while (_paths->pop(item)) {
+			ScanResult result;
+			result.device = item.device;
+			result.sequence = item.sequence;
+			timer.start();
+			result.isValid = SqlDatabase::readFileRef(item.path, result.record);
+			_context->readTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+			_records->push(result);
+		}
+		if (!_context->activeReaders.deref()) {
+			_records->close();
+		}
+	}
+};
+
+/** Saves the last checkpoint reached by each device. Files before a checkpoint must have been added to the current transaction. */
+static void saveCheckpoints(SqlDatabase &db, ScanContext &context, const QVector<int> &nextSequences)
+{
+	// Several checkpoints can be reached at once, only the last one of each location is useful
+	QHash<QString, QString> reachedCheckpoints;
+	{
+		QMutexLocker locker(&context.mutex);
+		for (int device = 0; device < context.checkpoints.size(); device++) {
+			QList<ScanCheckpoint> &checkpoints = context.checkpoints[device];
+			while (!checkpoints.isEmpty() && checkpoints.first().sequence <= nextSequences.at(device)) {
+				ScanCheckpoint checkpoint = checkpoints.takeFirst();
+				reachedCheckpoints.insert(checkpoint.location, checkpoint.folder);
+			}
+		}
+	}
+	for (auto it = reachedCheckpoints.cbegin(); it != reachedCheckpoints.cend(); ++it) {
+		db.saveScanCheckpoint(it.key(), it.value());
 	}
 }
 
 void MusicSearchEngine::doSearch()
+{
+	// Another scan, or changes reported by the filesystem, are being written: this scan starts once they are done
+	if (!MusicSearchEngine::isScanning.testAndSetOrdered(0, 1)) {
+		QTimer::singleShot(scanRetryDelay, this, &MusicSearchEngine::doSearch);
+		return;
+	}
+	this->scan();
+}
+
+/** Walks music locations, once isScanning has been set. */
+void MusicSearchEngine::scan()
 {
 	emit aboutToSearch();
 
-	MusicSearchEngine::isScanning = true;
-	QList<QDir> locations;
+	// Locations on different devices are scanned concurrently
+	QMap<quint64, QList<QDir>> locationsByDevice;
 	//QStringList pathsToSearch = _delta.isEmpty() ? SettingsPrivate::instance()->musicLocations() : _delta;
 	//for (QString musicPath : pathsToSearch) {
 	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
 		QDir location(musicPath);
 		location.setFilter(QDir::AllDirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
-		locations.append(location);
+		locationsByDevice[deviceOf(location.absolutePath())].append(location);
 	}
 
-	int entryCount = 0;
-	// QDirIterator class is very fast to scan large directories
-	for (QDir location : locations) {
-		QDirIterator it(location.absolutePath(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-		while (it.hasNext()) {
-			it.next();
-			entryCount++;
+	SqlDatabase db;
+	ScanContext context;
+
+	// Only files which were added or modified since last scan are read
+	context.knownFiles = db.selectFingerprints();
+	context.knownDirectories = db.selectDirectories();
+
+	// Locations are walked only once: progress is estimated with what was found last time
+	context.previousEntryCounts = db.selectLocationEntryCounts();
+	for (const QList<QDir> &locations : locationsByDevice) {
+		for (QDir location : locations) {
+			context.estimatedEntryCount.fetchAndAddRelaxed(context.previousEntryCounts.value(location.absolutePath()));
 		}
 	}
 
-	int currentEntry = 0;
-	int percent = 1;
-	bool atLeastOneAudioFileWasFound = false;
-	bool isNewDirectory = false;
+	// If previous scan was interrupted, it's resumed from its last checkpoints. Until this one is over, it can be resumed as well
+	context.resumeFolders = db.selectScanCheckpoints();
+	if (!context.resumeFolders.isEmpty()) {
+		qDebug() << Q_FUNC_INFO << "resuming interrupted scan" << context.resumeFolders;
+	}
+	db.transaction();
+	for (const QList<QDir> &locations : locationsByDevice) {
+		for (QDir location : locations) {
+			if (!context.resumeFolders.contains(location.absolutePath())) {
+				db.saveScanCheckpoint(location.absolutePath(), QString());
+			}
+		}
+	}
+	db.commit();
 
-	QString coverPath;
-	QString lastFileScannedNextToCover;
+	// Staged pipeline: for each device, one walker feeds its own pool of readers (parsing tags is CPU bound).
+	// Spinning disks have only a few readers to keep reads in order, others share CPU cores. This thread is the only writer
+	QList<quint64> devices = locationsByDevice.keys();
+	QHash<quint64, bool> rotationalDevices;
+	int solidStateDeviceCount = 0;
+	for (quint64 device : devices) {
+		rotationalDevices.insert(device, isRotational(device));
+		if (!rotationalDevices.value(device)) {
+			solidStateDeviceCount++;
+		}
+	}
+	int idealThreadCount = qMax(1, QThread::idealThreadCount());
+	int readersPerSolidStateDevice = qMax(1, idealThreadCount / qMax(1, solidStateDeviceCount));
 
-	QStringList suffixes = FileHelper::suffixes(FileHelper::ET_Standard | FileHelper::ET_GameMusicEmu);
+	QHash<quint64, int> readerCounts;
+	int readerCount = 0;
+	for (quint64 device : devices) {
+		int readers = rotationalDevices.value(device) ? qMin(2, idealThreadCount) : readersPerSolidStateDevice;
+		readerCounts.insert(device, readers);
+		readerCount += readers;
+	}
+	context.activeReaders.store(readerCount);
 
-	SqlDatabase db;
+	BoundedQueue<ScanResult> records(qMax(1, readerCount) * 64);
+	QList<BoundedQueue<ScanItem>*> pathQueues;
+	context.checkpoints.resize(devices.size());
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(readerCount + devices.size());
+	context.timer.start();
+	for (int i = 0; i < devices.size(); i++) {
+		quint64 device = devices.at(i);
+		BoundedQueue<ScanItem> *paths = new BoundedQueue<ScanItem>(readerCounts.value(device) * 64);
+		pathQueues.append(paths);
+		pool.start(new DirectoryWalker(locationsByDevice.value(device), paths, &context, rotationalDevices.value(device), i));
+		for (int j = 0; j < readerCounts.value(device); j++) {
+			pool.start(new TagReader(paths, &records, &context));
+		}
+	}
+	if (devices.isEmpty()) {
+		records.close();
+	}
+
+	int percent = 0;
+	int remainingTime = -1;
+	int pendingRecords = 0;
+	int recordCount = 0;
+	qint64 bytesRead = 0;
+	QElapsedTimer &elapsed = context.timer;
+	QElapsedTimer writeTimer;
+	qint64 writeTime = 0;
+	qint64 lastProgress = 0;
+	qint64 lastCheckpoint = 0;
+	qint64 lastWalCheckpoint = 0;
+
+	// Readers of a device finish files out of order: every file before nextSequences[device] has been written, files
+	// after it which are already written are kept aside
+	QVector<int> nextSequences(devices.size(), 0);
+	QVector<QSet<int>> writtenSequences(devices.size());
+
+	// Commit in batches so that readers never have to wait for one huge transaction. Each batch carries the position of
+	// the walk, so a crash loses at most what hasn't been committed yet.
+	// Views keep reading their snapshot meanwhile: the log is copied back into the library at a steady pace, by passive
+	// checkpoints which never wait for them
+	auto commitBatch = [&]() {
+		writeTimer.start();
+		saveCheckpoints(db, context, nextSequences);
+		if (pendingRecords > 0) {
+			db.bumpLibraryGeneration();
+		}
+		db.commit();
+		if (elapsed.elapsed() - lastWalCheckpoint >= checkpointInterval) {
+			db.checkpoint();
+			lastWalCheckpoint = elapsed.elapsed();
+		}
+		db.transaction();
+		writeTime += writeTimer.nsecsElapsed();
+		pendingRecords = 0;
+		lastCheckpoint = elapsed.elapsed();
+	};
+
+	db.setAutoCheckpoint(false);
 	db.transaction();
-	for (QDir location : locations) {
-		QDirIterator it(location.absolutePath(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-		while (it.hasNext()) {
-			QString entry = it.next();
-			QFileInfo qFileInfo(entry);
-			currentEntry++;
-
-			// Directory has changed: we can discard cover
-			if (qFileInfo.isDir()) {
-				if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty()) {
-					db.saveCoverRef(coverPath, lastFileScannedNextToCover);
-					coverPath.clear();
-				}
-				isNewDirectory = true;
-				atLeastOneAudioFileWasFound = false;
-				lastFileScannedNextToCover.clear();
-				continue;
-			} else if (qFileInfo.suffix().toLower() == "jpg" || qFileInfo.suffix().toLower() == "png") {
-				if (atLeastOneAudioFileWasFound) {
-					coverPath = qFileInfo.absoluteFilePath();
-					//db.saveCoverRef(coverPath, lastFileScannedNextToCover);
-					//coverPath.clear();
-				} else if (isNewDirectory) {
-					coverPath = qFileInfo.absoluteFilePath();
+	ScanResult result;
+	forever {
+		if (records.tryPop(result, progressInterval)) {
+			if (result.isValid) {
+				writeTimer.start();
+				db.saveTrackRecord(result.record);
+				writeTime += writeTimer.nsecsElapsed();
+				bytesRead += result.record.bytesRead;
+				recordCount++;
+				pendingRecords++;
+			}
+			int &nextSequence = nextSequences[result.device];
+			if (result.sequence == nextSequence) {
+				nextSequence++;
+				while (writtenSequences[result.device].remove(nextSequence)) {
+					nextSequence++;
 				}
-			} else if (suffixes.contains(qFileInfo.suffix())) {
-				db.saveFileRef(qFileInfo.absoluteFilePath());
-				atLeastOneAudioFileWasFound = true;
-				lastFileScannedNextToCover = qFileInfo.absoluteFilePath();
-				isNewDirectory = false;
+			} else {
+				writtenSequences[result.device].insert(result.sequence);
 			}
 
-			if (currentEntry * 100 / entryCount > percent) {
-				percent = currentEntry * 100 / entryCount;
-				emit progressChanged(percent);
-				qApp->processEvents();
+			if (pendingRecords == scanBatchSize) {
+				commitBatch();
 			}
+		} else if (records.isDrained()) {
+			break;
 		}
-		if (!coverPath.isEmpty() && !lastFileScannedNextToCover.isEmpty()) {
-			db.saveCoverRef(coverPath, lastFileScannedNextToCover);
-			coverPath.clear();
-			lastFileScannedNextToCover.clear();
+
+		// Views are notified at a reasonable pace, whatever the number of files
+		if (elapsed.elapsed() - lastProgress < progressInterval) {
+			continue;
 		}
-		atLeastOneAudioFileWasFound = false;
+		lastProgress = elapsed.elapsed();
+
+		// When almost nothing has changed since last scan, the walk still moves forward
+		if (lastProgress - lastCheckpoint >= checkpointInterval) {
+			commitBatch();
+		}
+
+		int current = context.currentEntry.load();
+		int estimate = context.estimatedEntryCount.load();
+		if (current >= estimate) {
+			// New files or new location since last scan: the walk isn't over yet, keep some room for what remains
+			estimate = current + current / 4 + 100;
+		}
+
+		// Progress never goes backward, even if estimation has been corrected
+		int p = qMin(99, current * 100 / qMax(1, estimate));
+		if (p > percent) {
+			percent = p;
+			emit progressChanged(percent);
+		}
+
+		// Remaining time is extrapolated from the speed so far, which is meaningless during the first second
+		if (current > 0 && lastProgress >= 1000) {
+			int t = static_cast<int>((estimate - current) * lastProgress / current / 1000);
+			if (t != remainingTime) {
+				remainingTime = t;
+				emit remainingTimeChanged(remainingTime);
+			}
+		}
+	}
+	writeTimer.start();
+	saveCheckpoints(db, context, nextSequences);
+	if (pendingRecords > 0) {
+		db.bumpLibraryGeneration();
+	}
+	db.commit();
+	writeTime += writeTimer.nsecsElapsed();
+	pool.waitForDone();
+	qDeleteAll(pathQueues);
+
+	qint64 finalizeStart = elapsed.elapsed();
+	db.updateLocationEntryCounts(context.entryCounts);
+	qDebug() << Q_FUNC_INFO << recordCount << "files read in" << elapsed.elapsed() << "ms," << bytesRead << "bytes fetched to parse tags";
+
+	// Remaining files were in the library but haven't been found on the filesystem
+	if (!context.knownFiles.isEmpty()) {
+		db.removeRecords(context.knownFiles.keys());
+	}
+
+	db.transaction();
+	for (const QPair<QString, QString> &directory : context.directories) {
+		db.saveDirectory(directory.first, directory.second);
+	}
+	// Files with new tags can leave empty albums behind
+	if (db.removeOrphans() || !context.directories.isEmpty()) {
+		db.bumpLibraryGeneration();
 	}
 	db.commit();
 
-	db.exec("CREATE INDEX IF NOT EXISTS indexArtist ON cache (artistNormalized)");
-	db.exec("CREATE INDEX IF NOT EXISTS indexAlbum ON cache (albumNormalized)");
-	db.exec("CREATE INDEX IF NOT EXISTS indexPath ON cache (uri)");
+	// Every location has been walked to the end and every change has been saved
+	db.removeScanCheckpoints();
+	db.setAutoCheckpoint(true);
+	db.checkpoint(SqlDatabase::CM_Truncate);
+
+	_statistics.entryCount = context.currentEntry.load();
+	_statistics.fileCount = recordCount;
+	_statistics.bytesRead = bytesRead;
+	_statistics.walkTime = context.walkTime;
+	_statistics.readTime = context.readTime.load() / 1000000;
+	_statistics.writeTime = writeTime / 1000000;
+	_statistics.finalizeTime = elapsed.elapsed() - finalizeStart;
+	_statistics.totalTime = elapsed.elapsed();
 
 	// Resync remote players and remote databases
 	//emit aboutToResyncRemoteSources();
 
-	MusicSearchEngine::isScanning = false;
+	MusicSearchEngine::isScanning.storeRelease(0);
 
 	emit searchHasEnded();
 }
 
+/** Starts to follow changes in music locations, or updates watches after locations have changed. */
 void MusicSearchEngine::watchForChanges()
 {
-	if (isScanning) {
-		qDebug() << Q_FUNC_INFO << "the filesystem is already being analyzed by another process";
+	this->setWatchForChanges(true);
+	if (!LibraryWatcher::isAvailable()) {
+		this->pollChanges();
+	}
+}
+
+/** Compares files in music locations with fingerprints saved by last scan, on platforms where the filesystem can't notify changes. */
+void MusicSearchEngine::pollChanges()
+{
+	if (isScanning.loadAcquire()) {
+		// The scan which is running will find these changes anyway
 		return;
 	}
 
-	// Gather all folders registered on music locations
-	QFileInfoList dirs;
+	SqlDatabase db;
+	QHash<QString, FileFingerprint> knownFiles = db.selectFingerprints();
+	QStringList modified;
 	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
-		QFileInfo location(musicPath);
-		QDirIterator it(location.absoluteFilePath(), QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		QDirIterator it(QDir(musicPath).absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
 		while (it.hasNext()) {
-			QString entry = it.next();
-			QFileInfo qFileInfo(entry);
-			dirs << qFileInfo;
+			it.next();
+			QFileInfo fileInfo = it.fileInfo();
+			if (!FileHelper::isLibraryFile(fileInfo)) {
+				continue;
+			}
+			QString absFilePath = fileInfo.absoluteFilePath();
+			auto known = knownFiles.find(absFilePath);
+			if (known == knownFiles.end()) {
+				modified.append(absFilePath);
+			} else {
+				if (FileFingerprint::fromFileInfo(fileInfo) != known.value()) {
+					modified.append(absFilePath);
+				}
+				knownFiles.erase(known);
+			}
 		}
 	}
 
-	SqlDatabase db;
+	// Remaining files were in the library but haven't been found in music locations
+	QList<QPair<QString, QString>> changes;
+	for (auto it = knownFiles.cbegin(); it != knownFiles.cend(); ++it) {
+		changes.append(qMakePair(it.key(), QString()));
+	}
+	if (!modified.isEmpty() || !changes.isEmpty()) {
+		this->updateLibrary(modified, changes);
+	}
+}
 
-	QStringList newFoldersToAddInLibrary;
-	// Add folders that were not found first
-	for (QFileInfo f : dirs) {
-		QSqlQuery query(db);
-		query.setForwardOnly(true);
-		query.prepare("SELECT * FROM filesystem WHERE path = ?");
-		query.addBindValue(f.absoluteFilePath());
-		if (query.exec() && !query.next()) {
-			newFoldersToAddInLibrary << f.absoluteFilePath();
-			QSqlQuery prepared(db);
-			prepared.setForwardOnly(true);
-			prepared.prepare("INSERT INTO filesystem (path, lastModified) VALUES (?, ?)");
-			prepared.addBindValue(f.absoluteFilePath());
-			prepared.addBindValue(f.lastModified().toTime_t());
-			prepared.exec();
-		}
-	}
-
-	if (!newFoldersToAddInLibrary.isEmpty()) {
-		//_delta = newFoldersToAddInLibrary;
-		this->doSearch();
-	}
-
-	// Process in reverse mode to clean cache: from database file and check if entry exists in database
-	QSqlQuery cache("SELECT * FROM filesystem", db);
-	qDebug() << Q_FUNC_INFO << "SELECT * FROM filesystem";
-	cache.setForwardOnly(true);
-	if (cache.exec()) {
-		QStringList oldLocations;
-		while (cache.next()) {
-			QDir d(cache.record().value(0).toString());
-			d.exists();
-			QFileInfo fileInfo(cache.record().value(0).toString());
-			// Remove folder in database because it couldn't be find in the filesystem
-			if (!fileInfo.exists()) {
-				QSqlQuery deleteFromFilesystem(db);
-				deleteFromFilesystem.prepare("DELETE FROM filesystem WHERE path = ?");
-				deleteFromFilesystem.addBindValue(fileInfo.absoluteFilePath());
-				qDebug() << Q_FUNC_INFO << "DELETE FROM filesystem WHERE path = ?";
-
-				if (deleteFromFilesystem.exec()) {
-					oldLocations << fileInfo.absoluteFilePath();
-				}
+/** Events were lost: locations are scanned again, once the scan which may be running has ended. */
+void MusicSearchEngine::rescanAfterOverflow()
+{
+	// A scan started by the user may have walked past lost events already. Two scans never run at the same time
+	if (!isScanning.testAndSetOrdered(0, 1)) {
+		QTimer::singleShot(scanRetryDelay, this, &MusicSearchEngine::rescanAfterOverflow);
+		return;
+	}
+	this->scan();
+	if (_watcher) {
+		_watcher->watch(SettingsPrivate::instance()->musicLocations());
+	}
+}
+
+/** Applies changes reported by the filesystem, without walking through music locations. */
+void MusicSearchEngine::updateLibrary(const QStringList &modified, const QList<QPair<QString, QString>> &changes)
+{
+	// The scan which is running will find these changes anyway. Otherwise, no scan can start until they are written
+	if (!isScanning.testAndSetOrdered(0, 1)) {
+		return;
+	}
+
+	// Views patch their models with the tracks which have changed: paths of folders are replaced by their tracks
+	SqlDatabase db;
+	QStringList removedUris;
+	QSet<QString> savedUris;
+	db.transaction();
+	for (const QPair<QString, QString> &change : changes) {
+		QStringList uris = db.selectTrackUris(change.first);
+		removedUris.append(uris);
+		if (change.second.isEmpty()) {
+			db.removeRecords({ change.first });
+			for (QString uri : uris) {
+				savedUris.remove(uri);
+			}
+		} else {
+			// Tracks which were at the new path are replaced
+			for (QString uri : db.selectTrackUris(change.second)) {
+				removedUris.append(uri);
+				savedUris.remove(uri);
 			}
+			for (QString uri : uris) {
+				savedUris.remove(uri);
+				savedUris.insert(change.second + uri.mid(change.first.length()));
+			}
+			db.moveRecords(change.first, change.second);
 		}
-		qDebug() << Q_FUNC_INFO << oldLocations;
-		if (!oldLocations.isEmpty()) {
-			//db.rebuildFomLocations(oldLocations, QStringList());
-			//setDelta(oldLocations);
-			//db.exec("DELETE FROM cache");
-			//db.exec("DROP INDEX indexUri");
+	}
+	QSet<QString> directories;
+	for (QString absFilePath : modified) {
+		TrackRecord record;
+		if (SqlDatabase::readFileRef(absFilePath, record)) {
+			db.saveTrackRecord(record);
+			directories.insert(QFileInfo(absFilePath).absolutePath());
+			savedUris.insert(absFilePath);
 		}
 	}
+	// Files with new tags can leave empty albums behind
+	db.removeOrphans();
+
+	// Pictures are resolved like a full scan does, only for folders which have changed
+	QStringList locations;
+	for (QString musicPath : SettingsPrivate::instance()->musicLocations()) {
+		locations.append(QDir(musicPath).absolutePath());
+	}
+	for (QString directory : directories) {
+		QString cover = Cover::bestPictureInDirectory(directory);
+		// Parent folder is used only if it's still in the library
+		if (cover.isEmpty() && !locations.contains(directory)) {
+			cover = Cover::bestPictureInDirectory(QFileInfo(directory).absolutePath());
+		}
+		db.saveDirectory(directory, cover);
+	}
+	if (!changes.isEmpty() || !directories.isEmpty()) {
+		db.bumpLibraryGeneration();
+	}
+	db.commit();
+	isScanning.storeRelease(0);
+
+	if (!removedUris.isEmpty() || !savedUris.isEmpty()) {
+		emit tracksChanged(removedUris, savedUris.toList());
+	}
 }
@@ -1,12 +1,48 @@
 #ifndef MUSICSEARCHENGINE_H
 #define MUSICSEARCHENGINE_H
 
+#include <QAtomicInt>
 #include <QDir>
 #include <QFileInfo>
+#include <QPair>
 #include <QTimer>
 
 #include "miamcore_global.h"
 
+/// Forward declaration
+class LibraryWatcher;
+
+/**
+ * \brief		The ScanStatistics struct sums up what the last scan has done, for logs and benchmarks.
+ * \details		Durations are in ms. Walking lasts until the last walker has finished. Reading is the time spent by all
+ *				readers to parse tags, so it can be longer than the scan itself. Writing is the time spent in the database
+ *				while files were coming, finalizing is everything which is done once they have all been written.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+struct MIAMCORE_LIBRARY ScanStatistics
+{
+	int entryCount;
+	int fileCount;
+	qint64 bytesRead;
+	qint64 walkTime;
+	qint64 readTime;
+	qint64 writeTime;
+	qint64 finalizeTime;
+	qint64 totalTime;
+
+	ScanStatistics()
+		: entryCount(0)
+		, fileCount(0)
+		, bytesRead(0)
+		, walkTime(0)
+		, readTime(0)
+		, writeTime(0)
+		, finalizeTime(0)
+		, totalTime(0)
+	{}
+};
+
 /**
  * \brief		The MusicSearchEngine class
  * \author      Matthieu Bachelier
@@ -17,10 +53,16 @@ class MIAMCORE_LIBRARY MusicSearchEngine : public QObject
 	Q_OBJECT
 private:
 	QTimer *_timer;
+	LibraryWatcher *_watcher;
+	ScanStatistics _statistics;
 	//QStringList _delta;
 
 public:
-	static bool isScanning;
+	/**
+	 * Scans run in their own thread, and the watcher in another one. Set while a scan, or changes reported by the
+	 * watcher, are being written, so that they never run at the same time.
+	 */
+	static QAtomicInt isScanning;
 
 	explicit MusicSearchEngine(QObject *parent = nullptr);
 
@@ -30,17 +72,44 @@ public:
 
 	void setWatchForChanges(bool b);
 
+	/** Figures of the last scan which has completed. */
+	inline const ScanStatistics& statistics() const { return _statistics; }
+
+	/** Remaining time of a scan, like "4:07", or "1:05:00" beyond an hour. */
+	static QString remainingTimeText(int seconds);
+
 public slots:
 	void doSearch();
 
+	/** Starts to follow changes in music locations, or updates watches after locations have changed. */
 	void watchForChanges();
 
+private:
+	/** Walks music locations, once isScanning has been set. */
+	void scan();
+
+private slots:
+	/** Compares files in music locations with fingerprints saved by last scan, on platforms where the filesystem can't notify changes. */
+	void pollChanges();
+
+	/** Events were lost: locations are scanned again, once the scan which may be running has ended. */
+	void rescanAfterOverflow();
+
+	/** Applies changes reported by the filesystem, without walking through music locations. */
+	void updateLibrary(const QStringList &modified, const QList<QPair<QString, QString>> &changes);
+
 signals:
 	void aboutToSearch();
 
 	void progressChanged(int);
 
+	/** Estimation in seconds, based on the number of entries found in locations during previous scan. */
+	void remainingTimeChanged(int);
+
 	void searchHasEnded();
+
+	/** Tracks were updated in the background, by their previous uri and by their current one. Views can patch their models. */
+	void tracksChanged(const QStringList &removedUris, const QStringList &savedUris);
 };
 
 #endif // MUSICSEARCHENGINE_H
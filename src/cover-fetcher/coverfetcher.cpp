@@ -2,6 +2,7 @@
 
 #include <settings.h>
 #include <model/sqldatabase.h>
+#include <model/sqlqueryservice.h>
 #include <filehelper.h>
 #include <cover.h>
 
@@ -66,9 +67,6 @@ void CoverFetcher::fetch(SelectedTracksModel *selectedTracksModel)
 		selectedTracksModel->updateSelectedTracks();
 	});
 
-	SqlDatabase db;
-	db.open();
-
 	// Format and concatenate all tracks in one big string. Replaces single quote with double quote
 	/// FIXME
 	QStringList tracks;
@@ -77,20 +75,40 @@ void CoverFetcher::fetch(SelectedTracksModel *selectedTracksModel)
 	}
 	QString l = tracks.join("\",\"").prepend("\"").append("\"");
 
-	QString strArtistsAlbums = "SELECT artistAlbum, album, cover, internalCover " \
-		"FROM cache WHERE uri IN (" + l + ") GROUP BY artistAlbum, album, cover ORDER BY artistAlbum, album";
-
-	QSqlQuery qArtistsAlbums(db);
-	qArtistsAlbums.exec(strArtistsAlbums);
+	// Albums are read in background, the dialog is filled once they are ready
+	QFuture<QList<QStringList>> albums = SqlQueryService::instance()->submit<QList<QStringList>>(SqlQueryService::QP_Interactive, QString(),
+																								 SqlConnectionPool::AM_ReadOnly, [l](SqlDatabase &db) {
+		QString strArtistsAlbums = "SELECT artistAlbum, album, cover, internalCover " \
+			"FROM cache WHERE uri IN (" + l + ") GROUP BY artistAlbum, album, cover ORDER BY artistAlbum, album";
+
+		QList<QStringList> rows;
+		QSqlQuery qArtistsAlbums(db);
+		qArtistsAlbums.setForwardOnly(true);
+		if (qArtistsAlbums.exec(strArtistsAlbums)) {
+			while (qArtistsAlbums.next()) {
+				QSqlRecord r = qArtistsAlbums.record();
+				rows.append({ r.value(0).toString(), r.value(1).toString(), r.value(2).toString(), r.value(3).toString() });
+			}
+		}
+		qArtistsAlbums.finish();
+		return rows;
+	});
+	SqlQueryService::whenReady<QList<QStringList>>(albums, fetchDialog, [this, fetchDialog] (const QList<QStringList> &rows) {
+		this->populate(fetchDialog, rows);
+	});
+}
 
+/** Adds a cover and a query to each provider for every album. */
+void CoverFetcher::populate(FetchDialog *fetchDialog, const QList<QStringList> &albums)
+{
 	QString prevArtist = "";
 	int size = Settings::instance()->value("providers/coverValueSize").toInt();
 	QSize s(size, size);
-	while (qArtistsAlbums.next()) {
-		QString artistAlbum = qArtistsAlbums.record().value(0).toString();
-		QString album = qArtistsAlbums.record().value(1).toString();
-		QString cover = qArtistsAlbums.record().value(2).toString();
-		QString internalCover = qArtistsAlbums.record().value(3).toString();
+	for (const QStringList &row : albums) {
+		QString artistAlbum = row.at(0);
+		QString album = row.at(1);
+		QString cover = row.at(2);
+		QString internalCover = row.at(3);
 
 		// Send a new request for fetching artists only if it's a new one
 		if (artistAlbum != prevArtist) {
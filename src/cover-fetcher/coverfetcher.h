@@ -6,6 +6,9 @@
 #include "providers/coverartprovider.h"
 #include "miamcoverfetcher_global.hpp"
 
+/// Forward declaration
+class FetchDialog;
+
 /**
  * \brief       Fetch covers using MusicBrainz.
  * \author      Matthieu Bachelier
@@ -29,6 +32,9 @@ public:
 	void fetch(SelectedTracksModel *selectedTracksModel);
 
 private:
+	/** Adds a cover and a query to each provider for every album. */
+	void populate(FetchDialog *fetchDialog, const QList<QStringList> &albums);
+
 	/** When one is checking items in the list, providers are added or removed dynamically. */
 	void manageProvider(bool enabled, QCheckBox *checkBox);
 };
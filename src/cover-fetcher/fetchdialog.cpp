@@ -81,12 +81,7 @@ bool FetchDialog::copyCoverToFolder(Cover *cover, QString artistAlbum, QString a
 			p.loadFromData(cover->byteArray(), cover->format());
 			b = p.save(absCover);
 
-			QSqlQuery updateTracks(db);
-			updateTracks.prepare("UPDATE cache SET cover = ? WHERE artistAlbum = ? AND album = ?");
-			updateTracks.addBindValue(absCover);
-			updateTracks.addBindValue(artistAlbum);
-			updateTracks.addBindValue(album);
-			b = updateTracks.exec();
+			b = db.updateTableAlbumWithCoverImage(absCover, album, artistAlbum);
 		}
 		return b;
 	} else {
@@ -112,8 +107,7 @@ bool FetchDialog::integrateCoverToFile(Cover *cover, QString artistAlbum, QStrin
 		if (fh.save()) {
 			// Cover has been successfully integrated into file
 			QSqlQuery updateTrack(db);
-			updateTrack.prepare("UPDATE cache SET internalCover = ? WHERE uri = ?");
-			updateTrack.addBindValue(fh.fileInfo().absoluteFilePath());
+			updateTrack.prepare("UPDATE tracks SET internalCover = 1 WHERE uri = ?");
 			updateTrack.addBindValue(fh.fileInfo().absoluteFilePath());
 			b = b & updateTrack.exec();
 		} else {
@@ -121,6 +115,7 @@ bool FetchDialog::integrateCoverToFile(Cover *cover, QString artistAlbum, QStrin
 		}
 	}
 	if (b) {
+		db.bumpLibraryGeneration();
 		db.commit();
 	} else {
 		db.rollback();
@@ -14,6 +14,8 @@ SOURCES += albumitem.cpp \
     libraryitemmodel.cpp \
     libraryorderdialog.cpp \
     libraryscrollbar.cpp \
+    librarysearchindex.cpp \
+    librarytree.cpp \
     librarytreeview.cpp \
     miamitemdelegate.cpp \
     miamitemmodel.cpp \
@@ -31,6 +33,8 @@ HEADERS += albumitem.h \
     libraryitemmodel.h \
     libraryorderdialog.h \
     libraryscrollbar.h \
+    librarysearchindex.h \
+    librarytree.h \
     librarytreeview.h \
     miamitemdelegate.h \
     miamitemmodel.h \
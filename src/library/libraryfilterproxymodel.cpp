@@ -1,6 +1,7 @@
 #include "libraryfilterproxymodel.h"
 
 #include <settingsprivate.h>
+#include "libraryitemmodel.h"
 
 #include <QtDebug>
 
@@ -20,33 +21,25 @@ QVariant LibraryFilterProxyModel::data(const QModelIndex &index, int role) const
 
 bool LibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
-	if (filterAcceptsRowItself(sourceRow, sourceParent)) {
+	if (_filter.isEmpty()) {
 		return true;
 	}
 
-	// Accept if any of the parents is accepted on it's own merits
-	QModelIndex parent = sourceParent;
-	while (parent.isValid()) {
-		if (filterAcceptsRowItself(parent.row(), parent.parent())) {
-			return true;
-		}
-		parent = parent.parent();
-	}
-
-	// Accept if any of the children is accepted on it's own merits
-	if (hasAcceptedChildren(sourceRow, sourceParent)) {
-		return true;
+	LibraryItemModel *model = static_cast<LibraryItemModel*>(sourceModel());
+	QStandardItem *item = model->itemFromIndex(model->index(sourceRow, 0, sourceParent));
+	if (!item) {
+		return false;
 	}
 
 	// Accept separators if any top level items and its children are accepted
-	QStandardItemModel *model = qobject_cast<QStandardItemModel*>(sourceModel());
-	QStandardItem *item = model->itemFromIndex(model->index(sourceRow, 0, sourceParent));
-	if (item && item->type() == Miam::IT_Separator) {
-		for (QModelIndex index : _topLevelItems.values(static_cast<SeparatorItem*>(item))) {
-			if (filterAcceptsRow(index.row(), sourceParent)) {
+	if (item->type() == Miam::IT_Separator) {
+		for (QModelIndex index : model->topLevelItems().values(static_cast<SeparatorItem*>(item))) {
+			if (model->tree()->isAccepted(model->itemFromIndex(index), _filter)) {
 				return true;
 			}
 		}
+	} else if (model->tree()->isAccepted(item, _filter)) {
+		return true;
 	}
 	return (SettingsPrivate::instance()->librarySearchMode() == SettingsPrivate::LSM_HighlightOnly);
 }
@@ -165,32 +158,9 @@ bool LibraryFilterProxyModel::lessThan(const QModelIndex &idxLeft, const QModelI
 	return result;
 }
 
-bool LibraryFilterProxyModel::filterAcceptsRowItself(int sourceRow, const QModelIndex &sourceParent) const
-{
-	return MiamSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent);
-}
-
-bool LibraryFilterProxyModel::hasAcceptedChildren(int sourceRow, const QModelIndex &sourceParent) const
+/** Redefined to keep the text which was typed. */
+void LibraryFilterProxyModel::filterLibrary(const QString &filter)
 {
-	QModelIndex item = sourceModel()->index(sourceRow, 0, sourceParent);
-	if (!item.isValid()) {
-		return false;
-	}
-
-	// Check if there are children
-	int childCount = item.model()->rowCount(item);
-	if (childCount == 0) {
-		return false;
-	}
-
-	for (int i = 0; i < childCount; ++i) {
-		if (filterAcceptsRowItself(i, item)) {
-			return true;
-		}
-		// Recursive call
-		if (hasAcceptedChildren(i, item)) {
-			return true;
-		}
-	}
-	return false;
+	_filter = filter;
+	MiamSortFilterProxyModel::filterLibrary(filter);
 }
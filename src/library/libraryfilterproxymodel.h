@@ -10,14 +10,19 @@
 
 /**
  * \brief		The LibraryFilterProxyModel class is used to filter Library by looking in all items
- * \details		When filtering, the method filterAcceptsRow will not stop if a search term was not found in a node. The algorithm
- *				will continue recursively until all subnodes and leaves are evaluated.
+ * \details		When filtering, a node is kept if it contains the search term, if one of its parents does, or one of its
+ *				children, even if this child hasn't been fetched yet. The search index of LibraryItemModel computes all of
+ *				this once for each term, so that each row is a single lookup.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMLIBRARY_LIBRARY LibraryFilterProxyModel : public MiamSortFilterProxyModel
 {
 	Q_OBJECT
+private:
+	/** Text which was typed, before it was turned into a regular expression. */
+	QString _filter;
+
 public:
 	explicit LibraryFilterProxyModel(QObject *parent = nullptr);
 
@@ -31,9 +36,8 @@ protected:
 	/** Redefined for custom sorting. */
 	virtual bool lessThan(const QModelIndex &idxLeft, const QModelIndex &idxRight) const override;
 
-private:
-	bool filterAcceptsRowItself(int sourceRow, const QModelIndex &sourceParent) const;
-	bool hasAcceptedChildren(int sourceRow, const QModelIndex &sourceParent) const;
+	/** Redefined to keep the text which was typed. */
+	virtual void filterLibrary(const QString &filter) override;
 };
 
 #endif // LIBRARYFILTERPROXYMODEL_H
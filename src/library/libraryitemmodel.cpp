@@ -1,7 +1,9 @@
 #include "libraryitemmodel.h"
 
 #include <settingsprivate.h>
+#include <model/librarysnapshot.h>
 #include <model/sqldatabase.h>
+#include <model/sqlqueryservice.h>
 #include "albumitem.h"
 #include "artistitem.h"
 #include "trackitem.h"
@@ -9,15 +11,13 @@
 
 #include <functional>
 
-#include <QRegularExpression>
-#include <QSqlQuery>
-#include <QSqlRecord>
-
 #include <QtDebug>
 
 LibraryItemModel::LibraryItemModel(QObject *parent)
 	: MiamItemModel(parent)
 	, _proxy(new LibraryFilterProxyModel(this))
+	, _isFirstLoad(true)
+	, _tree(createTree())
 {
 	setColumnCount(1);
 	_proxy->setSourceModel(this);
@@ -25,264 +25,258 @@ LibraryItemModel::LibraryItemModel(QObject *parent)
 }
 
 LibraryItemModel::~LibraryItemModel()
-{}
+{
+	qDeleteAll(_patches);
+}
 
-/** Read all tracks entries in the database and send them to connected views. */
+/**
+ * Read all tracks entries in the database and send them to connected views. Nodes are built in background, and current
+ * ones stay in the model until new ones are ready. A build which is still running is cancelled.
+ */
 void LibraryItemModel::load(const QString &)
 {
+	auto build = this->startBuild();
+	std::shared_ptr<LibraryTree> tree = createTree();
+
+	// Requests with the same key are coalesced: if a previous build is still waiting, it will never start
+	bool trustSnapshot = _isFirstLoad;
+	auto service = SqlQueryService::instance();
+	QFuture<bool> isBuilt = service->submit<bool>(SqlQueryService::QP_Interactive, "libraryModel", SqlConnectionPool::AM_ReadOnly,
+												  [tree, build, trustSnapshot](SqlDatabase &db) {
+		return tree->build(db, trustSnapshot, *build);
+	});
+	SqlQueryService::whenReady<bool>(isBuilt, this, [this, tree, build](const bool &isTreeBuilt) {
+		// A coalesced request shares its result with the one which replaced it: only the last tree is used
+		if (!this->finishBuild(build)) {
+			return;
+		}
+		if (isTreeBuilt) {
+			this->attachTree(tree);
+		}
+		emit loaded();
+	});
+}
+
+/** Empty tree for current hierarchy. Settings are read once, not for each track, and not from another thread. */
+std::shared_ptr<LibraryTree> LibraryItemModel::createTree()
+{
+	auto s = SettingsPrivate::instance();
+	QStringList articleFilters;
+	if (s->isLibraryFilteredByArticles() && !s->libraryFilteredByArticles().isEmpty()) {
+		articleFilters = s->libraryFilteredByArticles();
+	}
+	return std::make_shared<LibraryTree>(s->insertPolicy(), articleFilters);
+}
+
+/** Replaces every node with the ones of a tree which has been built in background. */
+void LibraryItemModel::attachTree(const std::shared_ptr<LibraryTree> &tree)
+{
+	// Items have been deleted by reset(): none of them refers to the previous snapshot anymore
 	this->reset();
+	_tree = tree;
+	_tree->attach(invisibleRootItem());
+	_letters.swap(_tree->_letters);
+	QMultiHashIterator<SeparatorItem*, QStandardItem*> it(_tree->_topLevelItems);
+	while (it.hasNext()) {
+		it.next();
+		_topLevelItems.insert(it.key(), it.value()->index());
+	}
+	_tree->_topLevelItems.clear();
 
-	SqlDatabase db;
+	if (_isFirstLoad && _tree->isTrusted()) {
+		this->verifySnapshot(_tree->snapshot().libraryId(), _tree->snapshot().generation());
+	}
+	_isFirstLoad = false;
+}
 
-	QSqlQuery q("SELECT uri, trackNumber, trackTitle, artist, artistNormalized, album, albumNormalized, artistAlbum, " \
-				"albumYear, trackLength, rating, disc, internalCover, cover, host, icon FROM cache ORDER BY uri, internalCover", db);
-	q.setForwardOnly(true);
-	if (!q.exec()) {
+/**
+ * Replaces tracks which have been modified in the library, and removes the ones which have been deleted. Only their
+ * nodes are touched: other artists and albums keep their rows, so views keep what is expanded and where they are.
+ */
+void LibraryItemModel::updateTracks(const QStringList &removedUris, const QStringList &savedUris)
+{
+	// Too many tracks to read with a single statement: the whole library is read once instead. A build which is still
+	// running may have read tracks before they were saved: it's started again
+	if (_isFirstLoad || _build || savedUris.size() > LibrarySnapshot::maxTracksPerRead) {
+		this->load();
 		return;
 	}
-	const int uri = 0, trackNumber = 1, trackTitle = 2, artist = 3, artistNorm = 4, album = 5, albumNorm = 6, artistAlbum = 7,
-			year = 8, trackLength = 9, rating = 10, disc = 11, internalCover = 12, cover = 13, host = 14, icon = 15;
-
-	// Lambda function to reduce duplicate code which is relevant in this method only
-	auto loadTrack = [=] (QSqlRecord& r) -> TrackItem* {
-		TrackItem *trackItem = new TrackItem;
-		trackItem->setText(r.value(trackTitle).toString());
-		trackItem->setData(r.value(uri).toString(), Miam::DF_URI);
-		trackItem->setData(r.value(trackNumber).toString(), Miam::DF_TrackNumber);
-		trackItem->setData(r.value(disc).toString(), Miam::DF_DiscNumber);
-		trackItem->setData(r.value(trackLength).toUInt(), Miam::DF_TrackLength);
-		if (r.value(rating).toInt() != -1) {
-			trackItem->setData(r.value(rating).toInt(), Miam::DF_Rating);
-		}
-		trackItem->setData(r.value(artist).toString(), Miam::DF_Artist);
-		trackItem->setData(r.value(album).toString(), Miam::DF_Album);
-		trackItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-		return trackItem;
-	};
 
-	auto s = SettingsPrivate::instance();
-	switch (s->insertPolicy()) {
-	case SettingsPrivate::IP_Artists: {
-		QStringList filters;
-		if (s->isLibraryFilteredByArticles() && !s->libraryFilteredByArticles().isEmpty()) {
-			filters = s->libraryFilteredByArticles();
+	// New versions are inserted before old ones are removed, so that an album which is edited is never empty. Removing a
+	// node can remove its parent too: persistent indexes tell which ones are already gone
+	QList<QPersistentModelIndex> oldItems;
+	for (QString uri : removedUris + savedUris) {
+		if (QStandardItem *item = this->takeTrackItem(uri)) {
+			oldItems.append(QPersistentModelIndex(item->index()));
 		}
+	}
 
-		QHash<uint, ArtistItem*> _artists;
-		QHash<uint, AlbumItem*> _albums;
-
-		while (q.next()) {
-			QSqlRecord r = q.record();
-
-			ArtistItem *artistItem = new ArtistItem;
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
-			QString artist = r.value(3).toString();
-			QString aa = r.value(artistAlbum).toString();
-			artistItem->setText(aa);
-			for (QString filter : filters) {
-				if (artist.startsWith(filter + " ", Qt::CaseInsensitive)) {
-					artist = artist.mid(filter.length() + 1);
-					artistItem->setData(artist + ", " + filter, Miam::DF_CustomDisplayText);
-					break;
-				}
-			}
-
-			if (artistNormalized.isEmpty() || !artistNormalized.contains(QRegularExpression("[\\w]"))) {
-				artistItem->setData("0", Miam::DF_NormalizedString);
-			} else {
-				artistItem->setData(artistNormalized, Miam::DF_NormalizedString);
-			}
-
-			// Add artist
-			if (_artists.contains(artistItem->hash())) {
-				//qDebug() << "hash found:" << artistItem->hash() << "for" << artistItem->text() ;
-				auto it = _artists.find(artistItem->hash());
-				delete artistItem;
-				artistItem = (*it);
-			} else {
-				_artists.insert(artistItem->hash(), artistItem);
-				invisibleRootItem()->appendRow(artistItem);
-
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(artistItem)) {
-					_topLevelItems.insert(separator, artistItem->index());
-				}
-			}
-
-			AlbumItem *albumItem = new AlbumItem;
-			if (r.value(albumNorm).toString().isEmpty() || !r.value(albumNorm).toString().contains(QRegularExpression("[\\w]"))) {
-				albumItem->setData("0", Miam::DF_NormalizedString);
-			} else {
-				albumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormalizedString);
-			}
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-
-			QString internalCoverPath = r.value(internalCover).toString();
-			QString coverPath = r.value(cover).toString();
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = *it;
-				if (albumItem->data(Miam::DF_InternalCover).toString().isEmpty() && !internalCoverPath.isEmpty()) {
-					albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
-				}
-				if (albumItem->data(Miam::DF_CoverPath).toString().isEmpty() && !coverPath.isEmpty()) {
-					albumItem->setData(coverPath, Miam::DF_CoverPath);
-				}
-			} else {
+	if (!savedUris.isEmpty()) {
+		SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
+		LibrarySnapshot *patch = new LibrarySnapshot;
+		if (!patch->read(db, savedUris)) {
+			delete patch;
+			this->load();
+			return;
+		}
+		_patches.append(patch);
+		QVector<LibraryTree::AlbumRecord> albums = LibraryTree::albumRecords(*patch);
+		for (quint32 i = 0; i < patch->trackCount(); i++) {
+			QStandardItem *parent = _tree->insertNodes(*patch, i, albums.at(patch->track(i).album));
+			TrackItem *trackItem = new TrackItem(patch, i);
+			parent->appendRow(trackItem);
+			_tree->addTrack(*patch, i, trackItem);
+			_patchedItems.insert(patch->text(patch->track(i).uri), trackItem);
+		}
+	}
 
-				albumItem->setText(r.value(album).toString());
-				albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
-				albumItem->setData(coverPath, Miam::DF_CoverPath);
-				albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-				albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
+	for (const QPersistentModelIndex &index : oldItems) {
+		if (index.isValid()) {
+			this->removeNode(itemFromIndex(index));
+		}
+	}
+	this->updateSeparators();
+}
 
-				_albums.insert(albumItem->hash(), albumItem);
-				artistItem->appendRow(albumItem);
+/** Finds the item of a track by its uri, and forgets it. */
+QStandardItem *LibraryItemModel::takeTrackItem(const QString &uri)
+{
+	auto patched = _patchedItems.find(uri);
+	if (patched != _patchedItems.end()) {
+		QStandardItem *item = patched.value();
+		_patchedItems.erase(patched);
+		return item;
+	}
+	int index = _tree->_snapshot.findTrack(uri);
+	if (index < 0 || index >= _tree->_snapshotItems.size()) {
+		return nullptr;
+	}
+	QStandardItem *item = _tree->_snapshotItems.at(index);
+	_tree->_snapshotItems[index] = nullptr;
+	if (item && item->type() != Miam::IT_Track) {
+		// Track hasn't been fetched yet: its album only has to forget it
+		_tree->removeTrackEntry(index);
+		auto pending = _tree->_pendingTracks.find(item);
+		if (pending != _tree->_pendingTracks.end()) {
+			pending.value().removeOne(index);
+			if (pending.value().isEmpty()) {
+				_tree->_pendingTracks.erase(pending);
 			}
-
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
 		}
-		break;
 	}
-	case SettingsPrivate::IP_Albums: {
-
-		QHash<uint, AlbumItem*> _albums;
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
-
-			AlbumItem *albumItem = new AlbumItem;
-			albumItem->setText(r.value(album).toString());
-			if (r.value(albumNorm).toString().isEmpty() || !r.value(albumNorm).toString().contains(QRegularExpression("[\\w]"))) {
-				albumItem->setData("0", Miam::DF_NormalizedString);
-			} else {
-				albumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormalizedString);
-			}
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			if (!r.value(internalCover).toString().isEmpty()) {
-				albumItem->setData(r.value(internalCover).toString(), Miam::DF_InternalCover);
-			}
-			albumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = (*it);
-			} else {
-				_albums.insert(albumItem->hash(), albumItem);
-				invisibleRootItem()->appendRow(albumItem);
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
-					_topLevelItems.insert(separator, albumItem->index());
-				}
-			}
+	return item;
+}
 
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
+/** Removes an item, then its parents which don't have any track left. */
+void LibraryItemModel::removeNode(QStandardItem *item)
+{
+	while (item && (item->type() == Miam::IT_Track || (!item->hasChildren() && !_tree->_pendingTracks.contains(item)))) {
+		QStandardItem *parent = item->parent() ? item->parent() : invisibleRootItem();
+		switch (item->type()) {
+		case Miam::IT_Artist:
+			_tree->_artists.remove(static_cast<ArtistItem*>(item)->hash());
+			break;
+		case Miam::IT_Album:
+			_tree->_albums.remove(static_cast<AlbumItem*>(item)->hash());
+			break;
+		case Miam::IT_Year:
+			_tree->_years.remove(static_cast<YearItem*>(item)->hash());
+			break;
 		}
-		break;
+		_tree->removeEntry(item);
+		parent->removeRow(item->row());
+		item = (parent == invisibleRootItem()) ? nullptr : parent;
 	}
-	case SettingsPrivate::IP_ArtistsAlbums: {
-		QHash<uint, AlbumItem*> _albums;
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			QString artistNormalized = r.value(artistNorm).toString();
-			QString albumNormalized = r.value(albumNorm).toString();
-
-			AlbumItem *albumItem = new AlbumItem;
-			albumItem->setText(r.value(artist).toString() + " – " + r.value(album).toString());
-			albumItem->setData(artistNormalized + "|" + albumNormalized, Miam::DF_NormalizedString);
-			albumItem->setData(artistNormalized, Miam::DF_NormArtist);
-			albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
-			albumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			albumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			albumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			albumItem->setData(!r.value(host).toString().isEmpty(), Miam::DF_IsRemote);
-
-			// Add album
-			if (_albums.contains(albumItem->hash())) {
-				auto it = _albums.find(albumItem->hash());
-				delete albumItem;
-				albumItem = *it;
-			} else {
-				_albums.insert(albumItem->hash(), albumItem);
-				invisibleRootItem()->appendRow(albumItem);
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(albumItem)) {
-					_topLevelItems.insert(separator, albumItem->index());
-				}
+}
+
+/** Adds separators for new top level items, and removes the ones which don't have any item left. */
+void LibraryItemModel::updateSeparators()
+{
+	QSet<SeparatorItem*> separators;
+	for (int row = 0; row < rowCount(); row++) {
+		QStandardItem *item = this->item(row);
+		if (item->type() != Miam::IT_Separator) {
+			if (SeparatorItem *separator = this->insertSeparator(item)) {
+				separators.insert(separator);
 			}
+		}
+	}
 
-			// Add tracks
-			albumItem->appendRow(loadTrack(r));
+	QMutableHashIterator<QString, SeparatorItem*> it(_letters);
+	while (it.hasNext()) {
+		it.next();
+		if (!separators.contains(it.value())) {
+			removeRow(it.value()->row());
+			it.remove();
 		}
-		break;
 	}
-	case SettingsPrivate::IP_Years: {
-
-		QHash<uint, YearItem*> _years;
-		QHash<uint, AlbumItem*> _artistAlbums;
-
-		while (q.next()) {
-			QSqlRecord r = q.record();
-			YearItem *yearItem = new YearItem(r.value(year).toString());
-
-			// Add year
-			if (_years.contains(yearItem->hash())) {
-				auto it = _years.find(yearItem->hash());
-				delete yearItem;
-				yearItem = (*it);
-			} else {
-				_years.insert(yearItem->hash(), yearItem);
-				invisibleRootItem()->appendRow(yearItem);
-
-				// Also check if newly inserted artist needs to insert a separator
-				if (SeparatorItem *separator = this->insertSeparator(yearItem)) {
-					_topLevelItems.insert(separator, yearItem->index());
-				}
-			}
 
-			// Add Artist - Album
-			AlbumItem *artistAlbumItem = new AlbumItem;
-			artistAlbumItem->setText(r.value(3).toString() + " – " + r.value(album).toString());
-			artistAlbumItem->setData(r.value(artistNorm).toString() + "|" + r.value(albumNorm).toString(), Miam::DF_NormalizedString);
-			artistAlbumItem->setData(r.value(artistNorm).toString(), Miam::DF_NormArtist);
-			artistAlbumItem->setData(r.value(albumNorm).toString(), Miam::DF_NormAlbum);
-			artistAlbumItem->setData(r.value(year).toString(), Miam::DF_Year);
-			artistAlbumItem->setData(r.value(cover).toString(), Miam::DF_CoverPath);
-			artistAlbumItem->setData(r.value(icon).toString(), Miam::DF_IconPath);
-			artistAlbumItem->setData(!r.value(14).toString().isEmpty(), Miam::DF_IsRemote);
-
-			if (_artistAlbums.contains(artistAlbumItem->hash())) {
-				auto it = _artistAlbums.find(artistAlbumItem->hash());
-				delete artistAlbumItem;
-				artistAlbumItem = *it;
-			} else {
-				_artistAlbums.insert(artistAlbumItem->hash(), artistAlbumItem);
-				yearItem->appendRow(artistAlbumItem);
+	// Indexes of top level items have moved if a row was removed before them
+	_topLevelItems.clear();
+	for (int row = 0; row < rowCount(); row++) {
+		QStandardItem *item = this->item(row);
+		if (item->type() != Miam::IT_Separator) {
+			if (SeparatorItem *separator = this->insertSeparator(item)) {
+				_topLevelItems.insert(separator, item->index());
 			}
+		}
+	}
+}
 
-			// Add tracks
-			artistAlbumItem->appendRow(loadTrack(r));
+/** Reloads the library if it has changed since the snapshot shown at startup was written. */
+void LibraryItemModel::verifySnapshot(qint64 libraryId, qint64 generation)
+{
+	auto service = SqlQueryService::instance();
+	QFuture<bool> isFresh = service->submit<bool>(SqlQueryService::QP_Background, "librarySnapshot", SqlConnectionPool::AM_ReadOnly,
+												  [libraryId, generation](SqlDatabase &db) {
+		qint64 currentId = 0, currentGeneration = 0;
+		return db.selectLibraryGeneration(currentId, currentGeneration) && currentId == libraryId && currentGeneration == generation;
+	});
+	SqlQueryService::whenReady<bool>(isFresh, this, [this](const bool &fresh) {
+		if (!fresh) {
+			this->load();
 		}
-		break;
+	});
+}
+
+/** Redefined: albums have tracks before they are fetched. */
+bool LibraryItemModel::hasChildren(const QModelIndex &parent) const
+{
+	return this->canFetchMore(parent) || MiamItemModel::hasChildren(parent);
+}
+
+bool LibraryItemModel::canFetchMore(const QModelIndex &parent) const
+{
+	QStandardItem *item = itemFromIndex(parent);
+	return item && _tree->_pendingTracks.contains(item);
+}
+
+/** Builds tracks of an album when it's expanded, or when its tracks are sent somewhere. */
+void LibraryItemModel::fetchMore(const QModelIndex &parent)
+{
+	QStandardItem *item = itemFromIndex(parent);
+	if (!item) {
+		return;
 	}
+	QVector<quint32> pending = _tree->_pendingTracks.take(item);
+	QList<QStandardItem*> tracks;
+	tracks.reserve(pending.size());
+	for (quint32 i : pending) {
+		TrackItem *trackItem = new TrackItem(&_tree->_snapshot, i);
+		_tree->_snapshotItems[i] = trackItem;
+		tracks.append(trackItem);
 	}
+	if (!tracks.isEmpty()) {
+		item->appendRows(tracks);
+	}
+}
 
-	this->sort(0);
+/** Builds every track which is still waiting, before the whole library is searched. */
+void LibraryItemModel::fetchAll()
+{
+	for (QStandardItem *item : _tree->_pendingTracks.keys()) {
+		this->fetchMore(item->index());
+	}
 }
 
 /** For every item in the library, gets the top level letter attached to it. */
@@ -333,6 +327,7 @@ void LibraryItemModel::rebuildSeparators()
 				item->setData(QString(), Miam::DF_CustomDisplayText);
 				// Recompute standard normalized name: "The Artist" -> "theartist"
 				item->setData(db.normalizeField(item->text()), Miam::DF_NormalizedString);
+				item->setData(db.sortKey(item->text()), Miam::DF_SortKey);
 			} else if (!filters.isEmpty()) {
 				for (QString filter : filters) {
 					QString text = item->text();
@@ -340,6 +335,7 @@ void LibraryItemModel::rebuildSeparators()
 						text = text.mid(filter.length() + 1);
 						item->setData(text + ", " + filter, Miam::DF_CustomDisplayText);
 						item->setData(db.normalizeField(text), Miam::DF_NormalizedString);
+						item->setData(db.sortKey(text), Miam::DF_SortKey);
 						break;
 					}
 				}
@@ -380,6 +376,11 @@ void LibraryItemModel::rebuildSeparators()
 void LibraryItemModel::reset()
 {
 	this->deleteCache();
+	_tree = createTree();
+	_patchedItems.clear();
+	qDeleteAll(_patches);
+	_patches.clear();
+
 	switch (SettingsPrivate::instance()->insertPolicy()) {
 	case SettingsPrivate::IP_Artists:
 		horizontalHeaderItem(0)->setText(tr("  Artists \\ Albums"));
@@ -3,7 +3,10 @@
 
 #include <QSet>
 #include <model/genericdao.h>
+#include <model/librarysnapshot.h>
 #include <filehelper.h>
+#include <settingsprivate.h>
+#include "librarytree.h"
 #include "miamitemmodel.h"
 #include "separatoritem.h"
 #include "miamlibrary_global.hpp"
@@ -21,11 +24,32 @@ class MIAMLIBRARY_LIBRARY LibraryItemModel : public MiamItemModel
 private:
 	LibraryFilterProxyModel *_proxy;
 
+	/** The first load trusts the snapshot of the previous session, and checks it afterwards. */
+	bool _isFirstLoad;
+
+	/** Nodes of the model, and the snapshot their tracks are read from. It's kept until the next load. */
+	std::shared_ptr<LibraryTree> _tree;
+
+	/** Tracks which have been updated since last load, with the small snapshots they were read from. */
+	QHash<QString, QStandardItem*> _patchedItems;
+	QList<LibrarySnapshot*> _patches;
+
 public:
 	explicit LibraryItemModel(QObject *parent = nullptr);
 
 	virtual ~LibraryItemModel();
 
+	/** Redefined: albums have tracks before they are fetched. */
+	virtual bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+
+	virtual bool canFetchMore(const QModelIndex &parent) const override;
+
+	/** Builds tracks of an album when it's expanded, or when its tracks are sent somewhere. */
+	virtual void fetchMore(const QModelIndex &parent) override;
+
+	/** Builds every track which is still waiting, before the whole library is searched. */
+	void fetchAll();
+
 	virtual QChar currentLetter(const QModelIndex &index) const override;
 
 	virtual LibraryFilterProxyModel* proxy() const override;
@@ -35,8 +59,36 @@ public:
 
 	void reset();
 
+	/**
+	 * Replaces tracks which have been modified in the library, and removes the ones which have been deleted. Only their
+	 * nodes are touched: other artists and albums keep their rows, so views keep what is expanded and where they are.
+	 */
+	void updateTracks(const QStringList &removedUris, const QStringList &savedUris);
+
 	inline QMultiHash<SeparatorItem*, QModelIndex> topLevelItems() const { return _topLevelItems; }
 
+	/** Nodes and the search index which was built with them. */
+	inline const LibraryTree *tree() const { return _tree.get(); }
+
+private:
+	/** Empty tree for current hierarchy. Settings are read once, not for each track, and not from another thread. */
+	static std::shared_ptr<LibraryTree> createTree();
+
+	/** Replaces every node with the ones of a tree which has been built in background. */
+	void attachTree(const std::shared_ptr<LibraryTree> &tree);
+
+	/** Removes an item, then its parents which don't have any track left. */
+	void removeNode(QStandardItem *item);
+
+	/** Finds the item of a track by its uri, and forgets it. */
+	QStandardItem *takeTrackItem(const QString &uri);
+
+	/** Adds separators for new top level items, and removes the ones which don't have any item left. */
+	void updateSeparators();
+
+	/** Reloads the library if it has changed since the snapshot shown at startup was written. */
+	void verifySnapshot(qint64 libraryId, qint64 generation);
+
 public slots:
 	virtual void load(const QString & = QString::null) override;
 };
@@ -0,0 +1,128 @@
+#include "librarysearchindex.h"
+
+#include <QRegExp>
+#include <QStringRef>
+
+#include <algorithm>
+
+LibrarySearchIndex::LibrarySearchIndex()
+{
+	_offsets.append(0);
+}
+
+/** Parents are added before their children. Rating is -1 for entries which aren't tracks. Returns the new entry. */
+int LibrarySearchIndex::add(const QString &text, int parent, int rating)
+{
+	int entry = _parents.size();
+	int begin = _text.size();
+	_text.append(text.toCaseFolded());
+	_offsets.append(_text.size());
+	_parents.append(parent);
+	_ratings.append(static_cast<qint8>(rating));
+
+	// A sequence which appears twice in the same text points to it once
+	for (int i = begin; i + 3 <= _text.size(); i++) {
+		QVector<int> &entries = _trigrams[trigram(_text.constData() + i)];
+		if (entries.isEmpty() || entries.last() != entry) {
+			entries.append(entry);
+		}
+	}
+	return entry;
+}
+
+/** Removed entries are never accepted again. */
+void LibrarySearchIndex::remove(int entry)
+{
+	if (entry >= 0) {
+		_removedEntries.insert(entry);
+	}
+}
+
+/**
+ * Entries which contain a filter, their parents which lead to them, and all their children. A filter like "***" keeps
+ * tracks which have at least this rating.
+ */
+QBitArray LibrarySearchIndex::accept(const QString &filter) const
+{
+	QBitArray matches;
+	if (filter.contains(QRegExp("^(\\*){1,5}$"))) {
+		matches.resize(size());
+		for (int entry = 0; entry < size(); entry++) {
+			if (_ratings.at(entry) >= filter.size() && !_removedEntries.contains(entry)) {
+				matches.setBit(entry);
+			}
+		}
+	} else {
+		matches = this->match(filter);
+	}
+
+	// Parents come before their children: a single pass accepts everything under a match, whatever its depth
+	QBitArray accepted(size());
+	for (int entry = 0; entry < size(); entry++) {
+		int parent = _parents.at(entry);
+		if (matches.testBit(entry) || (parent >= 0 && accepted.testBit(parent))) {
+			accepted.setBit(entry);
+		}
+	}
+
+	// Then parents of each match, until one which has already been accepted: its own parents are accepted too
+	for (int entry = 0; entry < size(); entry++) {
+		if (matches.testBit(entry)) {
+			for (int parent = _parents.at(entry); parent >= 0 && !accepted.testBit(parent); parent = _parents.at(parent)) {
+				accepted.setBit(parent);
+			}
+		}
+	}
+	return accepted;
+}
+
+/** Entries which contain a filter on their own. */
+QBitArray LibrarySearchIndex::match(const QString &filter) const
+{
+	QBitArray matches(size());
+	QString folded = filter.toCaseFolded();
+	auto contains = [this, &folded](int entry) -> bool {
+		return QStringRef(&_text, _offsets.at(entry), _offsets.at(entry + 1) - _offsets.at(entry)).contains(folded);
+	};
+
+	if (folded.size() < 3) {
+		for (int entry = 0; entry < size(); entry++) {
+			if (contains(entry)) {
+				matches.setBit(entry);
+			}
+		}
+	} else {
+		// Candidates are read from the rarest sequence of the filter, and must have all the other ones
+		QVector<const QVector<int>*> lists;
+		for (int i = 0; i + 3 <= folded.size(); i++) {
+			auto it = _trigrams.constFind(trigram(folded.constData() + i));
+			if (it == _trigrams.constEnd()) {
+				return matches;
+			}
+			lists.append(&it.value());
+		}
+		std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+			return a->size() < b->size();
+		});
+		for (int entry : *lists.first()) {
+			bool hasAll = true;
+			for (int i = 1; i < lists.size() && hasAll; i++) {
+				hasAll = std::binary_search(lists.at(i)->constBegin(), lists.at(i)->constEnd(), entry);
+			}
+			// Sequences can be in another order in the text
+			if (hasAll && contains(entry)) {
+				matches.setBit(entry);
+			}
+		}
+	}
+
+	for (int entry : _removedEntries) {
+		matches.clearBit(entry);
+	}
+	return matches;
+}
+
+quint64 LibrarySearchIndex::trigram(const QChar *c)
+{
+	return (static_cast<quint64>(c[0].unicode()) << 32) | (static_cast<quint64>(c[1].unicode()) << 16) | c[2].unicode();
+}
@@ -0,0 +1,60 @@
+#ifndef LIBRARYSEARCHINDEX_H
+#define LIBRARYSEARCHINDEX_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "miamlibrary_global.hpp"
+
+/**
+ * \brief		The LibrarySearchIndex class finds artists, albums and tracks which contain some text, without checking all of them.
+ * \details		Each entry is a text with its parent, like a track in its album. Texts are case folded, and every sequence of
+ *				three characters points to the entries which contain it. A filter looks up its own sequences, keeps entries
+ *				which have all of them, then checks these candidates only. Shorter filters are compared with every text.
+ *				Matches are propagated once to parents and children, so that filtering a row afterwards is a single lookup.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMLIBRARY_LIBRARY LibrarySearchIndex
+{
+private:
+	/** Texts of all entries, one after the other. Entry i starts at offset i, and ends at offset i + 1. */
+	QString _text;
+	QVector<int> _offsets;
+
+	QVector<int> _parents;
+	QVector<qint8> _ratings;
+
+	/** Entries which contain three characters, in increasing order. */
+	QHash<quint64, QVector<int>> _trigrams;
+
+	QSet<int> _removedEntries;
+
+public:
+	LibrarySearchIndex();
+
+	/** Parents are added before their children. Rating is -1 for entries which aren't tracks. Returns the new entry. */
+	int add(const QString &text, int parent, int rating = -1);
+
+	/** Removed entries are never accepted again. */
+	void remove(int entry);
+
+	inline int size() const { return _parents.size(); }
+
+	/**
+	 * Entries which contain a filter, their parents which lead to them, and all their children. A filter like "***" keeps
+	 * tracks which have at least this rating.
+	 */
+	QBitArray accept(const QString &filter) const;
+
+private:
+	/** Entries which contain a filter on their own. */
+	QBitArray match(const QString &filter) const;
+
+	static quint64 trigram(const QChar *c);
+};
+
+#endif // LIBRARYSEARCHINDEX_H
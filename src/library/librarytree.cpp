@@ -0,0 +1,367 @@
+#include "librarytree.h"
+
+#include <model/sqldatabase.h>
+#include "albumitem.h"
+#include "artistitem.h"
+#include "miamitemmodel.h"
+#include "separatoritem.h"
+#include "trackitem.h"
+#include "yearitem.h"
+
+#include <QRegularExpression>
+
+#include <QtDebug>
+
+/** Names without any letter or digit are grouped under "Various". */
+static const QByteArray variousSortKey("0");
+
+/** Built once: the same expression is checked for every track. */
+static const QRegularExpression wordCharacter("[\\w]");
+
+/** Albums of different artists are ordered by artist first. */
+static QByteArray artistAlbumSortKey(const LibraryTree::AlbumRecord &a)
+{
+	return a.artistSortKey + '\x01' + a.sortKey;
+}
+
+LibraryTree::LibraryTree(SettingsPrivate::InsertPolicy insertPolicy, const QStringList &articleFilters)
+	: _isTrusted(false)
+	, _insertPolicy(insertPolicy)
+	, _articleFilters(articleFilters)
+	, _root(&_detachedRoot)
+	, _firstTrackEntry(0)
+{}
+
+/**
+ * Maps the snapshot of the previous session if it can be trusted, or reads the library, then builds artists, albums
+ * and years. Called in background. False if the library can't be read, or if the build has been cancelled.
+ */
+bool LibraryTree::build(SqlDatabase &db, bool trustSnapshot, QFutureInterface<void> &progress)
+{
+	// At startup, the snapshot written by the previous session is shown right away, then compared with the library.
+	// Afterwards, it's only used if the library hasn't changed since it was written
+	if (trustSnapshot && _snapshot.map()) {
+		_isTrusted = true;
+	} else if (!_snapshot.map() || !_snapshot.isFresh(db)) {
+		if (!_snapshot.read(db)) {
+			return false;
+		}
+		_snapshot.write();
+	}
+
+	// Only artists, albums and years are built: tracks wait until their album is expanded, or until a search needs them
+	QVector<AlbumRecord> albums = albumRecords(_snapshot);
+	quint32 trackCount = _snapshot.trackCount();
+	_snapshotItems.resize(trackCount);
+	for (quint32 i = 0; i < trackCount; i++) {
+		if (i % 1000 == 0) {
+			if (progress.isCanceled()) {
+				return false;
+			}
+			progress.setProgressValue(static_cast<int>(i * 60ull / trackCount));
+		}
+		QStandardItem *parent = this->insertNodes(_snapshot, i, albums.at(_snapshot.track(i).album));
+		_pendingTracks[parent].append(i);
+		_snapshotItems[i] = parent;
+	}
+
+	// Tracks of the snapshot are indexed after all nodes, one after the other: they don't need any item to be found
+	_firstTrackEntry = _searchIndex.size();
+	for (quint32 i = 0; i < trackCount; i++) {
+		if (i % 1000 == 0) {
+			if (progress.isCanceled()) {
+				return false;
+			}
+			progress.setProgressValue(60 + static_cast<int>(i * 30ull / trackCount));
+		}
+		const LibrarySnapshot::Track &t = _snapshot.track(i);
+		_searchIndex.add(_snapshot.readText(t.title), _entries.value(_snapshotItems.at(i), -1), t.rating);
+	}
+	if (progress.isCanceled()) {
+		return false;
+	}
+
+	// Separators are appended while top level items are checked
+	int topLevelCount = _detachedRoot.rowCount();
+	for (int row = 0; row < topLevelCount; row++) {
+		QStandardItem *item = _detachedRoot.child(row);
+		if (SeparatorItem *separator = MiamItemModel::insertSeparator(item, _insertPolicy, _letters, &_detachedRoot)) {
+			_topLevelItems.insert(separator, item);
+		}
+	}
+	_detachedRoot.sortChildren(0);
+	progress.setProgressValue(100);
+	return true;
+}
+
+/** Strings of albums are shared by all their tracks. */
+QVector<LibraryTree::AlbumRecord> LibraryTree::albumRecords(const LibrarySnapshot &snapshot)
+{
+	QVector<AlbumRecord> albums(snapshot.albumCount());
+	for (quint32 i = 0; i < snapshot.albumCount(); i++) {
+		const LibrarySnapshot::Album &album = snapshot.album(i);
+		AlbumRecord &a = albums[i];
+		a.name = snapshot.text(album.name);
+		a.normalizedName = snapshot.text(album.normalizedName);
+		a.year = snapshot.text(album.year);
+		a.cover = snapshot.text(album.cover);
+		a.artist = snapshot.text(album.artist);
+		a.artistNormalized = snapshot.text(album.artistNormalized);
+		a.sortKey = snapshot.bytes(album.sortKey);
+		a.artistSortKey = snapshot.bytes(album.artistSortKey);
+	}
+	return albums;
+}
+
+/** Finds or creates the artist, album or year of a track of a snapshot. Returns the node where the track belongs. */
+QStandardItem *LibraryTree::insertNodes(const LibrarySnapshot &snapshot, quint32 i, const AlbumRecord &a)
+{
+	const LibrarySnapshot::Track &t = snapshot.track(i);
+	QStandardItem *parent = nullptr;
+	switch (_insertPolicy) {
+	case SettingsPrivate::IP_Artists: {
+		ArtistItem *artistItem = new ArtistItem;
+		QString artistNormalized = a.artistNormalized;
+		QString albumNormalized = a.normalizedName;
+		QString artist = snapshot.text(t.artist);
+		artistItem->setText(a.artist);
+		for (QString filter : _articleFilters) {
+			if (artist.startsWith(filter + " ", Qt::CaseInsensitive)) {
+				artist = artist.mid(filter.length() + 1);
+				artistItem->setData(artist + ", " + filter, Miam::DF_CustomDisplayText);
+				break;
+			}
+		}
+
+		if (artistNormalized.isEmpty() || !artistNormalized.contains(wordCharacter)) {
+			artistItem->setData("0", Miam::DF_NormalizedString);
+			artistItem->setData(variousSortKey, Miam::DF_SortKey);
+		} else {
+			artistItem->setData(artistNormalized, Miam::DF_NormalizedString);
+			artistItem->setData(a.artistSortKey, Miam::DF_SortKey);
+		}
+
+		// Add artist
+		if (_artists.contains(artistItem->hash())) {
+			//qDebug() << "hash found:" << artistItem->hash() << "for" << artistItem->text() ;
+			auto it = _artists.find(artistItem->hash());
+			delete artistItem;
+			artistItem = (*it);
+		} else {
+			_artists.insert(artistItem->hash(), artistItem);
+			_root->appendRow(artistItem);
+			this->addEntry(artistItem, nullptr);
+		}
+
+		AlbumItem *albumItem = new AlbumItem;
+		if (albumNormalized.isEmpty() || !albumNormalized.contains(wordCharacter)) {
+			albumItem->setData("0", Miam::DF_NormalizedString);
+			albumItem->setData(variousSortKey, Miam::DF_SortKey);
+		} else {
+			albumItem->setData(albumNormalized, Miam::DF_NormalizedString);
+			albumItem->setData(a.sortKey, Miam::DF_SortKey);
+		}
+		albumItem->setData(artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(albumNormalized, Miam::DF_NormAlbum);
+		albumItem->setData(a.year, Miam::DF_Year);
+
+		QString internalCoverPath = (t.flags & LibrarySnapshot::TF_InternalCover) ? snapshot.text(t.uri) : QString();
+		QString coverPath = a.cover;
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			albumItem = *it;
+			if (albumItem->data(Miam::DF_InternalCover).toString().isEmpty() && !internalCoverPath.isEmpty()) {
+				albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
+			}
+			if (albumItem->data(Miam::DF_CoverPath).toString().isEmpty() && !coverPath.isEmpty()) {
+				albumItem->setData(coverPath, Miam::DF_CoverPath);
+			}
+		} else {
+
+			albumItem->setText(a.name);
+			albumItem->setData(internalCoverPath, Miam::DF_InternalCover);
+			albumItem->setData(coverPath, Miam::DF_CoverPath);
+			albumItem->setData(snapshot.text(t.icon), Miam::DF_IconPath);
+			albumItem->setData((t.flags & LibrarySnapshot::TF_Remote) != 0, Miam::DF_IsRemote);
+
+			_albums.insert(albumItem->hash(), albumItem);
+			artistItem->appendRow(albumItem);
+			this->addEntry(albumItem, artistItem);
+		}
+
+		parent = albumItem;
+		break;
+	}
+	case SettingsPrivate::IP_Albums: {
+
+		AlbumItem *albumItem = new AlbumItem;
+		albumItem->setText(a.name);
+		if (a.normalizedName.isEmpty() || !a.normalizedName.contains(wordCharacter)) {
+			albumItem->setData("0", Miam::DF_NormalizedString);
+			albumItem->setData(variousSortKey, Miam::DF_SortKey);
+		} else {
+			albumItem->setData(a.normalizedName, Miam::DF_NormalizedString);
+			albumItem->setData(a.sortKey, Miam::DF_SortKey);
+		}
+		albumItem->setData(a.artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(a.normalizedName, Miam::DF_NormAlbum);
+		albumItem->setData(a.year, Miam::DF_Year);
+		if (t.flags & LibrarySnapshot::TF_InternalCover) {
+			albumItem->setData(snapshot.text(t.uri), Miam::DF_InternalCover);
+		}
+		albumItem->setData(a.cover, Miam::DF_CoverPath);
+		albumItem->setData(snapshot.text(t.icon), Miam::DF_IconPath);
+		albumItem->setData((t.flags & LibrarySnapshot::TF_Remote) != 0, Miam::DF_IsRemote);
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			albumItem = (*it);
+		} else {
+			_albums.insert(albumItem->hash(), albumItem);
+			_root->appendRow(albumItem);
+			this->addEntry(albumItem, nullptr);
+		}
+
+		parent = albumItem;
+		break;
+	}
+	case SettingsPrivate::IP_ArtistsAlbums: {
+		AlbumItem *albumItem = new AlbumItem;
+		albumItem->setText(snapshot.text(t.artist) + " – " + a.name);
+		albumItem->setData(a.artistNormalized + "|" + a.normalizedName, Miam::DF_NormalizedString);
+		albumItem->setData(artistAlbumSortKey(a), Miam::DF_SortKey);
+		albumItem->setData(a.artistNormalized, Miam::DF_NormArtist);
+		albumItem->setData(a.normalizedName, Miam::DF_NormAlbum);
+		albumItem->setData(a.year, Miam::DF_Year);
+		albumItem->setData(a.cover, Miam::DF_CoverPath);
+		albumItem->setData(snapshot.text(t.icon), Miam::DF_IconPath);
+		albumItem->setData((t.flags & LibrarySnapshot::TF_Remote) != 0, Miam::DF_IsRemote);
+
+		// Add album
+		if (_albums.contains(albumItem->hash())) {
+			auto it = _albums.find(albumItem->hash());
+			delete albumItem;
+			albumItem = *it;
+		} else {
+			_albums.insert(albumItem->hash(), albumItem);
+			_root->appendRow(albumItem);
+			this->addEntry(albumItem, nullptr);
+		}
+
+		parent = albumItem;
+		break;
+	}
+	case SettingsPrivate::IP_Years: {
+		YearItem *yearItem = new YearItem(a.year);
+
+		// Add year
+		if (_years.contains(yearItem->hash())) {
+			auto it = _years.find(yearItem->hash());
+			delete yearItem;
+			yearItem = (*it);
+		} else {
+			_years.insert(yearItem->hash(), yearItem);
+			_root->appendRow(yearItem);
+			this->addEntry(yearItem, nullptr);
+		}
+
+		// Add Artist - Album
+		AlbumItem *artistAlbumItem = new AlbumItem;
+		artistAlbumItem->setText(snapshot.text(t.artist) + " – " + a.name);
+		artistAlbumItem->setData(a.artistNormalized + "|" + a.normalizedName, Miam::DF_NormalizedString);
+		artistAlbumItem->setData(artistAlbumSortKey(a), Miam::DF_SortKey);
+		artistAlbumItem->setData(a.artistNormalized, Miam::DF_NormArtist);
+		artistAlbumItem->setData(a.normalizedName, Miam::DF_NormAlbum);
+		artistAlbumItem->setData(a.year, Miam::DF_Year);
+		artistAlbumItem->setData(a.cover, Miam::DF_CoverPath);
+		artistAlbumItem->setData(snapshot.text(t.icon), Miam::DF_IconPath);
+		artistAlbumItem->setData((t.flags & LibrarySnapshot::TF_Remote) != 0, Miam::DF_IsRemote);
+
+		if (_albums.contains(artistAlbumItem->hash())) {
+			auto it = _albums.find(artistAlbumItem->hash());
+			delete artistAlbumItem;
+			artistAlbumItem = *it;
+		} else {
+			_albums.insert(artistAlbumItem->hash(), artistAlbumItem);
+			yearItem->appendRow(artistAlbumItem);
+			this->addEntry(artistAlbumItem, yearItem);
+		}
+
+		parent = artistAlbumItem;
+		break;
+	}
+	}
+	return parent;
+}
+
+/** Gives top level items to the root of a model. New nodes are inserted under this root afterwards. */
+void LibraryTree::attach(QStandardItem *root)
+{
+	if (_detachedRoot.rowCount() > 0) {
+		root->appendRows(_detachedRoot.takeColumn(0));
+	}
+	_root = root;
+}
+
+/** Entry of a node in the search index, or -1 if it's not indexed. */
+int LibraryTree::entry(const QStandardItem *item) const
+{
+	if (item->type() == Miam::IT_Track) {
+		const TrackItem *track = static_cast<const TrackItem*>(item);
+		if (track->snapshot() == &_snapshot) {
+			return _firstTrackEntry + track->snapshotIndex();
+		}
+	}
+	return _entries.value(item, -1);
+}
+
+/** Indexes a track which was read after the tree was built. */
+void LibraryTree::addTrack(const LibrarySnapshot &snapshot, quint32 i, QStandardItem *trackItem)
+{
+	const LibrarySnapshot::Track &t = snapshot.track(i);
+	_entries.insert(trackItem, _searchIndex.add(snapshot.text(t.title), this->entry(trackItem->parent()), t.rating));
+	_acceptedFilter.clear();
+}
+
+/** Forgets a node which is about to be deleted. */
+void LibraryTree::removeEntry(const QStandardItem *item)
+{
+	_searchIndex.remove(this->entry(item));
+	_entries.remove(item);
+	_acceptedFilter.clear();
+}
+
+/** Forgets a track of the snapshot which hasn't been fetched yet. */
+void LibraryTree::removeTrackEntry(quint32 i)
+{
+	_searchIndex.remove(_firstTrackEntry + i);
+	_acceptedFilter.clear();
+}
+
+/**
+ * True if a node contains a filter, if one of its parents does, or one of its children. What a filter accepts is
+ * computed once, then each node is a single lookup.
+ */
+bool LibraryTree::isAccepted(const QStandardItem *item, const QString &filter) const
+{
+	if (_acceptedFilter != filter) {
+		_accepted = _searchIndex.accept(filter);
+		_acceptedFilter = filter;
+	}
+	int entry = this->entry(item);
+	if (entry < 0 || entry >= _accepted.size()) {
+		return item->text().contains(filter, Qt::CaseInsensitive);
+	}
+	return _accepted.testBit(entry);
+}
+
+void LibraryTree::addEntry(QStandardItem *item, const QStandardItem *parent)
+{
+	_entries.insert(item, _searchIndex.add(item->text(), parent ? this->entry(parent) : -1));
+	_acceptedFilter.clear();
+}
@@ -0,0 +1,128 @@
+#ifndef LIBRARYTREE_H
+#define LIBRARYTREE_H
+
+#include <QBitArray>
+#include <QFutureInterface>
+#include <QHash>
+#include <QStandardItem>
+#include <QVector>
+
+#include <model/librarysnapshot.h>
+#include <settingsprivate.h>
+#include "librarysearchindex.h"
+#include "miamlibrary_global.hpp"
+
+/// Forward declarations
+class AlbumItem;
+class ArtistItem;
+class SeparatorItem;
+class SqlDatabase;
+class YearItem;
+
+/**
+ * \brief		The LibraryTree class holds artists, albums and years of the library, with the snapshot tracks are read from.
+ * \details		A tree is built in background under a root which doesn't belong to any model, so that no signal is sent and
+ *				views don't see anything before it's complete. LibraryItemModel takes its top level items in a single step,
+ *				then keeps the tree to find nodes when tracks are edited. While it's building, it checks regularly if it has
+ *				been cancelled, because another hierarchy has been chosen for example. Texts of nodes and tracks are indexed
+ *				during the build too, so that tracks can be found while their album hasn't been expanded.
+ * \author      Matthieu Bachelier
+ * \copyright   GNU General Public License v3
+ */
+class MIAMLIBRARY_LIBRARY LibraryTree
+{
+public:
+	/** Texts of an album, read once and shared by all its tracks. */
+	struct AlbumRecord
+	{
+		QString name, normalizedName, year, cover, artist, artistNormalized;
+		QByteArray sortKey, artistSortKey;
+	};
+
+private:
+	/** Tracks read their roles from this snapshot, which is kept as long as the tree. */
+	LibrarySnapshot _snapshot;
+
+	/** True if the snapshot of the previous session was used without checking the library. */
+	bool _isTrusted;
+
+	SettingsPrivate::InsertPolicy _insertPolicy;
+	QStringList _articleFilters;
+
+	/** Top level items are created under this root until they're taken by the model. */
+	QStandardItem _detachedRoot;
+	QStandardItem *_root;
+
+	/** Nodes which already exist, to insert tracks at the right location. */
+	QHash<uint, ArtistItem*> _artists;
+	QHash<uint, AlbumItem*> _albums;
+	QHash<uint, YearItem*> _years;
+
+	/** Item of each track of the snapshot once it has been fetched, its album before, or null if it has been removed since. */
+	QVector<QStandardItem*> _snapshotItems;
+
+	/** Tracks of the snapshot which haven't been built yet, by album. */
+	QHash<QStandardItem*, QVector<quint32>> _pendingTracks;
+
+	/** Separators, and top level items under each of them. */
+	QHash<QString, SeparatorItem*> _letters;
+	QMultiHash<SeparatorItem*, QStandardItem*> _topLevelItems;
+
+	/** Texts of nodes and tracks, to filter them while one is typing. */
+	LibrarySearchIndex _searchIndex;
+
+	/** Entries of nodes, and of tracks read after the tree was built. Tracks of the snapshot follow each other from the first one. */
+	QHash<const QStandardItem*, int> _entries;
+	int _firstTrackEntry;
+
+	/** Last filter, and what it accepts. */
+	mutable QString _acceptedFilter;
+	mutable QBitArray _accepted;
+
+	friend class LibraryItemModel;
+
+public:
+	LibraryTree(SettingsPrivate::InsertPolicy insertPolicy, const QStringList &articleFilters);
+
+	/**
+	 * Maps the snapshot of the previous session if it can be trusted, or reads the library, then builds artists, albums
+	 * and years. Called in background. False if the library can't be read, or if the build has been cancelled.
+	 */
+	bool build(SqlDatabase &db, bool trustSnapshot, QFutureInterface<void> &progress);
+
+	/** Strings of albums are shared by all their tracks. */
+	static QVector<AlbumRecord> albumRecords(const LibrarySnapshot &snapshot);
+
+	/** Finds or creates the artist, album or year of a track of a snapshot. Returns the node where the track belongs. */
+	QStandardItem *insertNodes(const LibrarySnapshot &snapshot, quint32 i, const AlbumRecord &a);
+
+	/** Gives top level items to the root of a model. New nodes are inserted under this root afterwards. */
+	void attach(QStandardItem *root);
+
+	/** Entry of a node in the search index, or -1 if it's not indexed. */
+	int entry(const QStandardItem *item) const;
+
+	/** Indexes a track which was read after the tree was built. */
+	void addTrack(const LibrarySnapshot &snapshot, quint32 i, QStandardItem *trackItem);
+
+	/** Forgets a node which is about to be deleted. */
+	void removeEntry(const QStandardItem *item);
+
+	/** Forgets a track of the snapshot which hasn't been fetched yet. */
+	void removeTrackEntry(quint32 i);
+
+	/**
+	 * True if a node contains a filter, if one of its parents does, or one of its children. What a filter accepts is
+	 * computed once, then each node is a single lookup.
+	 */
+	bool isAccepted(const QStandardItem *item, const QString &filter) const;
+
+	inline bool isTrusted() const { return _isTrusted; }
+
+	inline const LibrarySnapshot &snapshot() const { return _snapshot; }
+
+private:
+	void addEntry(QStandardItem *item, const QStandardItem *parent);
+};
+
+#endif // LIBRARYTREE_H
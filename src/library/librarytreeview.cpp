@@ -114,7 +114,12 @@ const QImage *LibraryTreeView::expandedCover(AlbumItem *album) const
 /** Reimplemented. */
 void LibraryTreeView::findAll(const QModelIndex &index, QList<QUrl> *tracks) const
 {
-	QStandardItem *item = _libraryModel->itemFromIndex(_proxyModel->mapToSource(index));
+	// Albums which have never been expanded don't have their tracks yet
+	QModelIndex source = _proxyModel->mapToSource(index);
+	if (_libraryModel->canFetchMore(source)) {
+		_libraryModel->fetchMore(source);
+	}
+	QStandardItem *item = _libraryModel->itemFromIndex(source);
 	if (item && item->hasChildren()) {
 		for (int i = 0; i < item->rowCount(); i++) {
 			// Recursive call on children
@@ -288,7 +293,11 @@ void LibraryTreeView::paintEvent(QPaintEvent *event)
 /** Recursive count for leaves only. */
 int LibraryTreeView::count(const QModelIndex &index) const
 {
-	QStandardItem *item = _libraryModel->itemFromIndex(_proxyModel->mapToSource(index));
+	QModelIndex source = _proxyModel->mapToSource(index);
+	if (_libraryModel->canFetchMore(source)) {
+		_libraryModel->fetchMore(source);
+	}
+	QStandardItem *item = _libraryModel->itemFromIndex(source);
 	if (item) {
 		int tmp = 0;
 		for (int i = 0; i < item->rowCount(); i++) {
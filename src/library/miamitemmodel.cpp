@@ -3,6 +3,8 @@
 
 #include <settingsprivate.h>
 
+#include <QFutureWatcher>
+
 #include <QtDebug>
 
 MiamItemModel::MiamItemModel(QObject *parent)
@@ -29,22 +31,29 @@ void MiamItemModel::deleteCache()
 }
 
 SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node)
+{
+	return insertSeparator(node, SettingsPrivate::instance()->insertPolicy(), _letters, invisibleRootItem());
+}
+
+/** Finds or creates the separator of a top level node. The root doesn't have to belong to a model yet. */
+SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node, SettingsPrivate::InsertPolicy insertPolicy,
+											  QHash<QString, SeparatorItem*> &letters, QStandardItem *root)
 {
 	// Items are grouped every ten years in this particular case
-	switch (SettingsPrivate::instance()->insertPolicy()) {
+	switch (insertPolicy) {
 	case SettingsPrivate::IP_Years: {
 		int year = node->text().toInt();
 		if (year == 0) {
 			return nullptr;
 		}
 		QString yearStr = QString::number(year - year % 10);
-		if (_letters.contains(yearStr)) {
-			return _letters.value(yearStr);
+		if (letters.contains(yearStr)) {
+			return letters.value(yearStr);
 		} else {
 			SeparatorItem *separator = new SeparatorItem(yearStr);
 			separator->setData(yearStr, Miam::DF_NormalizedString);
-			invisibleRootItem()->appendRow(separator);
-			_letters.insert(yearStr, separator);
+			root->appendRow(separator);
+			letters.insert(yearStr, separator);
 			return separator;
 		}
 		break;
@@ -66,19 +75,50 @@ SeparatorItem *MiamItemModel::insertSeparator(const QStandardItem *node)
 			letter = tr("Various");
 			topLevelLetter = true;
 		}
-		if (_letters.contains(letter)) {
-			return _letters.value(letter);
+		if (letters.contains(letter)) {
+			return letters.value(letter);
 		} else {
 			SeparatorItem *separator = new SeparatorItem(letter);
 			if (topLevelLetter) {
 				separator->setData("0", Miam::DF_NormalizedString);
+				separator->setData(QByteArray("0"), Miam::DF_SortKey);
 			} else {
 				separator->setData(letter.toLower(), Miam::DF_NormalizedString);
+				separator->setData(letter.toLower().toUtf8(), Miam::DF_SortKey);
 			}
-			invisibleRootItem()->appendRow(separator);
-			_letters.insert(letter, separator);
+			root->appendRow(separator);
+			letters.insert(letter, separator);
 			return separator;
 		}
 	}
 	return nullptr;
 }
+
+/** Cancels the build which is still running, if any, and follows the progress of a new one. */
+std::shared_ptr<QFutureInterface<void>> MiamItemModel::startBuild()
+{
+	if (_build) {
+		_build->cancel();
+	}
+	_build = std::make_shared<QFutureInterface<void>>();
+	_build->reportStarted();
+	_build->setProgressRange(0, 100);
+
+	QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+	connect(watcher, &QFutureWatcherBase::progressValueChanged, this, &MiamItemModel::progressChanged);
+	connect(watcher, &QFutureWatcherBase::finished, watcher, &QObject::deleteLater);
+	watcher->setFuture(_build->future());
+	emit aboutToLoad();
+	return _build;
+}
+
+/** Stops following a build. False if another one has started since: its result has to be dropped. */
+bool MiamItemModel::finishBuild(const std::shared_ptr<QFutureInterface<void>> &build)
+{
+	build->reportFinished();
+	if (build != _build) {
+		return false;
+	}
+	_build.reset();
+	return true;
+}
@@ -1,11 +1,15 @@
 #ifndef MIAMITEMMODEL_H
 #define MIAMITEMMODEL_H
 
+#include <QFutureInterface>
 #include <QStandardItemModel>
 #include <QSortFilterProxyModel>
+#include <settingsprivate.h>
 #include "separatoritem.h"
 #include "trackitem.h"
 
+#include <memory>
+
 #include "miamlibrary_global.hpp"
 
 /**
@@ -29,6 +33,9 @@ protected:
 
 	QHash<QString, TrackItem*> _tracks;
 
+	/** Build which is running in background, or null. It's cancelled when another one starts. */
+	std::shared_ptr<QFutureInterface<void>> _build;
+
 public:
 	explicit MiamItemModel(QObject *parent = nullptr);
 
@@ -42,10 +49,29 @@ public:
 
 	virtual QSortFilterProxyModel* proxy() const = 0;
 
+	/** Finds or creates the separator of a top level node. The root doesn't have to belong to a model yet. */
+	static SeparatorItem *insertSeparator(const QStandardItem *node, SettingsPrivate::InsertPolicy insertPolicy,
+										  QHash<QString, SeparatorItem*> &letters, QStandardItem *root);
+
 protected:
 	void deleteCache();
 
 	SeparatorItem *insertSeparator(const QStandardItem *node);
+
+	/** Cancels the build which is still running, if any, and follows the progress of a new one. */
+	std::shared_ptr<QFutureInterface<void>> startBuild();
+
+	/** Stops following a build. False if another one has started since: its result has to be dropped. */
+	bool finishBuild(const std::shared_ptr<QFutureInterface<void>> &build);
+
+signals:
+	/** Items are about to be built in background. Current ones stay in the model meanwhile. */
+	void aboutToLoad();
+
+	void progressChanged(int);
+
+	/** Items which were built in background have replaced the previous ones. */
+	void loaded();
 };
 
 #endif // MIAMITEMMODEL_H
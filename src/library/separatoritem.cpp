@@ -5,6 +5,7 @@ SeparatorItem::SeparatorItem(const QString &text) :
 	QStandardItem(text)
 {
 	setData(text.left(1).toLower(), Miam::DF_NormalizedString);
+	setData(text.left(1).toLower().toUtf8(), Miam::DF_SortKey);
 }
 
 int SeparatorItem::type() const
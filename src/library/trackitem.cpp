@@ -2,10 +2,52 @@
 #include "miamcore_global.h"
 
 TrackItem::TrackItem()
+	: _snapshot(nullptr)
+	, _index(0)
 {
 
 }
 
+TrackItem::TrackItem(const LibrarySnapshot *snapshot, quint32 index)
+	: _snapshot(snapshot)
+	, _index(index)
+{}
+
+QVariant TrackItem::data(int role) const
+{
+	QVariant value = QStandardItem::data(role);
+	if (value.isValid() || _snapshot == nullptr) {
+		return value;
+	}
+
+	const LibrarySnapshot::Track &t = _snapshot->track(_index);
+	switch (role) {
+	case Qt::DisplayRole:
+	case Qt::EditRole:
+		return _snapshot->text(t.title);
+	case Miam::DF_SortKey:
+		return _snapshot->bytes(t.sortKey);
+	case Miam::DF_URI:
+		return _snapshot->text(t.uri);
+	case Miam::DF_TrackNumber:
+		return _snapshot->text(t.trackNumber);
+	case Miam::DF_DiscNumber:
+		return _snapshot->text(t.disc);
+	case Miam::DF_TrackLength:
+		return t.length;
+	case Miam::DF_Rating:
+		return t.rating == -1 ? QVariant() : QVariant(t.rating);
+	case Miam::DF_Artist:
+		return _snapshot->text(t.artist);
+	case Miam::DF_Album:
+		return _snapshot->text(_snapshot->album(t.album).name);
+	case Miam::DF_IsRemote:
+		return (t.flags & LibrarySnapshot::TF_Remote) != 0;
+	default:
+		return value;
+	}
+}
+
 int TrackItem::type() const
 {
 	return Miam::IT_Track;
@@ -2,20 +2,38 @@
 #define TRACKITEM_H
 
 #include <QStandardItem>
+#include <model/librarysnapshot.h>
 #include "miamlibrary_global.hpp"
 
 /**
  * \brief		The TrackItem class
+ * \details		Tracks are most of the items in the library. When they are built from a snapshot, they only keep the index of
+ *				their record: title, uri, artist and other roles are read from the snapshot when a view asks for them, and
+ *				texts are shared between all tracks. Roles which are set afterwards, like highlighting, are stored as usual.
  * \author      Matthieu Bachelier
  * \copyright   GNU General Public License v3
  */
 class MIAMLIBRARY_LIBRARY TrackItem : public QStandardItem
 {
+private:
+	const LibrarySnapshot *_snapshot;
+	quint32 _index;
+
 public:
 	explicit TrackItem();
 
+	/** The snapshot must outlive this item. */
+	explicit TrackItem(const LibrarySnapshot *snapshot, quint32 index);
+
 	virtual ~TrackItem() {}
 
+	virtual QVariant data(int role = Qt::UserRole + 1) const override;
+
+	/** Snapshot this track was built from, or null. */
+	inline const LibrarySnapshot *snapshot() const { return _snapshot; }
+
+	inline quint32 snapshotIndex() const { return _index; }
+
 	virtual int type() const override;
 };
 
@@ -533,18 +533,12 @@ void CustomizeOptionsDialog::updateMusicLocations(bool immediateRescan)
 				removedLocations << savedLocation;
 			}
 		}
-		SqlDatabase db;
-
 		// Remove old locations from database cache
-		db.transaction();
+		QStringList removedPaths;
 		for (QString removedLocation : removedLocations) {
-			QSqlQuery syncDb(db);
-			syncDb.setForwardOnly(true);
-			syncDb.prepare("DELETE FROM cache WHERE uri LIKE :path ");
-			syncDb.bindValue(":path", QDir::fromNativeSeparators(removedLocation) + "%");
-			syncDb.exec();
+			removedPaths << QDir::fromNativeSeparators(removedLocation);
 		}
-		db.commit();
+		SqlDatabase().removeRecords(removedPaths);
 
 		if (immediateRescan) {
 			settings->setMusicLocations(newLocations);
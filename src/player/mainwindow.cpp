@@ -3,6 +3,7 @@
 #include <mediabuttons/mediabutton.h>
 #include <abstractviewplaylists.h>
 #include <musicsearchengine.h>
+#include <model/sqldatabase.h>
 #include <quickstart.h>
 #include <settings.h>
 #include <settingsprivate.h>
@@ -32,6 +33,7 @@ MainWindow::MainWindow(QWidget *parent)
 	, _shortcutStop(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaStop), this))
 	, _shortcutPlayPause(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaPlay), this))
 	, _shortcutSkipForward(new QxtGlobalShortcut(QKeySequence(Qt::Key_MediaNext), this))
+	, _fileSystemWatcher(nullptr)
 {
 	setupUi(this);
 	actionPlay->setIcon(style()->standardIcon(QStyle::SP_MediaPlay));
@@ -90,6 +92,12 @@ void MainWindow::activateLastView()
 		if (defaultActionView == nullptr) {
 			actionViewPlaylists->trigger();
 		}
+		this->monitorFileSystem(settingsPrivate->isFileSystemMonitored());
+
+		// Last scan was interrupted by a crash or because the player was closed: it continues where it has stopped
+		if (!SqlDatabase().selectScanCheckpoints().isEmpty()) {
+			this->syncLibrary(QStringList(), settingsPrivate->musicLocations());
+		}
 	}
 }
 
@@ -255,23 +263,7 @@ void MainWindow::setupActions()
 
 	connect(actionMute, &QAction::triggered, _mediaPlayer, &MediaPlayer::toggleMute);
 
-	connect(settingsPrivate, &SettingsPrivate::monitorFileSystemChanged, this, [=](bool b) {
-		if (b) {
-			MusicSearchEngine *worker = new MusicSearchEngine;
-			QThread *thread = new QThread;
-			worker->moveToThread(thread);
-			connect(thread, &QThread::started, worker, &MusicSearchEngine::watchForChanges);
-			connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-			thread->start();
-
-			if (_currentView && _currentView->viewProperty(Settings::VP_HasAreaForRescan)) {
-				_currentView->setMusicSearchEngine(worker);
-			}
-			qDebug() << Q_FUNC_INFO << "create new instance of file system watcher";
-		} else {
-			qDebug() << Q_FUNC_INFO << "delete any instance of file system watcher";
-		}
-	});
+	connect(settingsPrivate, &SettingsPrivate::monitorFileSystemChanged, this, &MainWindow::monitorFileSystem);
 
 	connect(settingsPrivate, &SettingsPrivate::fontHasChanged, this, [=](SettingsPrivate::FontFamily ff) {
 		if (ff == SettingsPrivate::FF_Menu) {
@@ -429,6 +421,33 @@ void MainWindow::initQuickStart()
 	this->resize(400, 500);
 }
 
+void MainWindow::monitorFileSystem(bool enabled)
+{
+	if (enabled && !_fileSystemWatcher) {
+		_fileSystemWatcher = new MusicSearchEngine;
+		QThread *thread = new QThread;
+		_fileSystemWatcher->moveToThread(thread);
+		connect(thread, &QThread::started, _fileSystemWatcher, &MusicSearchEngine::watchForChanges);
+		connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+		connect(_fileSystemWatcher, &MusicSearchEngine::destroyed, thread, &QThread::quit);
+		connect(_fileSystemWatcher, &MusicSearchEngine::tracksChanged, this, [=](const QStringList &removedUris, const QStringList &savedUris) {
+			if (_currentView) {
+				emit _currentView->tracksChanged(removedUris, savedUris);
+			}
+		});
+		thread->start();
+
+		if (_currentView && _currentView->viewProperty(Settings::VP_HasAreaForRescan)) {
+			_currentView->setMusicSearchEngine(_fileSystemWatcher);
+		}
+		qDebug() << Q_FUNC_INFO << "create new instance of file system watcher";
+	} else if (!enabled && _fileSystemWatcher) {
+		qDebug() << Q_FUNC_INFO << "delete any instance of file system watcher";
+		_fileSystemWatcher->deleteLater();
+		_fileSystemWatcher = nullptr;
+	}
+}
+
 void MainWindow::toggleShortcutsOnMenuBar(bool enabled)
 {
 	qDebug() << Q_FUNC_INFO << enabled;
@@ -761,20 +780,9 @@ void MainWindow::syncLibrary(const QStringList &oldLocations, const QStringList
 		return;
 	}
 
-	bool same = true;
-	if (oldLocations.size() == newLocations.size()) {
-		for (int i = 0; i < newLocations.size(); i++) {
-			same = same && QString::compare(newLocations.at(i), oldLocations.at(i)) == 0;
-		}
-
-	} else {
-		same = false;
-	}
-
-	if (!same) {
-		SqlDatabase db;
-		db.reset();
-	}
+	// No need to reset the library when locations have changed: scans are incremental, tracks which are not under
+	// one of the new locations anymore will be removed, and existing ones won't be read again
+	Q_UNUSED(oldLocations)
 
 	QThread *thread = new QThread;
 	MusicSearchEngine *worker = new MusicSearchEngine;
@@ -801,6 +809,11 @@ void MainWindow::syncLibrary(const QStringList &oldLocations, const QStringList
 		actionScanLibrary->setEnabled(true);
 	});
 	thread->start();
+
+	// Locations may have changed: watches have to be updated as well
+	if (_fileSystemWatcher) {
+		QMetaObject::invokeMethod(_fileSystemWatcher, "watchForChanges", Qt::QueuedConnection);
+	}
 }
 
 void MainWindow::toggleMenuBar(bool checked)
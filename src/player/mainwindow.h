@@ -40,6 +40,9 @@ private:
 	QxtGlobalShortcut *_shortcutSkipForward;
 	QTranslator _translator;
 
+	/** Keeps the library up-to-date in background when one has activated this option. */
+	MusicSearchEngine *_fileSystemWatcher;
+
 public:
 	explicit MainWindow(QWidget *parent = nullptr);
 
@@ -80,6 +83,8 @@ protected:
 private:
 	void initQuickStart();
 
+	void monitorFileSystem(bool enabled);
+
 	void toggleShortcutsOnMenuBar(bool enabled);
 
 public slots:
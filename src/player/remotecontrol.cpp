@@ -249,7 +249,7 @@ void RemoteControl::sendTrackInfos(const QString &track)
 	QStringList args;
 	args << QString::number(CMD_Track);
 
-	SqlDatabase db;
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 	TrackDAO dao = db.selectTrackByURI(track);
 	args << dao.uri();
 	args << dao.artistAlbum();
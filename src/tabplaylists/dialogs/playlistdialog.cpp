@@ -1,6 +1,7 @@
 ﻿#include "playlistdialog.h"
 
 #include <model/playlistdao.h>
+#include <model/sqlqueryservice.h>
 #include <model/trackdao.h>
 #include <scrollbar.h>
 #include <filehelper.h>
@@ -285,21 +286,31 @@ void PlaylistDialog::populatePreviewFromSaved(const QItemSelection &, const QIte
 	this->clearPreview(!empty);
 	if (indexes.size() == 1) {
 		uint playlistId = _savedPlaylistModel->itemFromIndex(indexes.first())->data(PlaylistID).toUInt();
-		QStringList tracks = SqlDatabase().selectPlaylistTracks(playlistId);
-		for (int i = 0; i < tracks.size(); i++) {
-			QString track = tracks.at(i);
-			QTreeWidgetItem *item = new QTreeWidgetItem;
-			FileHelper fh(track);
-			item->setText(0, QString("%1 (%2 - %3)").arg(fh.title(), fh.artist(), fh.album()));
-			previewPlaylist->addTopLevelItem(item);
-
-			if (i + 1 == MAX_TRACKS_PREVIEW_AREA) {
+		QFuture<QStringList> tracks = SqlQueryService::instance()->submit<QStringList>(SqlQueryService::QP_Interactive, "playlistPreview",
+																					   SqlConnectionPool::AM_ReadOnly, [playlistId](SqlDatabase &db) {
+			return db.selectPlaylistTracks(playlistId);
+		});
+		SqlQueryService::whenReady<QStringList>(tracks, this, [this, playlistId] (const QStringList &tracks) {
+			// Selection may have changed while tracks were read
+			QModelIndexList indexes = savedPlaylists->selectionModel()->selectedIndexes();
+			if (indexes.size() != 1 || indexes.first().data(PlaylistID).toUInt() != playlistId || previewPlaylist->topLevelItemCount() > 0) {
+				return;
+			}
+			for (int i = 0; i < tracks.size(); i++) {
+				QString track = tracks.at(i);
 				QTreeWidgetItem *item = new QTreeWidgetItem;
-				item->setText(0, tr("And more tracks..."));
+				FileHelper fh(track);
+				item->setText(0, QString("%1 (%2 - %3)").arg(fh.title(), fh.artist(), fh.album()));
 				previewPlaylist->addTopLevelItem(item);
-				break;
+
+				if (i + 1 == MAX_TRACKS_PREVIEW_AREA) {
+					QTreeWidgetItem *item = new QTreeWidgetItem;
+					item->setText(0, tr("And more tracks..."));
+					previewPlaylist->addTopLevelItem(item);
+					break;
+				}
 			}
-		}
+		});
 	}
 	loadPlaylists->setDisabled(empty);
 	deletePlaylists->setDisabled(empty);
@@ -361,7 +372,10 @@ void PlaylistDialog::renameItem(QStandardItem *item)
 		} else {
 			PlaylistDAO dao = _saved.value(item);
 			dao.setTitle(item->text());
-			SqlDatabase().updateTablePlaylist(dao);
+			SqlQueryService::instance()->submit<bool>(SqlQueryService::QP_Background, "renamePlaylist/" + dao.id(), SqlConnectionPool::AM_ReadWrite,
+													  [dao](SqlDatabase &db) {
+				return db.updateTablePlaylist(dao);
+			});
 			emit aboutToRenameTab(dao);
 		}
 	}
@@ -370,41 +384,49 @@ void PlaylistDialog::renameItem(QStandardItem *item)
 /** Update saved playlists when one is adding a new one. */
 void PlaylistDialog::updatePlaylists()
 {
-	// Populate saved playlists area
-	_savedPlaylistModel->clear();
-	_savedPlaylistModel->blockSignals(true);
+	// Reset buttons status
+	loadPlaylists->setEnabled(false);
+	savePlaylists->setEnabled(false);
+	deletePlaylists->setEnabled(false);
+	exportPlaylists->setEnabled(false);
 
-	QMap<uint, Playlist*> map;
-	for (int i = 0; i < _playlists.count(); i++) {
-		Playlist *p = _playlists.at(i);
-		if (p->id() != 0) {
-			map.insert(p->id(), p);
+	// Read in background after playlists which are still being saved or deleted
+	QFuture<QList<PlaylistDAO>> playlists = SqlQueryService::instance()->submit<QList<PlaylistDAO>>(SqlQueryService::QP_Background, "savedPlaylists",
+																									SqlConnectionPool::AM_ReadOnly, [](SqlDatabase &db) {
+		return db.selectPlaylists();
+	});
+	SqlQueryService::whenReady<QList<PlaylistDAO>>(playlists, this, [this] (const QList<PlaylistDAO> &playlists) {
+		// Populate saved playlists area
+		_savedPlaylistModel->clear();
+		_saved.clear();
+		_savedPlaylistModel->blockSignals(true);
+
+		QMap<uint, Playlist*> map;
+		for (int i = 0; i < _playlists.count(); i++) {
+			Playlist *p = _playlists.at(i);
+			if (p->id() != 0) {
+				map.insert(p->id(), p);
+			}
 		}
-	}
 
-	for (PlaylistDAO playlist : SqlDatabase().selectPlaylists()) {
-		QStandardItem *item = new QStandardItem(playlist.title());
-		item->setData(playlist.id(), PlaylistID);
-		if (playlist.icon().isEmpty()) {
-			Playlist *p = map.value(playlist.id().toUInt());
-			if (p && p->isModified()) {
-				item->setIcon(QIcon(":/icons/playlist_modified"));
-				item->setData(true, PlaylistModified);
-				item->setToolTip(tr("This playlist has changed"));
+		for (PlaylistDAO playlist : playlists) {
+			QStandardItem *item = new QStandardItem(playlist.title());
+			item->setData(playlist.id(), PlaylistID);
+			if (playlist.icon().isEmpty()) {
+				Playlist *p = map.value(playlist.id().toUInt());
+				if (p && p->isModified()) {
+					item->setIcon(QIcon(":/icons/playlist_modified"));
+					item->setData(true, PlaylistModified);
+					item->setToolTip(tr("This playlist has changed"));
+				} else {
+					item->setIcon(QIcon(":/icons/playlist"));
+				}
 			} else {
-				item->setIcon(QIcon(":/icons/playlist"));
+				item->setIcon(QIcon(playlist.icon()));
 			}
-		} else {
-			item->setIcon(QIcon(playlist.icon()));
+			_savedPlaylistModel->appendRow(item);
+			_saved.insert(item, playlist);
 		}
-		_savedPlaylistModel->appendRow(item);
-		_saved.insert(item, playlist);
-	}
-	_savedPlaylistModel->blockSignals(false);
-
-	// Reset buttons status
-	loadPlaylists->setEnabled(false);
-	savePlaylists->setEnabled(false);
-	deletePlaylists->setEnabled(false);
-	exportPlaylists->setEnabled(false);
+		_savedPlaylistModel->blockSignals(false);
+	});
 }
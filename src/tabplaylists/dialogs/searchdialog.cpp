@@ -203,7 +203,7 @@ void SearchDialog::artistWasDoubleClicked(const QModelIndex &artistIndex)
 	const QStandardItemModel *m = qobject_cast<const QStandardItemModel*>(artistIndex.model());
 	QStandardItem *item = m->itemFromIndex(artistIndex);
 
-	SqlDatabase db;
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 
 	QSqlQuery q(db);
 	q.prepare("SELECT uri FROM cache WHERE artist = ?");
@@ -225,7 +225,7 @@ void SearchDialog::albumWasDoubleClicked(const QModelIndex &albumIndex)
 	const QStandardItemModel *m = qobject_cast<const QStandardItemModel*>(albumIndex.model());
 	QStandardItem *item = m->itemFromIndex(albumIndex);
 
-	SqlDatabase db;
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 
 	QSqlQuery q(db);
 	q.prepare("SELECT uri FROM cache WHERE album = ?");
@@ -256,52 +256,35 @@ void SearchDialog::localSearch(const QString &text)
 		return;
 	}
 
-	SqlDatabase db;
-
-	/// XXX: Factorize this, 3 times the (almost) same code
-	QSqlQuery qSearchForArtists(db);
-	qSearchForArtists.prepare("SELECT DISTINCT artist FROM cache WHERE artist LIKE :t LIMIT 5");
-	qSearchForArtists.bindValue(":t", "%" + text + "%");
-	if (qSearchForArtists.exec()) {
-		QList<QStandardItem*> artistList;
-		while (qSearchForArtists.next()) {
-			QString artistName = qSearchForArtists.record().value(0).toString();
-			QStandardItem *artist = new QStandardItem(artistName);
-			artist->setData(artistName, Miam::DF_Artist);
-			artist->setData(_checkBoxLibrary->text(), DT_Origin);
-			artistList.append(artist);
-		}
-		this->processResults(Artist, artistList);
-	}
+	// Words being typed are looked up in the full-text index of the library
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 
-	QSqlQuery qSearchForAlbums(db);
-	qSearchForAlbums.prepare("SELECT DISTINCT album, artist FROM cache WHERE album LIKE :t LIMIT 5");
-	qSearchForAlbums.bindValue(":t", "%" + text + "%");
-	if (qSearchForAlbums.exec()) {
-		QList<QStandardItem*> albumList;
-		while (qSearchForAlbums.next()) {
-			QStandardItem *album = new QStandardItem(qSearchForAlbums.record().value(0).toString() + " – " + qSearchForAlbums.record().value(1).toString());
-			album->setData(qSearchForAlbums.record().value(0).toString(), Miam::DF_Album);
-			album->setData(_checkBoxLibrary->text(), DT_Origin);
-			albumList.append(album);
-		}
-		this->processResults(Album, albumList);
+	QList<QStandardItem*> artistList;
+	for (QString artistName : db.searchArtists(text, 5)) {
+		QStandardItem *artist = new QStandardItem(artistName);
+		artist->setData(artistName, Miam::DF_Artist);
+		artist->setData(_checkBoxLibrary->text(), DT_Origin);
+		artistList.append(artist);
 	}
-
-	QSqlQuery qSearchForTracks(db);
-	qSearchForTracks.prepare("SELECT DISTINCT trackTitle, COALESCE(artistAlbum, artist), uri FROM cache WHERE trackTitle LIKE :t LIMIT 5");
-	qSearchForTracks.bindValue(":t", "%" + text + "%");
-	if (qSearchForTracks.exec()) {
-		QList<QStandardItem*> trackList;
-		while (qSearchForTracks.next()) {
-			QSqlRecord r = qSearchForTracks.record();
-			QStandardItem *track = new QStandardItem(r.value(0).toString() + " – " + r.value(1).toString());
-			track->setData(r.value(2).toString(), Miam::DF_URI);
-			track->setData(_checkBoxLibrary->text(), DT_Origin);
-			trackList.append(track);
-		}
-		this->processResults(Track, trackList);
+	this->processResults(Artist, artistList);
+
+	QList<QStandardItem*> albumList;
+	for (QPair<QString, QString> albumAndArtist : db.searchAlbums(text, 5)) {
+		QStandardItem *album = new QStandardItem(albumAndArtist.first + " – " + albumAndArtist.second);
+		album->setData(albumAndArtist.first, Miam::DF_Album);
+		album->setData(_checkBoxLibrary->text(), DT_Origin);
+		albumList.append(album);
+	}
+	this->processResults(Album, albumList);
+
+	QList<QStandardItem*> trackList;
+	for (TrackDAO dao : db.searchTracks(text, 5)) {
+		QStandardItem *track = new QStandardItem(dao.title() + " – " + dao.artist());
+		track->setData(dao.uri(), Miam::DF_URI);
+		track->setData(_checkBoxLibrary->text(), DT_Origin);
+		trackList.append(track);
 	}
+	this->processResults(Track, trackList);
 }
 
 /** Expand this dialog to all available space. */
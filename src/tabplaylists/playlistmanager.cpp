@@ -2,6 +2,7 @@
 
 #include <model/playlistdao.h>
 #include <model/sqldatabase.h>
+#include <model/sqlqueryservice.h>
 #include <settingsprivate.h>
 #include "playlist.h"
 #include "tabplaylist.h"
@@ -57,9 +58,14 @@ bool PlaylistManager::loadPlaylist(Playlist *p, const QFileInfo &fileInfo)
 	return !tracks.isEmpty();
 }
 
-bool PlaylistManager::deletePlaylist(uint playlistId)
+/** Result is known once saves which are still waiting have been written. */
+QFuture<bool> PlaylistManager::deletePlaylist(uint playlistId)
 {
-	return SqlDatabase().removePlaylist(playlistId);
+	// Queued after saves which are still waiting, so that a playlist can't be written again once it has been removed
+	return SqlQueryService::instance()->submit<bool>(SqlQueryService::QP_Background, QString(), SqlConnectionPool::AM_ReadWrite,
+													 [playlistId](SqlDatabase &db) {
+		return db.removePlaylist(playlistId);
+	});
 }
 
 uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiting)
@@ -77,15 +83,9 @@ uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiti
 	if (p && !p->mediaPlaylist()->isEmpty()) {
 
 		uint generateNewHash = p->generateNewHash();
-		PlaylistDAO playlist;
 
 		// Check first if one has the same playlist in database
-		for (PlaylistDAO dao : db.selectPlaylists()) {
-			if (dao.checksum().toUInt() == generateNewHash) {
-				playlist = dao;
-				break;
-			}
-		}
+		PlaylistDAO playlist = db.selectPlaylistByChecksum(QString::number(generateNewHash));
 
 		// No playlists with this checksum were found -> it's possible to write/overwrite this one
 		if (playlist.id().isEmpty()) {
@@ -127,7 +127,15 @@ uint PlaylistManager::savePlaylist(Playlist *p, bool isOverwriting, bool isExiti
 			tracks << p->model()->index(j, p->COL_TRACK_DAO).data().toString();
 		}
 
-		id = db.insertIntoTablePlaylists(playlist, tracks, isOverwriting);
+		// Tracks are written in background: the id of a new playlist is chosen now, so that the tab can keep it
+		if (playlist.id().isEmpty()) {
+			playlist.setId(QString::number(db.generatePlaylistId()));
+		}
+		id = playlist.id().toUInt();
+		SqlQueryService::instance()->submit<uint>(SqlQueryService::QP_Background, "savePlaylist/" + playlist.id(), SqlConnectionPool::AM_ReadWrite,
+												  [playlist, tracks, isOverwriting](SqlDatabase &db) {
+			return db.insertIntoTablePlaylists(playlist, tracks, isOverwriting);
+		});
 
 		p->setId(id);
 		p->setHash(generateNewHash);
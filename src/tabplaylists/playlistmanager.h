@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QFileInfo>
+#include <QFuture>
 #include "miamtabplaylists_global.hpp"
 
 /// Forward declarations
@@ -26,7 +27,8 @@ public:
 	bool loadPlaylist(Playlist *p, const QFileInfo &fileInfo);
 
 public slots:
-	bool deletePlaylist(uint playlistId);
+	/** Result is known once saves which are still waiting have been written. */
+	QFuture<bool> deletePlaylist(uint playlistId);
 
 	uint savePlaylist(Playlist *p, bool isOverwriting, bool isExiting);
 
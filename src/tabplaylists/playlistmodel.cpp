@@ -118,27 +118,22 @@ void PlaylistModel::insertMedia(int rowIndex, const FileHelper &fileHelper)
 	iconItem->setIcon(QIcon(":/icons/computer"));
 	iconItem->setToolTip(tr("Local file"));
 	if (FileHelper::suffixes(FileHelper::ET_Standard).contains(fileHelper.fileInfo().suffix())) {
-		QString title;
-		if (fileHelper.title().isEmpty()) {
-			title = fileHelper.fileInfo().baseName();
-		} else {
-			title = fileHelper.title();
-		}
+		FileHelper::Snapshot tags = fileHelper.snapshot();
+		QString title = tags.title.isEmpty() ? fileHelper.fileInfo().baseName() : tags.title;
 
 		// Then, construct a new row with correct informations
-		trackItem = new QStandardItem(fileHelper.trackNumber());
+		trackItem = new QStandardItem(QString("%1").arg(tags.trackNumber, 2, 10, QChar('0')));
 		titleItem = new QStandardItem(title);
-		albumItem = new QStandardItem(fileHelper.album());
-		lengthItem = new QStandardItem(fileHelper.length());
-		artistItem = new QStandardItem(fileHelper.artist());
+		albumItem = new QStandardItem(tags.album);
+		lengthItem = new QStandardItem(QString::number(tags.length));
+		artistItem = new QStandardItem(tags.artist);
 		ratingItem = new QStandardItem;
-		int rating = fileHelper.rating();
-		if (rating > 0) {
-			StarRating r(rating);
+		if (tags.rating > 0) {
+			StarRating r(tags.rating);
 			ratingItem->setData(QVariant::fromValue(r), Qt::DisplayRole);
 			ratingItem->setData(false, RemoteMedia);
 		}
-		yearItem = new QStandardItem(fileHelper.year());
+		yearItem = new QStandardItem(tags.year);
 		trackDAO->setData(fileHelper.fileInfo().absoluteFilePath(), Qt::DisplayRole);
 
 		trackItem->setTextAlignment(Qt::AlignCenter);
@@ -220,28 +215,22 @@ void PlaylistModel::reload()
 {
 	for (int row = 0; row < rowCount(); row++) {
 		QStandardItem *currentTrackItem = item(row, Playlist::COL_TRACK_DAO);
-		FileHelper fileHelper(currentTrackItem->data(Qt::DisplayRole).toString());
-
-		QString title;
-		if (fileHelper.title().isEmpty()) {
-			title = fileHelper.fileInfo().baseName();
-		} else {
-			title = fileHelper.title();
-		}
+		// Tags may have changed, but not the length which is already displayed
+		FileHelper fileHelper(currentTrackItem->data(Qt::DisplayRole).toString(), FileHelper::RO_SkipAudioProperties);
+		FileHelper::Snapshot tags = fileHelper.snapshot();
+		QString title = tags.title.isEmpty() ? fileHelper.fileInfo().baseName() : tags.title;
 
 		// Then, construct a new row with correct informations
-		item(row, Playlist::COL_TRACK_NUMBER)->setData(fileHelper.trackNumber(), Qt::DisplayRole);
+		item(row, Playlist::COL_TRACK_NUMBER)->setData(QString("%1").arg(tags.trackNumber, 2, 10, QChar('0')), Qt::DisplayRole);
 		item(row, Playlist::COL_TITLE)->setData(title, Qt::DisplayRole);
-		item(row, Playlist::COL_ALBUM)->setData(fileHelper.album(), Qt::DisplayRole);
-		item(row, Playlist::COL_LENGTH)->setData(fileHelper.length(), Qt::DisplayRole);
-		item(row, Playlist::COL_ARTIST)->setData(fileHelper.artist(), Qt::DisplayRole);
-		int rating = fileHelper.rating();
-		if (rating > 0) {
-			StarRating r(rating);
+		item(row, Playlist::COL_ALBUM)->setData(tags.album, Qt::DisplayRole);
+		item(row, Playlist::COL_ARTIST)->setData(tags.artist, Qt::DisplayRole);
+		if (tags.rating > 0) {
+			StarRating r(tags.rating);
 			item(row, Playlist::COL_RATINGS)->setData(QVariant::fromValue(r), Qt::DisplayRole);
 			item(row, Playlist::COL_RATINGS)->setData(false, RemoteMedia);
 		}
-		item(row, Playlist::COL_YEAR)->setData(fileHelper.year(), Qt::DisplayRole);
+		item(row, Playlist::COL_YEAR)->setData(tags.year, Qt::DisplayRole);
 	}
 }
 
@@ -1,6 +1,7 @@
 #include "tabplaylist.h"
 
 #include <model/sqldatabase.h>
+#include <model/sqlqueryservice.h>
 #include <settings.h>
 #include <settingsprivate.h>
 
@@ -395,19 +396,18 @@ void TabPlaylist::removeCurrentPlaylist()
 
 void TabPlaylist::deletePlaylist(uint playlistId)
 {
-	int index = -1;
-	for (int i = 0; i < playlists().count(); i++) {
-		Playlist *tmp = playlist(i);
-		if (tmp->id() == playlistId) {
-			index = i;
-			break;
+	SqlQueryService::whenReady<bool>(_playlistManager->deletePlaylist(playlistId), this, [this, playlistId](const bool &isDeleted) {
+		if (!isDeleted) {
+			return;
 		}
-	}
-	if (_playlistManager->deletePlaylist(playlistId)) {
-		if (index != -1) {
-			this->removeTabFromCloseButton(index);
+		// Tabs may have moved while the playlist was being deleted
+		for (int i = 0; i < playlists().count(); i++) {
+			if (playlist(i)->id() == playlistId) {
+				this->removeTabFromCloseButton(i);
+				break;
+			}
 		}
-	}
+	});
 }
 
 void TabPlaylist::changeCurrentPlaylistPlaybackMode(QMediaPlaylist::PlaybackMode mode)
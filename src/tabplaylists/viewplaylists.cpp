@@ -79,7 +79,14 @@ ViewPlaylists::ViewPlaylists(MediaPlayer *mediaPlayer, QWidget *parent)
 	// Main Splitter
 	connect(splitter, &QSplitter::splitterMoved, _searchDialog, &SearchDialog::moveSearchDialog);
 
-	connect(searchBar, &LibraryFilterLineEdit::aboutToStartSearch, library->model()->proxy(), &LibraryFilterProxyModel::findMusic);
+	connect(searchBar, &LibraryFilterLineEdit::aboutToStartSearch, this, [=](const QString &text) {
+		// Filtering reads titles and ratings of tracks from the search index. Highlighting marks items: albums which haven't
+		// been expanded yet are filled first
+		if (!text.isEmpty() && SettingsPrivate::instance()->librarySearchMode() == SettingsPrivate::LSM_HighlightOnly) {
+			library->model()->fetchAll();
+		}
+		library->model()->proxy()->findMusic(text);
+	});
 	connect(settingsPrivate, &SettingsPrivate::librarySearchModeHasChanged, this, [=]() {
 		QString text;
 		searchBar->setText(text);
@@ -169,6 +176,14 @@ ViewPlaylists::ViewPlaylists(MediaPlayer *mediaPlayer, QWidget *parent)
 		}
 	});
 
+	// Tags edited by one are patched in the library: expanded nodes and scrollbar stay where they are
+	connect(this, &AbstractView::tracksChanged, this, [=](const QStringList &removedUris, const QStringList &savedUris) {
+		library->model()->updateTracks(removedUris, savedUris);
+		for (Playlist *p : tabPlaylists->playlists()) {
+			p->model()->reload();
+		}
+	});
+
 	connect(settingsPrivate, &SettingsPrivate::languageAboutToChange, this, [=](const QString &newLanguage) {
 		QApplication::removeTranslator(&translator);
 		translator.load(":/translations/tabPlaylists_" + newLanguage);
@@ -211,6 +226,42 @@ ViewPlaylists::ViewPlaylists(MediaPlayer *mediaPlayer, QWidget *parent)
 		}
 	});
 
+	// The library is built in background: previous nodes stay visible with a progress bar below them, unless a scan
+	// already shows its own
+	connect(library->model(), &LibraryItemModel::aboutToLoad, this, [=]() {
+		if (library->layout()) {
+			return;
+		}
+		QVBoxLayout *vbox = new QVBoxLayout;
+		vbox->setMargin(0);
+
+		PaintableWidget *paintable = new PaintableWidget(library);
+		paintable->setObjectName("libraryLoading");
+		paintable->setHalfTopBorder(false);
+		paintable->setFrameBorder(false, true, true, false);
+		QVBoxLayout *vbox2 = new QVBoxLayout;
+		vbox2->addWidget(new QLabel(tr("Your library is loading..."), paintable));
+		vbox2->addWidget(new QProgressBar(paintable));
+		paintable->setLayout(vbox2);
+
+		vbox->addSpacerItem(new QSpacerItem(1, 1, QSizePolicy::Expanding, QSizePolicy::Expanding));
+		vbox->addWidget(paintable);
+		library->setLayout(vbox);
+	});
+
+	connect(library->model(), &LibraryItemModel::progressChanged, this, [=](int p) {
+		if (PaintableWidget *loading = library->findChild<PaintableWidget*>("libraryLoading")) {
+			loading->findChild<QProgressBar*>()->setValue(p);
+		}
+	});
+
+	connect(library->model(), &LibraryItemModel::loaded, this, [=]() {
+		if (PaintableWidget *loading = library->findChild<PaintableWidget*>("libraryLoading")) {
+			delete loading;
+			delete library->layout();
+		}
+	});
+
 	library->model()->load();
 }
 
@@ -254,6 +305,11 @@ int ViewPlaylists::selectedTracksInCurrentPlaylist() const
 void ViewPlaylists::setMusicSearchEngine(MusicSearchEngine *musicSearchEngine)
 {
 	connect(musicSearchEngine, &MusicSearchEngine::aboutToSearch, this, [=]() {
+		// A library which is still loading will be loaded again when the scan is over
+		if (PaintableWidget *loading = library->findChild<PaintableWidget*>("libraryLoading")) {
+			delete loading;
+			delete library->layout();
+		}
 		QVBoxLayout *vbox = new QVBoxLayout;
 		vbox->setMargin(0);
 
@@ -276,6 +332,12 @@ void ViewPlaylists::setMusicSearchEngine(MusicSearchEngine *musicSearchEngine)
 		}
 	});
 
+	connect(musicSearchEngine, &MusicSearchEngine::remainingTimeChanged, this, [=](int seconds) {
+		if (QProgressBar *progress = this->findChild<QProgressBar*>()) {
+			progress->setFormat(tr("%p% (%1 remaining)").arg(MusicSearchEngine::remainingTimeText(seconds)));
+		}
+	});
+
 	connect(musicSearchEngine, &MusicSearchEngine::searchHasEnded, this, [=]() {
 		auto l = library->layout();
 		while (!l->isEmpty()) {
@@ -425,7 +425,7 @@ void TagEditor::commitChanges()
 		// Check if files are already in the library, and then update them
 		if (!oldPaths.isEmpty()) {
 			SqlDatabase db;
-			connect(&db, &SqlDatabase::aboutToUpdateView, origin(), &AbstractView::modelReloadRequested);
+			connect(&db, &SqlDatabase::tracksChanged, origin(), &AbstractView::tracksChanged);
 			db.updateTracks(oldPaths, newPaths);
 		}
 	}
@@ -63,7 +63,8 @@ void TagEditorTableWidget::resetTable()
 		int row = it.key();
 		QFileInfo fileInfo(it.value());
 
-		FileHelper fh(fileInfo.absoluteFilePath());
+		FileHelper fh(fileInfo.absoluteFilePath(), FileHelper::RO_SkipAudioProperties);
+		FileHelper::Snapshot tags = fh.snapshot();
 
 		// Reload info
 		int column = -1;
@@ -80,18 +81,17 @@ void TagEditorTableWidget::resetTable()
 		QTableWidgetItem *comment = this->item(row, ++column);
 
 		filename->setText(fileInfo.fileName());
-		title->setText(fh.title());
-		artist->setText(fh.artist());
-		artistAlbum->setText(fh.artistAlbum());
-		album->setText(fh.album());
-		if (fh.trackNumber() != "00") {
-			trackNumber->setText(fh.trackNumber());
+		title->setText(tags.title);
+		artist->setText(tags.artist);
+		artistAlbum->setText(tags.artistAlbum);
+		album->setText(tags.album);
+		if (tags.trackNumber > 0) {
+			trackNumber->setText(QString("%1").arg(tags.trackNumber, 2, 10, QChar('0')));
 		}
-		int d = fh.discNumber(true);
-		d > 0 ? disc->setText(QString::number(d)) :	disc->setText("");
-		year->setText(fh.year());
-		genre->setText(fh.genre());
-		comment->setText(fh.comment());
+		tags.disc > 0 ? disc->setText(QString::number(tags.disc)) : disc->setText("");
+		year->setText(tags.year);
+		genre->setText(tags.genre);
+		comment->setText(tags.comment);
 
 		QList<QTableWidgetItem*> items = { filename, title, artist, artistAlbum, album, trackNumber, disc, year, genre, comment };
 		for (QTableWidgetItem *item : items) {
@@ -133,10 +133,11 @@ bool TagEditorTableWidget::addItemsToEditor(const QStringList &tracks, QMap<int,
 {
 	QSet<QPair<QString, QString>> artistAlbumSet;
 	for (QString track : tracks) {
-		FileHelper fh(track);
+		FileHelper fh(track, FileHelper::RO_SkipAudioProperties);
 		if (!fh.isValid()) {
 			continue;
 		}
+		FileHelper::Snapshot tags = fh.snapshot();
 
 		/// XXX: warning, this information is difficult to find even if public
 		QTableWidgetItem *fileName = new QTableWidgetItem(fh.fileInfo().fileName());
@@ -146,26 +147,26 @@ bool TagEditorTableWidget::addItemsToEditor(const QStringList &tracks, QMap<int,
 		QTableWidgetItem *absPath = new QTableWidgetItem(QDir::toNativeSeparators(fh.fileInfo().path()));
 		absPath->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
 
-		QTableWidgetItem *title = new QTableWidgetItem(fh.title());
-		QTableWidgetItem *artist = new QTableWidgetItem(fh.artist());
-		QTableWidgetItem *artistAlbum = new QTableWidgetItem(fh.artistAlbum());
-		QTableWidgetItem *album = new QTableWidgetItem(fh.album());
+		QTableWidgetItem *title = new QTableWidgetItem(tags.title);
+		QTableWidgetItem *artist = new QTableWidgetItem(tags.artist);
+		QTableWidgetItem *artistAlbum = new QTableWidgetItem(tags.artistAlbum);
+		QTableWidgetItem *album = new QTableWidgetItem(tags.album);
 		QTableWidgetItem *trackNumber = nullptr;
-		if (fh.trackNumber() == "00") {
+		if (tags.trackNumber == 0) {
 			trackNumber = new QTableWidgetItem();
 		} else {
-			trackNumber = new QTableWidgetItem(fh.trackNumber());
+			trackNumber = new QTableWidgetItem(QString("%1").arg(tags.trackNumber, 2, 10, QChar('0')));
 		}
 
 		QTableWidgetItem *disc;
-		if (fh.discNumber() == 0) {
+		if (tags.disc == 0) {
 			disc = new QTableWidgetItem;
 		} else {
-			disc = new QTableWidgetItem(QString::number(fh.discNumber()));
+			disc = new QTableWidgetItem(QString::number(tags.disc));
 		}
-		QTableWidgetItem *year = new QTableWidgetItem(fh.year());
-		QTableWidgetItem *genre = new QTableWidgetItem(fh.genre());
-		QTableWidgetItem *comment = new QTableWidgetItem(fh.comment());
+		QTableWidgetItem *year = new QTableWidgetItem(tags.year);
+		QTableWidgetItem *genre = new QTableWidgetItem(tags.genre);
+		QTableWidgetItem *comment = new QTableWidgetItem(tags.comment);
 
 		QList<QTableWidgetItem*> items;
 		items << fileName << absPath << title << artist << artistAlbum << album << trackNumber << disc << year << genre << comment;
@@ -88,7 +88,8 @@ TableView::TableView(QWidget *parent)
 			loadFont(newFont);
 		}
 	});
-	this->adjust();
+	// Rows are read in background
+	connect(_model, &UniqueLibraryItemModel::loaded, this, &TableView::adjust);
 	this->installEventFilter(this);
 }
 
@@ -179,7 +180,7 @@ QList<QUrl> TableView::selectedTracks()
 			}
 		}
 	}
-	SqlDatabase db;
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 	QSqlQuery q(db);
 	if (q.exec("SELECT uri FROM cache WHERE artistNormalized IN (" + artists.join(",") + ")")) {
 		while (q.next()) {
@@ -265,7 +266,7 @@ void TableView::paintEvent(QPaintEvent *event)
 
 void TableView::jumpTo(const QString &letter)
 {
-	SqlDatabase db;
+	SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 	QSqlQuery firstArtist(db);
 	firstArtist.prepare("SELECT artist FROM cache WHERE artist LIKE ? ORDER BY artist COLLATE NOCASE LIMIT ?");
 	firstArtist.addBindValue(letter + "%");
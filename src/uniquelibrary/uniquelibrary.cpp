@@ -14,6 +14,7 @@
 #include <QStandardItemModel>
 
 #include <ctime>
+#include <memory>
 #include <random>
 
 #include <QtDebug>
@@ -64,7 +65,6 @@ UniqueLibrary::UniqueLibrary(MediaPlayer *mediaPlayer, QWidget *parent)
 			_currentTrack = nullptr;
 		}
 		uniqueTable->model()->load(text);
-		uniqueTable->adjust();
 
 		uniqueTable->scrollToTop();
 		uniqueTable->verticalScrollBar()->setValue(0);
@@ -125,18 +125,23 @@ UniqueLibrary::UniqueLibrary(MediaPlayer *mediaPlayer, QWidget *parent)
 
 	uniqueTable->setFocus();
 
+	// Rows are read in background: the last track played is selected once they're all in the model
 	if (!settingsPrivate->value("uniqueLibraryLastPlayed").isNull()) {
-		int track = settingsPrivate->value("uniqueLibraryLastPlayed").toInt();
-		QModelIndex lastPlayed = uniqueTable->model()->index(track, 1);
-		if (lastPlayed.isValid()) {
-			QModelIndex p = uniqueTable->model()->proxy()->mapFromSource(lastPlayed);
-			QStandardItem *trackItem = uniqueTable->model()->itemFromIndex(lastPlayed);
-			if (p.isValid() && trackItem != nullptr) {
-				_currentTrack = trackItem;
-				uniqueTable->setCurrentIndex(p);
-				uniqueTable->scrollTo(p, QAbstractItemView::PositionAtCenter);
+		auto restoreLastPlayed = std::make_shared<QMetaObject::Connection>();
+		*restoreLastPlayed = connect(uniqueTable->model(), &UniqueLibraryItemModel::loaded, this, [=]() {
+			disconnect(*restoreLastPlayed);
+			int track = settingsPrivate->value("uniqueLibraryLastPlayed").toInt();
+			QModelIndex lastPlayed = uniqueTable->model()->index(track, 1);
+			if (lastPlayed.isValid()) {
+				QModelIndex p = uniqueTable->model()->proxy()->mapFromSource(lastPlayed);
+				QStandardItem *trackItem = uniqueTable->model()->itemFromIndex(lastPlayed);
+				if (p.isValid() && trackItem != nullptr) {
+					_currentTrack = trackItem;
+					uniqueTable->setCurrentIndex(p);
+					uniqueTable->scrollTo(p, QAbstractItemView::PositionAtCenter);
+				}
 			}
-		}
+		});
 	}
 
 	connect(qApp, &QApplication::aboutToQuit, this, [=]() {
@@ -243,6 +248,12 @@ void UniqueLibrary::setMusicSearchEngine(MusicSearchEngine *musicSearchEngine)
 		}
 	});
 
+	connect(musicSearchEngine, &MusicSearchEngine::remainingTimeChanged, this, [=](int seconds) {
+		if (QProgressBar *progress = this->findChild<QProgressBar*>()) {
+			progress->setFormat(tr("%p% (%1 remaining)").arg(MusicSearchEngine::remainingTimeText(seconds)));
+		}
+	});
+
 	connect(musicSearchEngine, &MusicSearchEngine::searchHasEnded, this, [=]() {
 		auto l = uniqueTable->layout();
 		while (!l->isEmpty()) {
@@ -255,7 +266,6 @@ void UniqueLibrary::setMusicSearchEngine(MusicSearchEngine *musicSearchEngine)
 		}
 		delete uniqueTable->layout();
 		uniqueTable->model()->load();
-		uniqueTable->adjust();
 	});
 }
 
@@ -32,7 +32,7 @@ bool UniqueLibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModel
 		if (MiamSortFilterProxyModel::filterAcceptsRow(sourceRow, sourceParent)) {
 			result = true;
 		} else {
-			SqlDatabase db;
+			SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 			QSqlQuery getArtist(db);
 			getArtist.setForwardOnly(true);
 			getArtist.prepare("SELECT * FROM cache WHERE trackTitle LIKE ?");
@@ -44,7 +44,7 @@ bool UniqueLibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModel
 		if (item->text().contains(filterRegExp().pattern(), Qt::CaseInsensitive)) {
 			result = true;
 		} else {
-			SqlDatabase db;
+			SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 			QSqlQuery getAlbum(db);
 			getAlbum.setForwardOnly(true);
 			getAlbum.prepare("SELECT * FROM cache WHERE trackTitle LIKE ?");
@@ -56,7 +56,7 @@ bool UniqueLibraryFilterProxyModel::filterAcceptsRow(int sourceRow, const QModel
 		if (filterRegExp().indexIn(item->data(Miam::DF_Artist).toString()) != -1) {
 			result = true;
 		} else {
-			SqlDatabase db;
+			SqlDatabase db(SqlConnectionPool::AM_ReadOnly);
 			QSqlQuery getDiscAlbum(db);
 			getDiscAlbum.setForwardOnly(true);
 			getDiscAlbum.prepare("SELECT * FROM cache WHERE disc > 0 AND trackTitle LIKE ?");
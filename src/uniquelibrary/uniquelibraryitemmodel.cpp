@@ -1,17 +1,25 @@
 #include "uniquelibraryitemmodel.h"
 
 #include <model/sqldatabase.h>
+#include <model/sqlqueryservice.h>
 #include <albumitem.h>
 #include <artistitem.h>
 #include <discitem.h>
 #include <trackitem.h>
 #include "coveritem.h"
 
+#include <QSignalBlocker>
 #include <QSqlQuery>
 #include <QSqlRecord>
 
 #include <QtDebug>
 
+/** Artists, albums, discs and tracks are sorted in a single list: the key of each row starts with the key of its parent. */
+static QByteArray childSortKey(const QByteArray &parentKey, const QByteArray &key)
+{
+	return parentKey + '\x01' + key;
+}
+
 UniqueLibraryItemModel::UniqueLibraryItemModel(QObject *parent)
 	: MiamItemModel(parent)
 	, _proxy(new UniqueLibraryFilterProxyModel(this))
@@ -43,18 +51,67 @@ UniqueLibraryFilterProxyModel *UniqueLibraryItemModel::proxy() const
 	return _proxy;
 }
 
+UniqueLibraryItemModel::Rows::~Rows()
+{
+	qDeleteAll(covers);
+	qDeleteAll(items);
+}
+
+/**
+ * Reads rows in background. Current ones stay in the model until new ones are ready, then they're swapped in a single
+ * reset. A load which is still running is cancelled.
+ */
 void UniqueLibraryItemModel::load(const QString &filter)
 {
-	this->deleteCache();
+	auto build = this->startBuild();
+	std::shared_ptr<Rows> rows = std::make_shared<Rows>();
 
-	SqlDatabase db;
+	// Requests with the same key are coalesced: when one is typing, only the last filter is read
+	auto service = SqlQueryService::instance();
+	QFuture<bool> isRead = service->submit<bool>(SqlQueryService::QP_Interactive, "uniqueLibraryModel", SqlConnectionPool::AM_ReadOnly,
+												 [filter, build, rows](SqlDatabase &db) {
+		return readRows(db, filter, *build, *rows);
+	});
+	SqlQueryService::whenReady<bool>(isRead, this, [this, build, rows](const bool &areRowsRead) {
+		if (!this->finishBuild(build)) {
+			return;
+		}
+		if (areRowsRead) {
+			// Views only receive the reset: items are inserted one by one, which would send a signal for each of them
+			this->beginResetModel();
+			{
+				const QSignalBlocker blocker(this);
+				this->deleteCache();
+				this->setRowCount(rows->items.size());
+				for (int row = 0; row < rows->items.size(); row++) {
+					if (rows->covers.at(row)) {
+						this->setItem(row, 0, rows->covers.at(row));
+					}
+					this->setItem(row, 1, rows->items.at(row));
+				}
+				rows->covers.clear();
+				rows->items.clear();
+			}
+			this->endResetModel();
+			this->proxy()->sort(this->proxy()->defaultSortColumn());
+			this->proxy()->setDynamicSortFilter(false);
+		}
+		emit loaded();
+	});
+}
+
+/** Called in background. False if the library can't be read, or if this load has been cancelled. */
+bool UniqueLibraryItemModel::readRows(SqlDatabase &db, const QString &filter, QFutureInterface<void> &progress, Rows &rows)
+{
+	// Artists, albums, discs and tracks are read from the same snapshot, even if a scan is writing at the same time
+	db.transaction();
 
 	QSqlQuery query(db);
 	query.setForwardOnly(true);
 	if (filter.isEmpty()) {
-		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host FROM cache");
+		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host, artistSortKey FROM cache");
 	} else {
-		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host FROM cache " \
+		query.prepare("SELECT DISTINCT artistAlbum, artistNormalized, icon, host, artistSortKey FROM cache " \
 					  "WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al");
 		query.bindValue(":t", "%" + filter + "%");
 		query.bindValue(":ar", "%" + filter + "%");
@@ -68,16 +125,23 @@ void UniqueLibraryItemModel::load(const QString &filter)
 			artist->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
 			artist->setData(query.record().value(++i).toString(), Miam::DF_IconPath);
 			artist->setData(!query.record().value(++i).toString().isEmpty(), Miam::DF_IsRemote);
-			appendRow({ nullptr, artist });
+			artist->setData(query.record().value(++i).toByteArray(), Miam::DF_SortKey);
+			rows.covers.append(nullptr);
+			rows.items.append(artist);
 		}
 	}
+	if (progress.isCanceled()) {
+		db.rollback();
+		return false;
+	}
+	progress.setProgressValue(10);
 
 	if (filter.isEmpty()) {
 		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized, albumNormalized, album, artistAlbum, " \
-					  "albumYear, icon, internalCover, cover FROM cache ORDER BY uri, internalCover");
+					  "albumYear, icon, internalCover, cover, artistSortKey, albumSortKey FROM cache ORDER BY uri, internalCover");
 	} else {
 		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized, albumNormalized, album, artistAlbum, " \
-					  "albumYear, icon, internalCover, cover FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al ORDER BY uri, internalCover");
+					  "albumYear, icon, internalCover, cover, artistSortKey, albumSortKey FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al ORDER BY uri, internalCover");
 		query.bindValue(":t", "%" + filter + "%");
 		query.bindValue(":ar", "%" + filter + "%");
 		query.bindValue(":al", "%" + filter + "%");
@@ -97,10 +161,14 @@ void UniqueLibraryItemModel::load(const QString &filter)
 			album->setData(query.record().value(++i).toString(), Miam::DF_NormAlbum);
 			album->setText(query.record().value(++i).toString());
 			album->setData(query.record().value(++i).toString(), Miam::DF_Artist);
-			album->setData(query.record().value(++i).toString(), Miam::DF_Year);
+			QString year = query.record().value(++i).toString();
+			album->setData(year, Miam::DF_Year);
 			album->setData(query.record().value(++i).toString(), Miam::DF_IconPath);
 			QString internalCover = query.record().value(++i).toString();
 			QString coverPath = query.record().value(++i).toString();
+			QByteArray artistSortKey = query.record().value(++i).toByteArray();
+			QByteArray albumSortKey = query.record().value(++i).toByteArray();
+			album->setData(childSortKey(childSortKey(artistSortKey, year.toUtf8()), albumSortKey), Miam::DF_SortKey);
 			CoverItem *cover = nullptr;
 			if (!internalCover.isEmpty() || !coverPath.isEmpty()) {
 				cover = new CoverItem;
@@ -110,16 +178,22 @@ void UniqueLibraryItemModel::load(const QString &filter)
 					cover->setData(internalCover, Miam::DF_InternalCover);
 				}
 			}
-			appendRow({ cover, album });
+			rows.covers.append(cover);
+			rows.items.append(album);
 		}
 	}
+	if (progress.isCanceled()) {
+		db.rollback();
+		return false;
+	}
+	progress.setProgressValue(20);
 
 	if (filter.isEmpty()) {
 		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1)" \
-					  ", artistAlbum, disc FROM cache WHERE disc > 0");
+					  ", artistAlbum, disc, artistSortKey, albumYear, albumSortKey FROM cache WHERE disc > 0");
 	} else {
 		query.prepare("SELECT DISTINCT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1)" \
-					  ", artistAlbum, disc FROM cache WHERE (disc > 0) AND (trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al)");
+					  ", artistAlbum, disc, artistSortKey, albumYear, albumSortKey FROM cache WHERE (disc > 0) AND (trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al)");
 		query.bindValue(":t", "%" + filter + "%");
 		query.bindValue(":ar", "%" + filter + "%");
 		query.bindValue(":al", "%" + filter + "%");
@@ -131,22 +205,38 @@ void UniqueLibraryItemModel::load(const QString &filter)
 			disc->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
 			disc->setData(query.record().value(++i).toString(), Miam::DF_Artist);
 			disc->setText(query.record().value(++i).toString());
-			appendRow({ nullptr, disc });
+			QByteArray artistSortKey = query.record().value(++i).toByteArray();
+			QByteArray year = query.record().value(++i).toString().toUtf8();
+			QByteArray albumSortKey = childSortKey(childSortKey(artistSortKey, year), query.record().value(++i).toByteArray());
+			disc->setData(childSortKey(albumSortKey, disc->text().toUtf8().rightJustified(2, '0')), Miam::DF_SortKey);
+			rows.covers.append(nullptr);
+			rows.items.append(disc);
 		}
 	}
+	if (progress.isCanceled()) {
+		db.rollback();
+		return false;
+	}
+	progress.setProgressValue(30);
 
 	if (filter.isEmpty()) {
 		query.prepare("SELECT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1) || '|' || substr('00' || trackNumber, -2, 2)  || '|' || trackTitle, " \
-					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host FROM cache");
+					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host, artistSortKey, albumYear, albumSortKey, trackSortKey FROM cache");
 	} else {
 		query.prepare("SELECT artistNormalized || '|' || albumYear  || '|' || albumNormalized || '|' || substr('0' || disc, -1, 1) || '|' || substr('00' || trackNumber, -2, 2)  || '|' || trackTitle, " \
-					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al");
+					  "trackTitle, uri, trackNumber, artistAlbum, album, trackLength, rating, disc, host, artistSortKey, albumYear, albumSortKey, trackSortKey " \
+					  "FROM cache WHERE trackTitle LIKE :t OR artist LIKE :ar OR album LIKE :al");
 		query.bindValue(":t", "%" + filter + "%");
 		query.bindValue(":ar", "%" + filter + "%");
 		query.bindValue(":al", "%" + filter + "%");
 	}
 	if (query.exec()) {
 		while (query.next()) {
+			if (rows.items.size() % 1000 == 0 && progress.isCanceled()) {
+				query.finish();
+				db.rollback();
+				return false;
+			}
 			TrackItem *track = new TrackItem;
 			int i = -1;
 			track->setData(query.record().value(++i).toString(), Miam::DF_NormalizedString);
@@ -159,10 +249,19 @@ void UniqueLibraryItemModel::load(const QString &filter)
 			track->setData(query.record().value(++i).toInt(), Miam::DF_Rating);
 			track->setData(query.record().value(++i).toString(), Miam::DF_DiscNumber);
 			track->setData(!query.record().value(++i).toString().isEmpty(), Miam::DF_IsRemote);
-			appendRow({ nullptr, track });
+			QByteArray artistSortKey = query.record().value(++i).toByteArray();
+			QByteArray year = query.record().value(++i).toString().toUtf8();
+			QByteArray albumSortKey = childSortKey(childSortKey(artistSortKey, year), query.record().value(++i).toByteArray());
+			QByteArray discSortKey = childSortKey(albumSortKey, track->data(Miam::DF_DiscNumber).toString().toUtf8().rightJustified(2, '0'));
+			QByteArray trackNumber = track->data(Miam::DF_TrackNumber).toString().toUtf8().rightJustified(3, '0');
+			track->setData(childSortKey(childSortKey(discSortKey, trackNumber), query.record().value(++i).toByteArray()), Miam::DF_SortKey);
+			rows.covers.append(nullptr);
+			rows.items.append(track);
 		}
 
 	}
-	this->proxy()->sort(this->proxy()->defaultSortColumn());
-	this->proxy()->setDynamicSortFilter(false);
+	query.finish();
+	db.commit();
+	progress.setProgressValue(100);
+	return true;
 }
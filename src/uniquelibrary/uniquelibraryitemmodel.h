@@ -6,6 +6,9 @@
 #include "uniquelibraryfilterproxymodel.h"
 #include <model/trackdao.h>
 
+/// Forward declaration
+class SqlDatabase;
+
 /**
  * \brief		The UniqueLibraryItemModel class is the model used to store all tracks in a list view.
  * \details		This class is populated from SqlDatabase where all relevant informations are gathered together:
@@ -19,6 +22,15 @@ class MIAMUNIQUELIBRARY_LIBRARY UniqueLibraryItemModel : public MiamItemModel
 private:
 	UniqueLibraryFilterProxyModel *_proxy;
 
+	/** Rows read in background, with an optional cover in the first column. Items are deleted if they're not used. */
+	struct Rows
+	{
+		QList<QStandardItem*> covers;
+		QList<QStandardItem*> items;
+
+		~Rows();
+	};
+
 public:
 	explicit UniqueLibraryItemModel(QObject *parent = nullptr);
 
@@ -26,7 +38,15 @@ public:
 
 	virtual UniqueLibraryFilterProxyModel* proxy() const override;
 
+private:
+	/** Called in background. False if the library can't be read, or if this load has been cancelled. */
+	static bool readRows(SqlDatabase &db, const QString &filter, QFutureInterface<void> &progress, Rows &rows);
+
 public slots:
+	/**
+	 * Reads rows in background. Current ones stay in the model until new ones are ready, then they're swapped in a single
+	 * reset. A load which is still running is cancelled.
+	 */
 	virtual void load(const QString & filter = QString::null) override;
 };
 